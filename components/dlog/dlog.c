@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "dlog.h"
+
+#define DLOG_RING_SIZE (1u << CONFIG_DLOG_BUFFER_ORDER)
+#define DLOG_RING_MASK (DLOG_RING_SIZE - 1)
+
+typedef struct {
+    uint32_t seq;               // slot state relative to its index, see below
+    uint16_t id;
+    uint8_t nargs;
+    uint8_t core;
+    int64_t timestamp_us;
+    uint32_t args[DLOG_MAX_ARGS];
+} dlog_record_t;
+
+/* Bounded multi-producer ring (Vyukov): slot i is free for position p when
+ * its sequence is p and holds a committed record when it is p + 1. The stored
+ * value is sequence - i so a zeroed ring is a valid empty ring. Producers on
+ * the same core can preempt each other, so head is claimed with a CAS; the
+ * drain task is the only consumer. */
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+    uint32_t written;
+    dlog_record_t slots[DLOG_RING_SIZE];
+} dlog_ring_t;
+
+static const char *TAG = "dlog";
+
+static dlog_ring_t rings[portNUM_PROCESSORS];
+static const dlog_format_t *format_table;
+static size_t format_count;
+static uint32_t drained;
+
+static inline uint32_t slot_seq(const dlog_record_t *slot, uint32_t pos) {
+    return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) + (pos & DLOG_RING_MASK);
+}
+
+static inline void slot_publish(dlog_record_t *slot, uint32_t pos, uint32_t seq) {
+    __atomic_store_n(&slot->seq, seq - (pos & DLOG_RING_MASK), __ATOMIC_RELEASE);
+}
+
+void dlog_write(uint16_t id, uint8_t nargs, const uint32_t args[DLOG_MAX_ARGS]) {
+    dlog_ring_t *r = &rings[xPortGetCoreID()];
+    uint32_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    dlog_record_t *slot;
+    for (;;) {
+        slot = &r->slots[pos & DLOG_RING_MASK];
+        const int32_t diff = (int32_t)(slot_seq(slot, pos) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->id = id;
+    slot->nargs = nargs;
+    slot->core = xPortGetCoreID();
+    slot->timestamp_us = esp_timer_get_time();
+    memcpy(slot->args, args, sizeof(slot->args));
+    slot_publish(slot, pos, pos + 1);
+    __atomic_fetch_add(&r->written, 1, __ATOMIC_RELAXED);
+}
+
+static void format_record(const dlog_record_t *rec) {
+    char line[128];
+    if (rec->id >= format_count || format_table[rec->id].fmt == NULL) {
+        ESP_LOGW(TAG, "unknown format id %u", rec->id);
+        return;
+    }
+    const dlog_format_t *f = &format_table[rec->id];
+    snprintf(line, sizeof(line), f->fmt, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+    // Keep the ESP_LOGI layout, with the time the event happened rather than now
+    esp_log_write(ESP_LOG_INFO, f->tag, "I (%lu) %s: %s\n",
+                  (unsigned long)(rec->timestamp_us / 1000), f->tag, line);
+}
+
+static void drain_ring(dlog_ring_t *r) {
+    for (;;) {
+        dlog_record_t *slot = &r->slots[r->tail & DLOG_RING_MASK];
+        if (slot_seq(slot, r->tail) != r->tail + 1) {
+            // Empty, or a preempted producer has not committed yet
+            return;
+        }
+        const dlog_record_t rec = *slot;
+        slot_publish(slot, r->tail, r->tail + DLOG_RING_SIZE);
+        r->tail++;
+        format_record(&rec);
+        drained++;
+    }
+}
+
+static void drain_task(void *arg) {
+    uint32_t reported_drops = 0;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_DLOG_DRAIN_PERIOD_MS));
+        uint32_t dropped = 0;
+        for (int i = 0; i < portNUM_PROCESSORS; i++) {
+            drain_ring(&rings[i]);
+            dropped += __atomic_load_n(&rings[i].dropped, __ATOMIC_RELAXED);
+        }
+        if (dropped != reported_drops) {
+            ESP_LOGW(TAG, "%lu records dropped", (unsigned long)(dropped - reported_drops));
+            reported_drops = dropped;
+        }
+    }
+}
+
+void dlog_init(const dlog_format_t *formats, size_t count) {
+    format_table = formats;
+    format_count = count;
+    xTaskCreate(drain_task, "dlog_drain", 1024 * 3, NULL, tskIDLE_PRIORITY + 1, NULL);
+}
+
+void dlog_get_stats(dlog_stats_t *out) {
+    *out = (dlog_stats_t) { 0 };
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        out->written += __atomic_load_n(&rings[i].written, __ATOMIC_RELAXED);
+        out->dropped += __atomic_load_n(&rings[i].dropped, __ATOMIC_RELAXED);
+    }
+    out->drained = drained;
+}
+
+#if CONFIG_DLOG_BENCHMARK
+#include "esp_cpu.h"
+
+#define DLOG_BENCH_ROUNDS 32
+
+void dlog_benchmark(uint16_t id) {
+    static const char *BENCH_TAG = "dlog_bench";
+    // Stay below the ring size so no write takes the drop path
+    const int rounds = DLOG_BENCH_ROUNDS < DLOG_RING_SIZE / 2 ? DLOG_BENCH_ROUNDS : DLOG_RING_SIZE / 2;
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < rounds; i++) {
+        ESP_LOGI(BENCH_TAG, "Read %d bytes", i);
+    }
+    const uint32_t logi_cycles = esp_cpu_get_cycle_count() - start;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < rounds; i++) {
+        DLOG(id, i);
+    }
+    const uint32_t dlog_cycles = esp_cpu_get_cycle_count() - start;
+
+    ESP_LOGI(BENCH_TAG, "ESP_LOGI: %lu cycles/call, dlog: %lu cycles/call (%d calls)",
+             (unsigned long)(logi_cycles / rounds), (unsigned long)(dlog_cycles / rounds), rounds);
+}
+#endif
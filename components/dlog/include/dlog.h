@@ -0,0 +1,54 @@
+#ifndef DLOG_H_
+#define DLOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Deferred binary logging for hot paths.
+ *
+ * A call site stores a format ID and up to DLOG_MAX_ARGS raw 32-bit
+ * arguments into a lock-free ring owned by the current core; no formatting
+ * and no console I/O happen at the call site. A low-priority drain task
+ * formats the records later using the table passed to dlog_init().
+ *
+ * Arguments are stored as uint32_t, so formats must use %lu/%ld/%lx/%c.
+ * %s is only valid for pointers to strings that outlive the record, e.g.
+ * string literals. */
+#define DLOG_MAX_ARGS 4
+
+typedef struct {
+    const char *tag;
+    const char *fmt;
+} dlog_format_t;
+
+/* Helper for building format tables from an X-macro list of (id, tag, fmt). */
+#define DLOG_FORMAT_ENTRY(id, tag, fmt) [id] = { tag, fmt },
+#define DLOG_ID_ENTRY(id, tag, fmt) id,
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;           // ring was full
+    uint32_t drained;
+} dlog_stats_t;
+
+/* Install the format table and start the drain task. Records written before
+ * this call are kept and formatted once the task runs. */
+void dlog_init(const dlog_format_t *formats, size_t count);
+
+void dlog_write(uint16_t id, uint8_t nargs, const uint32_t args[DLOG_MAX_ARGS]);
+
+void dlog_get_stats(dlog_stats_t *out);
+
+/* Compare the call-site cost of dlog_write() and ESP_LOGI. id must be an
+ * entry of the installed table whose format takes one numeric argument.
+ * Only built with CONFIG_DLOG_BENCHMARK. */
+void dlog_benchmark(uint16_t id);
+
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, N, ...) N
+#define DLOG_NARGS(...) DLOG_NARGS_(_, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+
+/* DLOG(LOG_RX_READ, len) */
+#define DLOG(id, ...) \
+    dlog_write((id), DLOG_NARGS(__VA_ARGS__), (const uint32_t[DLOG_MAX_ARGS]) { __VA_ARGS__ })
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Append-only record log on a raw flash area.
+ *
+ * The area is split into erase sectors used as a ring. Each sector starts
+ * with a header carrying a sequence number; fixed-size records follow,
+ * each ending in a CRC-32 over its global index and payload. Records are
+ * only ever programmed into erased space, the sector after the current one
+ * is kept erased as a spare, and sectors are reused in order so erases are
+ * spread evenly.
+ *
+ * Mounting reads every sector header once to find the newest sector, then
+ * binary-searches that sector for the first erased slot, so recovery costs
+ * about sectors + log2(records per sector) reads instead of a full scan.
+ *
+ * Flash access goes through journal_flash_t, so the engine runs the same on
+ * an esp_partition or on the RAM emulation in journal_ram.c. */
+
+typedef struct {
+    esp_err_t (*read)(void *ctx, uint32_t offset, void *buf, size_t len);
+    esp_err_t (*write)(void *ctx, uint32_t offset, const void *buf, size_t len);
+    esp_err_t (*erase)(void *ctx, uint32_t offset, size_t len);
+    void *ctx;
+    uint32_t size;              // usable bytes, a multiple of sector_size
+    uint32_t sector_size;
+} journal_flash_t;
+
+typedef struct {
+    uint32_t reads;             // flash read operations issued
+    uint32_t writes;            // flash program operations issued
+    uint32_t erases;            // sectors erased
+    uint32_t appends;
+    uint32_t torn;              // records found with a bad CRC
+    uint32_t mount_reads;       // reads needed by the last mount
+} journal_stats_t;
+
+typedef struct {
+    journal_flash_t flash;
+    uint16_t record_size;       // payload + 4 byte CRC
+    uint16_t records_per_sector;
+    uint16_t sectors;
+    uint16_t cur_sector;
+    uint32_t cur_seq;           // sequence number of cur_sector
+    uint16_t next_slot;         // first erased slot in cur_sector
+    journal_stats_t stats;
+} journal_t;
+
+#define JOURNAL_HEADER_SIZE 16
+#define JOURNAL_CRC_SIZE 4
+
+/* Recover the write position, formatting the area if it holds no journal.
+ * record_size includes the CRC and must be a multiple of 4. */
+esp_err_t journal_mount(journal_t *j, const journal_flash_t *flash, uint16_t record_size);
+
+/* Append one record of record_size - JOURNAL_CRC_SIZE bytes. */
+esp_err_t journal_append(journal_t *j, const void *payload);
+
+/* Append count records whose payloads are packed back to back. Records
+ * that are contiguous on flash go out in one program operation of up to
+ * 256 bytes instead of one per record. */
+esp_err_t journal_append_many(journal_t *j, const void *payloads, size_t count);
+
+/* Global indexes of the oldest retained record and one past the newest.
+ * Indexes only ever grow, so they work as stable cursors. */
+uint32_t journal_first_index(const journal_t *j);
+uint32_t journal_end_index(const journal_t *j);
+
+/* Read the record at a global index. ESP_ERR_NOT_FOUND if it has been
+ * recycled or not written yet, ESP_ERR_INVALID_CRC if it is torn. */
+esp_err_t journal_read(journal_t *j, uint32_t index, void *payload);
+
+/* Newest record with a valid CRC, looking back at most a few slots past
+ * torn ones. */
+esp_err_t journal_read_last(journal_t *j, void *payload);
+
+/* True when the next append only programs its record, the normal case
+ * since an append that fills a sector opens the next one. False only after
+ * a reset or error left the current sector full, in which case the next
+ * append also writes a header. Neither case needs an erase. */
+bool journal_next_is_in_place(const journal_t *j);
+
+/* Backends. */
+esp_err_t journal_ram_init(journal_flash_t *flash, uint32_t size, uint32_t sector_size);
+void journal_ram_free(journal_flash_t *flash);
+esp_err_t journal_partition_init(journal_flash_t *flash, const char *label);
+
+/* Append throughput, erase spread and recovery cost on the RAM emulation.
+ * Only built with CONFIG_JOURNAL_BENCHMARK. */
+void journal_benchmark(void);
+
+#endif
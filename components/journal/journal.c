@@ -0,0 +1,286 @@
+#include <string.h>
+#include "journal.h"
+
+#define JOURNAL_MAGIC 0x4C4E524A        // "JRNL"
+#define JOURNAL_MAX_RECORD 64
+#define JOURNAL_LAST_LOOKBACK 4
+#define JOURNAL_BATCH_BYTES 256
+
+// Kept local so the engine has no target dependencies
+static uint32_t crc32(uint32_t crc, const uint8_t *p, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static esp_err_t flash_read(journal_t *j, uint32_t offset, void *buf, size_t len) {
+    j->stats.reads++;
+    return j->flash.read(j->flash.ctx, offset, buf, len);
+}
+
+static esp_err_t flash_write(journal_t *j, uint32_t offset, const void *buf, size_t len) {
+    j->stats.writes++;
+    return j->flash.write(j->flash.ctx, offset, buf, len);
+}
+
+static esp_err_t flash_erase_sector(journal_t *j, uint16_t sector) {
+    j->stats.erases++;
+    return j->flash.erase(j->flash.ctx, (uint32_t)sector * j->flash.sector_size, j->flash.sector_size);
+}
+
+static uint32_t slot_offset(const journal_t *j, uint16_t sector, uint16_t slot) {
+    return (uint32_t)sector * j->flash.sector_size + JOURNAL_HEADER_SIZE + (uint32_t)slot * j->record_size;
+}
+
+static bool is_blank(const uint8_t *p, size_t len) {
+    while (len--) {
+        if (*p++ != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool read_header(journal_t *j, uint16_t sector, uint32_t *seq) {
+    uint8_t h[JOURNAL_HEADER_SIZE];
+    if (flash_read(j, (uint32_t)sector * j->flash.sector_size, h, sizeof(h)) != ESP_OK) {
+        return false;
+    }
+    if (get_u32(&h[0]) != JOURNAL_MAGIC || get_u32(&h[12]) != crc32(0, h, 12) ||
+        (h[8] | h[9] << 8) != j->record_size) {
+        return false;
+    }
+    *seq = get_u32(&h[4]);
+    return true;
+}
+
+static esp_err_t write_header(journal_t *j, uint16_t sector, uint32_t seq) {
+    uint8_t h[JOURNAL_HEADER_SIZE];
+    put_u32(&h[0], JOURNAL_MAGIC);
+    put_u32(&h[4], seq);
+    h[8] = j->record_size;
+    h[9] = j->record_size >> 8;
+    h[10] = 0xFF;
+    h[11] = 0xFF;
+    put_u32(&h[12], crc32(0, h, 12));
+    return flash_write(j, (uint32_t)sector * j->flash.sector_size, h, sizeof(h));
+}
+
+// Erase the sector unless every byte already reads as erased, which also
+// catches an erase that was interrupted by a reset
+static esp_err_t ensure_blank(journal_t *j, uint16_t sector) {
+    uint8_t buf[64];
+    const uint32_t base = (uint32_t)sector * j->flash.sector_size;
+    for (uint32_t off = 0; off < j->flash.sector_size; off += sizeof(buf)) {
+        esp_err_t err = flash_read(j, base + off, buf, sizeof(buf));
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (!is_blank(buf, sizeof(buf))) {
+            return flash_erase_sector(j, sector);
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t format(journal_t *j) {
+    esp_err_t err = flash_erase_sector(j, 0);
+    if (err == ESP_OK) {
+        err = write_header(j, 0, 1);
+    }
+    if (err == ESP_OK) {
+        err = flash_erase_sector(j, 1);
+    }
+    j->cur_sector = 0;
+    j->cur_seq = 1;
+    j->next_slot = 0;
+    return err;
+}
+
+esp_err_t journal_mount(journal_t *j, const journal_flash_t *flash, uint16_t record_size) {
+    if (record_size % 4 || record_size <= JOURNAL_CRC_SIZE || record_size > JOURNAL_MAX_RECORD ||
+        flash->sector_size <= (uint32_t)JOURNAL_HEADER_SIZE + record_size || flash->size / flash->sector_size < 3) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(j, 0, sizeof(*j));
+    j->flash = *flash;
+    j->record_size = record_size;
+    j->records_per_sector = (flash->sector_size - JOURNAL_HEADER_SIZE) / record_size;
+    j->sectors = flash->size / flash->sector_size;
+
+    // Newest sector: one header read per sector
+    bool found = false;
+    for (uint16_t s = 0; s < j->sectors; s++) {
+        uint32_t seq;
+        if (read_header(j, s, &seq) && (!found || seq > j->cur_seq)) {
+            found = true;
+            j->cur_sector = s;
+            j->cur_seq = seq;
+        }
+    }
+    if (!found) {
+        esp_err_t err = format(j);
+        j->stats.mount_reads = j->stats.reads;
+        return err;
+    }
+
+    // Records fill a sector front to back, so "slot is programmed" is monotonic
+    uint8_t rec[JOURNAL_MAX_RECORD];
+    uint16_t lo = 0, hi = j->records_per_sector;
+    while (lo < hi) {
+        const uint16_t mid = lo + (hi - lo) / 2;
+        esp_err_t err = flash_read(j, slot_offset(j, j->cur_sector, mid), rec, record_size);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (is_blank(rec, record_size)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    j->next_slot = lo;
+
+    // A reset between writing a new header and erasing the next spare leaves
+    // old data in the spare; only its header needs checking here
+    uint8_t h[JOURNAL_HEADER_SIZE];
+    const uint16_t spare = (j->cur_sector + 1) % j->sectors;
+    esp_err_t err = flash_read(j, (uint32_t)spare * flash->sector_size, h, sizeof(h));
+    if (err == ESP_OK && !is_blank(h, sizeof(h))) {
+        err = flash_erase_sector(j, spare);
+    }
+    j->stats.mount_reads = j->stats.reads;
+    return err;
+}
+
+static esp_err_t rotate(journal_t *j) {
+    const uint16_t next = (j->cur_sector + 1) % j->sectors;
+    esp_err_t err = ensure_blank(j, next);
+    if (err == ESP_OK) {
+        err = write_header(j, next, j->cur_seq + 1);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    j->cur_sector = next;
+    j->cur_seq++;
+    j->next_slot = 0;
+    // Prepare the following sector now so no append has to wait for an erase
+    return flash_erase_sector(j, (next + 1) % j->sectors);
+}
+
+static uint32_t record_crc(uint32_t index, const uint8_t *payload, size_t len) {
+    uint8_t idx[4];
+    put_u32(idx, index);
+    return crc32(crc32(0, idx, sizeof(idx)), payload, len);
+}
+
+esp_err_t journal_append_many(journal_t *j, const void *payloads, size_t count) {
+    const size_t len = j->record_size - JOURNAL_CRC_SIZE;
+    const uint8_t *src = payloads;
+    uint8_t buf[JOURNAL_BATCH_BYTES];
+    while (count > 0) {
+        if (j->next_slot >= j->records_per_sector) {
+            esp_err_t err = rotate(j);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        // As many records as fit the buffer and the current sector, in one program
+        size_t n = sizeof(buf) / j->record_size;
+        if (n > count) {
+            n = count;
+        }
+        if (n > (size_t)(j->records_per_sector - j->next_slot)) {
+            n = j->records_per_sector - j->next_slot;
+        }
+        for (size_t i = 0; i < n; i++) {
+            uint8_t *rec = &buf[i * j->record_size];
+            memcpy(rec, src, len);
+            put_u32(&rec[len], record_crc(journal_end_index(j) + i, rec, len));
+            src += len;
+        }
+        esp_err_t err = flash_write(j, slot_offset(j, j->cur_sector, j->next_slot), buf, n * j->record_size);
+        // A failed program may have changed bits, never reuse the slots
+        j->next_slot += n;
+        if (err != ESP_OK) {
+            return err;
+        }
+        j->stats.appends += n;
+        count -= n;
+        // Open the next sector right away so the following append is a single
+        // program; on failure the rotation is retried by that append
+        if (j->next_slot == j->records_per_sector) {
+            rotate(j);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_append(journal_t *j, const void *payload) {
+    return journal_append_many(j, payload, 1);
+}
+
+uint32_t journal_first_index(const journal_t *j) {
+    // All sectors but the spare hold data
+    const uint32_t retained = j->sectors - 1;
+    const uint32_t first_seq = j->cur_seq > retained ? j->cur_seq - retained + 1 : 1;
+    return (first_seq - 1) * j->records_per_sector;
+}
+
+uint32_t journal_end_index(const journal_t *j) {
+    return (j->cur_seq - 1) * j->records_per_sector + j->next_slot;
+}
+
+esp_err_t journal_read(journal_t *j, uint32_t index, void *payload) {
+    if (index < journal_first_index(j) || index >= journal_end_index(j)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const uint32_t seq = index / j->records_per_sector + 1;
+    const uint16_t slot = index % j->records_per_sector;
+    const uint16_t sector = (j->cur_sector + j->sectors - (j->cur_seq - seq)) % j->sectors;
+
+    uint8_t rec[JOURNAL_MAX_RECORD];
+    esp_err_t err = flash_read(j, slot_offset(j, sector, slot), rec, j->record_size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const size_t len = j->record_size - JOURNAL_CRC_SIZE;
+    if (get_u32(&rec[len]) != record_crc(index, rec, len)) {
+        j->stats.torn++;
+        return ESP_ERR_INVALID_CRC;
+    }
+    memcpy(payload, rec, len);
+    return ESP_OK;
+}
+
+esp_err_t journal_read_last(journal_t *j, void *payload) {
+    const uint32_t first = journal_first_index(j);
+    uint32_t index = journal_end_index(j);
+    for (int i = 0; i < JOURNAL_LAST_LOOKBACK && index > first; i++) {
+        if (journal_read(j, --index, payload) == ESP_OK) {
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+bool journal_next_is_in_place(const journal_t *j) {
+    return j->next_slot < j->records_per_sector;
+}
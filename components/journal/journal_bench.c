@@ -0,0 +1,42 @@
+#include "sdkconfig.h"
+
+#if CONFIG_JOURNAL_BENCHMARK
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "journal.h"
+
+#define BENCH_SIZE (64 * 1024)
+#define BENCH_SECTOR 4096
+#define BENCH_RECORD 16
+#define BENCH_APPENDS 20000
+
+void journal_benchmark(void) {
+    static const char *BENCH_TAG = "journal_bench";
+    journal_flash_t flash;
+    if (journal_ram_init(&flash, BENCH_SIZE, BENCH_SECTOR) != ESP_OK) {
+        ESP_LOGE(BENCH_TAG, "no memory for the emulated partition");
+        return;
+    }
+
+    journal_t j;
+    journal_mount(&j, &flash, BENCH_RECORD);
+    uint8_t payload[BENCH_RECORD - JOURNAL_CRC_SIZE] = { 0 };
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < BENCH_APPENDS; i++) {
+        payload[0] = i;
+        journal_append(&j, payload);
+    }
+    const int64_t append_us = esp_timer_get_time() - start;
+    ESP_LOGI(BENCH_TAG, "%d appends in %lld us (%lld appends/s), %lu erases, %.1f per sector",
+             BENCH_APPENDS, (long long)append_us, (long long)BENCH_APPENDS * 1000000 / (append_us ? append_us : 1),
+             (unsigned long)j.stats.erases, (double)j.stats.erases / j.sectors);
+
+    start = esp_timer_get_time();
+    journal_mount(&j, &flash, BENCH_RECORD);
+    const int64_t mount_us = esp_timer_get_time() - start;
+    ESP_LOGI(BENCH_TAG, "recovery: %lu reads in %lld us (full scan: %u reads), end index %lu",
+             (unsigned long)j.stats.mount_reads, (long long)mount_us,
+             (unsigned)(j.sectors * (j.records_per_sector + 1)), (unsigned long)journal_end_index(&j));
+    journal_ram_free(&flash);
+}
+#endif
@@ -0,0 +1,30 @@
+#include "esp_partition.h"
+#include "journal.h"
+
+static esp_err_t part_read(void *ctx, uint32_t offset, void *buf, size_t len) {
+    return esp_partition_read(ctx, offset, buf, len);
+}
+
+static esp_err_t part_write(void *ctx, uint32_t offset, const void *buf, size_t len) {
+    return esp_partition_write(ctx, offset, buf, len);
+}
+
+static esp_err_t part_erase(void *ctx, uint32_t offset, size_t len) {
+    return esp_partition_erase_range(ctx, offset, len);
+}
+
+esp_err_t journal_partition_init(journal_flash_t *flash, const char *label) {
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *flash = (journal_flash_t) {
+        .read = part_read,
+        .write = part_write,
+        .erase = part_erase,
+        .ctx = (void *)part,
+        .size = part->size - part->size % part->erase_size,
+        .sector_size = part->erase_size,
+    };
+    return ESP_OK;
+}
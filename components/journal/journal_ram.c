@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <string.h>
+#include "journal.h"
+
+/* RAM stand-in for a NOR flash partition: programming can only clear bits
+ * and erase works on whole sectors, like the real part. Used for
+ * benchmarks and for exercising the engine off-target. */
+
+typedef struct {
+    uint8_t *mem;
+    uint32_t size;
+    uint32_t sector_size;
+} ram_flash_t;
+
+static esp_err_t ram_read(void *ctx, uint32_t offset, void *buf, size_t len) {
+    ram_flash_t *f = ctx;
+    if (offset + len > f->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buf, &f->mem[offset], len);
+    return ESP_OK;
+}
+
+static esp_err_t ram_write(void *ctx, uint32_t offset, const void *buf, size_t len) {
+    ram_flash_t *f = ctx;
+    if (offset + len > f->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t *src = buf;
+    for (size_t i = 0; i < len; i++) {
+        f->mem[offset + i] &= src[i];
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ram_erase(void *ctx, uint32_t offset, size_t len) {
+    ram_flash_t *f = ctx;
+    if (offset % f->sector_size || len % f->sector_size || offset + len > f->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&f->mem[offset], 0xFF, len);
+    return ESP_OK;
+}
+
+esp_err_t journal_ram_init(journal_flash_t *flash, uint32_t size, uint32_t sector_size) {
+    ram_flash_t *f = calloc(1, sizeof(*f));
+    if (f == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    f->mem = malloc(size);
+    if (f->mem == NULL) {
+        free(f);
+        return ESP_ERR_NO_MEM;
+    }
+    // Fresh parts come erased
+    memset(f->mem, 0xFF, size);
+    f->size = size;
+    f->sector_size = sector_size;
+    *flash = (journal_flash_t) {
+        .read = ram_read,
+        .write = ram_write,
+        .erase = ram_erase,
+        .ctx = f,
+        .size = size,
+        .sector_size = sector_size,
+    };
+    return ESP_OK;
+}
+
+void journal_ram_free(journal_flash_t *flash) {
+    ram_flash_t *f = flash->ctx;
+    if (f) {
+        free(f->mem);
+        free(f);
+        flash->ctx = NULL;
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef LINK_PROTO_H_
+#define LINK_PROTO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Binary frames exchanged between master and slave over UART:
+ *
+ *   SOF(0xA5) | type | len | payload[len] | crc16 (LE)
+ *
+ * The CRC is CRC-16/CCITT-FALSE over type, len and payload. All multi-byte
+ * payload fields are little-endian and written with the put/get helpers so
+ * the layout does not depend on struct packing. */
+#define LINK_SOF 0xA5
+#define LINK_MAX_PAYLOAD 64
+#define LINK_HEADER_LEN 3
+#define LINK_CRC_LEN 2
+#define LINK_MAX_FRAME (LINK_HEADER_LEN + LINK_MAX_PAYLOAD + LINK_CRC_LEN)
+
+typedef enum {
+    LINK_FRAME_TELEMETRY = 0x01,
+    LINK_FRAME_HELLO = 0x02,        // master -> slave capabilities; slave -> master link-up announce
+    LINK_FRAME_HELLO_ACK = 0x03,    // slave -> master capabilities in reply to HELLO
+    LINK_FRAME_COMMAND = 0x04,      // master -> slave, see link_command_pack()
+} link_frame_type_t;
+
+/* Commands understood by the slave. Peers that did not complete the
+ * capability exchange use the legacy text strings instead. */
+typedef enum {
+    LINK_CMD_NONE = 0,
+    LINK_CMD_START = 1,
+    LINK_CMD_STOP = 2,
+    LINK_CMD_RESET = 3,
+} link_cmd_t;
+
+#define LINK_LEGACY_START "Power on - start counting"
+#define LINK_LEGACY_STOP "Power off - stop counting time"
+#define LINK_LEGACY_RESET "RESET"
+
+/* COMMAND payload: a link_cmd_t, optionally followed by a 16-bit channel.
+ * The one-byte form addresses channel 0, which is all older slaves have;
+ * legacy text commands always address channel 0. */
+#define LINK_COMMAND_MAX_LEN 3
+
+/* Capability exchange at link-up. The master sends HELLO, the slave answers
+ * HELLO_ACK, and both sides run link_negotiate() on the pair so they agree on
+ * the result without a third message. A peer that never answers is legacy
+ * and gets text commands. */
+#define LINK_PROTO_VERSION 1
+#define LINK_HELLO_LEN 6
+
+#define LINK_FEAT_BINARY_CMD (1 << 0)   // accepts LINK_FRAME_COMMAND
+#define LINK_FEAT_TELEMETRY (1 << 1)    // sends/accepts LINK_FRAME_TELEMETRY
+#define LINK_FEAT_BAUD_SWITCH (1 << 2)  // can move to a faster common baud rate
+
+/* Baud rates a peer may offer, one bit each in link_hello_t.bauds. */
+#define LINK_BAUD_COUNT 4
+extern const uint32_t link_bauds[LINK_BAUD_COUNT];
+
+typedef struct {
+    uint8_t version;
+    uint8_t max_payload;
+    uint16_t features;          // LINK_FEAT_*
+    uint16_t bauds;             // bit i set: link_bauds[i] supported
+} link_hello_t;
+
+/* Periodic slave -> master status. */
+#define LINK_TELEMETRY_VERSION 1
+#define LINK_TELEMETRY_LEN 30
+
+#define LINK_TELEMETRY_RUNNING (1 << 0)
+
+typedef struct {
+    uint8_t version;
+    uint8_t flags;              // LINK_TELEMETRY_*
+    uint32_t uptime_ms;         // slave uptime when the frame was built
+    uint32_t counter_s;         // counted time in seconds
+    uint16_t rx_frame_errors;   // UART framing/parity errors
+    uint16_t rx_overflows;      // FIFO overflows and ring buffer full events
+    uint16_t rx_unknown;        // commands that did not parse
+    uint32_t persist_writes;    // successful persistent commits
+    uint16_t persist_errors;    // failed persistent commits
+    uint32_t free_heap;
+    uint32_t min_free_heap;
+} link_telemetry_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t len;
+    uint8_t payload[LINK_MAX_PAYLOAD];
+} link_frame_t;
+
+/* Incremental frame decoder, fed one byte at a time from the UART stream. */
+typedef struct {
+    enum { LINK_WAIT_SOF, LINK_TYPE, LINK_LEN, LINK_PAYLOAD, LINK_CRC_LO, LINK_CRC_HI } state;
+    uint8_t pos;
+    uint16_t crc;
+    link_frame_t frame;
+    uint32_t frames;            // frames accepted
+    uint32_t crc_errors;        // frames dropped on CRC mismatch
+    uint32_t junk;              // bytes skipped while hunting for SOF
+} link_decoder_t;
+
+uint16_t link_crc16(uint16_t crc, const uint8_t *data, size_t len);
+
+void link_decoder_init(link_decoder_t *d);
+
+/* Returns true when byte completes a valid frame, which is then in d->frame
+ * until the next call. */
+bool link_decoder_feed(link_decoder_t *d, uint8_t byte);
+
+/* Encode a frame into out (at least LINK_MAX_FRAME bytes). Returns the frame
+ * length, or 0 if len is too large. */
+size_t link_encode(uint8_t type, const void *payload, uint8_t len, uint8_t *out);
+
+void link_hello_pack(const link_hello_t *h, uint8_t out[LINK_HELLO_LEN]);
+bool link_hello_unpack(const link_frame_t *f, link_hello_t *h);
+
+/* Common capabilities of two peers. Baud switching is only kept when
+ * telemetry is too, since the periodic frames are what lets the master
+ * notice a slave that reset back to its default baud rate. */
+void link_negotiate(const link_hello_t *local, const link_hello_t *peer, link_hello_t *out);
+
+/* Mask of the rates in link_bauds up to max_baud, and the fastest rate in a
+ * mask (0 if empty). */
+uint16_t link_baud_mask(uint32_t max_baud);
+uint32_t link_baud_fastest(uint16_t mask);
+
+/* Returns the payload length: 1 for channel 0, 3 otherwise. */
+size_t link_command_pack(link_cmd_t cmd, uint16_t channel, uint8_t out[LINK_COMMAND_MAX_LEN]);
+bool link_command_unpack(const link_frame_t *f, link_cmd_t *cmd, uint16_t *channel);
+
+link_cmd_t link_parse_legacy(const char *text);
+const char *link_legacy_text(link_cmd_t cmd);
+
+void link_telemetry_pack(const link_telemetry_t *t, uint8_t out[LINK_TELEMETRY_LEN]);
+bool link_telemetry_unpack(const link_frame_t *f, link_telemetry_t *t);
+
+static inline void link_put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void link_put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static inline uint16_t link_get_u16(const uint8_t *p) {
+    return p[0] | (uint16_t)p[1] << 8;
+}
+
+static inline uint32_t link_get_u32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include <string.h>
+#include "link_proto.h"
+
+const uint32_t link_bauds[LINK_BAUD_COUNT] = { 115200, 230400, 460800, 921600 };
+
+uint16_t link_crc16(uint16_t crc, const uint8_t *data, size_t len) {
+    while (len--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void link_decoder_init(link_decoder_t *d) {
+    memset(d, 0, sizeof(*d));
+    d->state = LINK_WAIT_SOF;
+}
+
+bool link_decoder_feed(link_decoder_t *d, uint8_t byte) {
+    switch (d->state) {
+    case LINK_WAIT_SOF:
+        if (byte == LINK_SOF) {
+            d->state = LINK_TYPE;
+        } else {
+            d->junk++;
+        }
+        return false;
+    case LINK_TYPE:
+        d->frame.type = byte;
+        d->state = LINK_LEN;
+        return false;
+    case LINK_LEN:
+        if (byte > LINK_MAX_PAYLOAD) {
+            // Cannot be one of ours, resynchronise on the next SOF
+            d->junk += 3;
+            d->state = LINK_WAIT_SOF;
+            return false;
+        }
+        d->frame.len = byte;
+        d->pos = 0;
+        d->state = byte ? LINK_PAYLOAD : LINK_CRC_LO;
+        return false;
+    case LINK_PAYLOAD:
+        d->frame.payload[d->pos++] = byte;
+        if (d->pos == d->frame.len) {
+            d->state = LINK_CRC_LO;
+        }
+        return false;
+    case LINK_CRC_LO:
+        d->crc = byte;
+        d->state = LINK_CRC_HI;
+        return false;
+    case LINK_CRC_HI: {
+        d->crc |= (uint16_t)byte << 8;
+        d->state = LINK_WAIT_SOF;
+        uint8_t hdr[2] = { d->frame.type, d->frame.len };
+        uint16_t crc = link_crc16(0xFFFF, hdr, sizeof(hdr));
+        crc = link_crc16(crc, d->frame.payload, d->frame.len);
+        if (crc != d->crc) {
+            d->crc_errors++;
+            return false;
+        }
+        d->frames++;
+        return true;
+    }
+    }
+    return false;
+}
+
+size_t link_encode(uint8_t type, const void *payload, uint8_t len, uint8_t *out) {
+    if (len > LINK_MAX_PAYLOAD) {
+        return 0;
+    }
+    out[0] = LINK_SOF;
+    out[1] = type;
+    out[2] = len;
+    if (len) {
+        memcpy(&out[LINK_HEADER_LEN], payload, len);
+    }
+    uint16_t crc = link_crc16(0xFFFF, &out[1], 2 + len);
+    link_put_u16(&out[LINK_HEADER_LEN + len], crc);
+    return LINK_HEADER_LEN + len + LINK_CRC_LEN;
+}
+
+void link_telemetry_pack(const link_telemetry_t *t, uint8_t out[LINK_TELEMETRY_LEN]) {
+    out[0] = t->version;
+    out[1] = t->flags;
+    link_put_u32(&out[2], t->uptime_ms);
+    link_put_u32(&out[6], t->counter_s);
+    link_put_u16(&out[10], t->rx_frame_errors);
+    link_put_u16(&out[12], t->rx_overflows);
+    link_put_u16(&out[14], t->rx_unknown);
+    link_put_u32(&out[16], t->persist_writes);
+    link_put_u16(&out[20], t->persist_errors);
+    link_put_u32(&out[22], t->free_heap);
+    link_put_u32(&out[26], t->min_free_heap);
+}
+
+bool link_telemetry_unpack(const link_frame_t *f, link_telemetry_t *t) {
+    // Newer slaves may append fields; accept anything at least as long as v1
+    if (f->type != LINK_FRAME_TELEMETRY || f->len < LINK_TELEMETRY_LEN) {
+        return false;
+    }
+    const uint8_t *p = f->payload;
+    t->version = p[0];
+    t->flags = p[1];
+    t->uptime_ms = link_get_u32(&p[2]);
+    t->counter_s = link_get_u32(&p[6]);
+    t->rx_frame_errors = link_get_u16(&p[10]);
+    t->rx_overflows = link_get_u16(&p[12]);
+    t->rx_unknown = link_get_u16(&p[14]);
+    t->persist_writes = link_get_u32(&p[16]);
+    t->persist_errors = link_get_u16(&p[20]);
+    t->free_heap = link_get_u32(&p[22]);
+    t->min_free_heap = link_get_u32(&p[26]);
+    return true;
+}
+
+void link_hello_pack(const link_hello_t *h, uint8_t out[LINK_HELLO_LEN]) {
+    out[0] = h->version;
+    out[1] = h->max_payload;
+    link_put_u16(&out[2], h->features);
+    link_put_u16(&out[4], h->bauds);
+}
+
+bool link_hello_unpack(const link_frame_t *f, link_hello_t *h) {
+    if ((f->type != LINK_FRAME_HELLO && f->type != LINK_FRAME_HELLO_ACK) || f->len < LINK_HELLO_LEN) {
+        return false;
+    }
+    h->version = f->payload[0];
+    h->max_payload = f->payload[1];
+    h->features = link_get_u16(&f->payload[2]);
+    h->bauds = link_get_u16(&f->payload[4]);
+    return true;
+}
+
+void link_negotiate(const link_hello_t *local, const link_hello_t *peer, link_hello_t *out) {
+    out->version = local->version < peer->version ? local->version : peer->version;
+    out->max_payload = local->max_payload < peer->max_payload ? local->max_payload : peer->max_payload;
+    out->features = local->features & peer->features;
+    out->bauds = local->bauds & peer->bauds;
+    if (!(out->features & LINK_FEAT_TELEMETRY)) {
+        out->features &= ~LINK_FEAT_BAUD_SWITCH;
+    }
+}
+
+uint16_t link_baud_mask(uint32_t max_baud) {
+    uint16_t mask = 0;
+    for (int i = 0; i < LINK_BAUD_COUNT; i++) {
+        if (link_bauds[i] <= max_baud) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+uint32_t link_baud_fastest(uint16_t mask) {
+    for (int i = LINK_BAUD_COUNT - 1; i >= 0; i--) {
+        if (mask & (1 << i)) {
+            return link_bauds[i];
+        }
+    }
+    return 0;
+}
+
+size_t link_command_pack(link_cmd_t cmd, uint16_t channel, uint8_t out[LINK_COMMAND_MAX_LEN]) {
+    out[0] = cmd;
+    if (channel == 0) {
+        return 1;
+    }
+    link_put_u16(&out[1], channel);
+    return 3;
+}
+
+bool link_command_unpack(const link_frame_t *f, link_cmd_t *cmd, uint16_t *channel) {
+    if (f->type != LINK_FRAME_COMMAND || f->len < 1) {
+        return false;
+    }
+    *cmd = (link_cmd_t)f->payload[0];
+    *channel = f->len >= 3 ? link_get_u16(&f->payload[1]) : 0;
+    return true;
+}
+
+link_cmd_t link_parse_legacy(const char *text) {
+    if (strcmp(text, LINK_LEGACY_START) == 0) {
+        return LINK_CMD_START;
+    } else if (strcmp(text, LINK_LEGACY_STOP) == 0) {
+        return LINK_CMD_STOP;
+    } else if (strcmp(text, LINK_LEGACY_RESET) == 0) {
+        return LINK_CMD_RESET;
+    }
+    return LINK_CMD_NONE;
+}
+
+const char *link_legacy_text(link_cmd_t cmd) {
+    switch (cmd) {
+    case LINK_CMD_START:
+        return LINK_LEGACY_START;
+    case LINK_CMD_STOP:
+        return LINK_LEGACY_STOP;
+    case LINK_CMD_RESET:
+        return LINK_LEGACY_RESET;
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef WIFI_FAST_H_
+#define WIFI_FAST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/* Station connect that gets faster after the first success.
+ *
+ * Once a connection has an IP, the BSSID and channel of its access point
+ * are cached in NVS, written only when they change. The next start locks
+ * onto that BSSID on that one channel, skipping the all-channel scan; if
+ * the attempt fails the lock is dropped and the normal scan runs without
+ * using up a retry. The lease is reused by lwIP itself: with
+ * CONFIG_LWIP_DHCP_RESTORE_LAST_IP the client asks for the previous
+ * address straight away instead of discovering. CONFIG_WIFI_FAST_STATIC_IP
+ * skips DHCP altogether.
+ *
+ * Every connection logs its time to IP, split into association and
+ * address, together with the path it took. NVS must be initialised
+ * first. */
+typedef struct {
+    bool connected;
+    bool cached;                // associated through the cached BSSID and channel
+    bool static_ip;
+    uint32_t connects;          // connections that reached an IP
+    int64_t associate_us;       // last connection: attempt start to association
+    int64_t ip_us;              // last connection: attempt start to IP
+} wifi_fast_status_t;
+
+/* Network interface, default event loop and Wi-Fi driver. Register any
+ * extra event handlers between this and wifi_fast_connect(). */
+esp_err_t wifi_fast_init(void);
+
+/* Start connecting and return. Disconnects are retried up to max_retry
+ * times in a row, counting only attempts with the full scan. After that
+ * wifi_fast_wait() reports the failure, but the station keeps trying with
+ * a backoff that doubles from 1 s up to 60 s, so a later connection still
+ * comes through as IP_EVENT_STA_GOT_IP. */
+esp_err_t wifi_fast_connect(const char *ssid, const char *password, int max_retry);
+
+/* Wait until the station has an IP or has run out of its max_retry
+ * retries. True when connected. */
+bool wifi_fast_wait(TickType_t timeout);
+
+void wifi_fast_get_status(wifi_fast_status_t *out);
+
+#endif
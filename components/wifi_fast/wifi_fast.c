@@ -0,0 +1,236 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "wifi_fast.h"
+
+#define NVS_NAMESPACE "wifi_fast"
+#define NVS_KEY "ap"
+#define CACHE_VERSION 1
+
+#define CONNECTED_BIT BIT0
+#define FAIL_BIT BIT1
+
+// Past max_retries the station keeps trying, backing off up to a minute
+#define BACKOFF_MIN_US (1000 * 1000LL)
+#define BACKOFF_MAX_US (60 * 1000 * 1000LL)
+
+static const char *TAG = "wifi_fast";
+
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[33];
+} ap_cache_t;
+
+static esp_netif_t *netif;
+static EventGroupHandle_t events;
+static wifi_config_t config;
+static ap_cache_t cache;        // what NVS holds, to skip rewriting it
+static int max_retries;
+static int retries;
+static int64_t backoff_us = BACKOFF_MIN_US;
+static esp_timer_handle_t retry_timer;
+static bool pinned;             // config locked to the cached BSSID and channel
+static int64_t attempt_us;      // start of the current connection attempt
+static wifi_fast_status_t status;
+static portMUX_TYPE status_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool load_cache(const char *ssid) {
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(cache);
+    const esp_err_t err = nvs_get_blob(nvs, NVS_KEY, &cache, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(cache) && cache.version == CACHE_VERSION &&
+           cache.channel != 0 && strncmp(cache.ssid, ssid, sizeof(cache.ssid)) == 0;
+}
+
+static void save_cache(void) {
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+    ap_cache_t c = {
+        .version = CACHE_VERSION,
+        .channel = ap.primary,
+    };
+    memcpy(c.bssid, ap.bssid, sizeof(c.bssid));
+    strncpy(c.ssid, (const char *)config.sta.ssid, sizeof(c.ssid) - 1);
+    if (memcmp(&c, &cache, sizeof(c)) == 0) {
+        return;
+    }
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, NVS_KEY, &c, sizeof(c));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err == ESP_OK) {
+        cache = c;
+        ESP_LOGI(TAG, "cached AP " MACSTR " on channel %u", MAC2STR(c.bssid), c.channel);
+    } else {
+        ESP_LOGW(TAG, "AP cache not saved: %s", esp_err_to_name(err));
+    }
+}
+
+static void pin(bool on) {
+    pinned = on;
+    config.sta.bssid_set = on;
+    if (on) {
+        memcpy(config.sta.bssid, cache.bssid, sizeof(config.sta.bssid));
+    }
+    config.sta.channel = on ? cache.channel : 0;
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+}
+
+static void retry(void *arg) {
+    ESP_LOGI(TAG, "retry to connect to the AP");
+    esp_wifi_connect();
+}
+
+static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    const int64_t now = esp_timer_get_time();
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        taskENTER_CRITICAL(&status_lock);
+        status.cached = pinned;
+        status.associate_us = now - attempt_us;
+        taskEXIT_CRITICAL(&status_lock);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        xEventGroupClearBits(events, CONNECTED_BIT);
+        taskENTER_CRITICAL(&status_lock);
+        const bool was_connected = status.connected;
+        status.connected = false;
+        taskEXIT_CRITICAL(&status_lock);
+        if (was_connected) {
+            attempt_us = now;
+        }
+        if (pinned) {
+            // The cached AP is gone or moved: scan for any AP with the SSID
+            ESP_LOGI(TAG, "cached AP not reachable, scanning");
+            pin(false);
+            esp_wifi_connect();
+        } else if (retries < max_retries) {
+            retries++;
+            ESP_LOGI(TAG, "retry to connect to the AP");
+            esp_wifi_connect();
+        } else {
+            // Report the failure to wifi_fast_wait() but never give up on the AP
+            ESP_LOGI(TAG, "Failed to connect to SSID:%s, next try in %lld s", (const char *)config.sta.ssid,
+                     (long long)backoff_us / 1000000);
+            xEventGroupSetBits(events, FAIL_BIT);
+            esp_timer_start_once(retry_timer, backoff_us);
+            backoff_us = backoff_us * 2 < BACKOFF_MAX_US ? backoff_us * 2 : BACKOFF_MAX_US;
+        }
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        const ip_event_got_ip_t *event = event_data;
+        retries = 0;
+        backoff_us = BACKOFF_MIN_US;
+        taskENTER_CRITICAL(&status_lock);
+        status.connected = true;
+        status.connects++;
+        status.ip_us = now - attempt_us;
+        const wifi_fast_status_t s = status;
+        taskEXIT_CRITICAL(&status_lock);
+        ESP_LOGI(TAG, "got ip:" IPSTR " in %lld ms (associated at %lld ms) via %s, %s", IP2STR(&event->ip_info.ip),
+                 (long long)s.ip_us / 1000, (long long)s.associate_us / 1000,
+                 s.cached ? "cached AP" : "scan", s.static_ip ? "static IP" : "DHCP");
+        xEventGroupClearBits(events, FAIL_BIT);
+        xEventGroupSetBits(events, CONNECTED_BIT);
+#if CONFIG_WIFI_FAST_CACHE
+        save_cache();
+#endif
+    }
+}
+
+#if CONFIG_WIFI_FAST_STATIC_IP
+static esp_err_t set_static_ip(void) {
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_netif_dhcpc_stop(netif));
+    const esp_netif_ip_info_t ip = {
+        .ip.addr = esp_ip4addr_aton(CONFIG_WIFI_FAST_STATIC_ADDR),
+        .netmask.addr = esp_ip4addr_aton(CONFIG_WIFI_FAST_STATIC_NETMASK),
+        .gw.addr = esp_ip4addr_aton(CONFIG_WIFI_FAST_STATIC_GW),
+    };
+    esp_err_t err = esp_netif_set_ip_info(netif, &ip);
+    if (err == ESP_OK) {
+        esp_netif_dns_info_t dns = { 0 };
+        dns.ip.type = ESP_IPADDR_TYPE_V4;
+        dns.ip.u_addr.ip4.addr = esp_ip4addr_aton(CONFIG_WIFI_FAST_STATIC_DNS);
+        err = esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+    return err;
+}
+#endif
+
+esp_err_t wifi_fast_init(void) {
+    events = xEventGroupCreate();
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &retry_timer));
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    netif = esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, NULL));
+    return ESP_OK;
+}
+
+esp_err_t wifi_fast_connect(const char *ssid, const char *password, int max_retry) {
+    max_retries = max_retry;
+    memset(&config, 0, sizeof(config));
+    strncpy((char *)config.sta.ssid, ssid, sizeof(config.sta.ssid));
+    strncpy((char *)config.sta.password, password, sizeof(config.sta.password));
+    config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+#if CONFIG_WIFI_FAST_STATIC_IP
+    status.static_ip = set_static_ip() == ESP_OK;
+    if (!status.static_ip) {
+        ESP_LOGE(TAG, "static IP rejected, using DHCP");
+        esp_netif_dhcpc_start(netif);
+    }
+#endif
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+#if CONFIG_WIFI_FAST_CACHE
+    if (load_cache(ssid)) {
+        ESP_LOGI(TAG, "trying cached AP " MACSTR " on channel %u", MAC2STR(cache.bssid), cache.channel);
+        pin(true);
+    } else {
+        pin(false);
+    }
+#else
+    pin(false);
+#endif
+    attempt_us = esp_timer_get_time();
+    return esp_wifi_start();
+}
+
+bool wifi_fast_wait(TickType_t timeout) {
+    const EventBits_t bits = xEventGroupWaitBits(events, CONNECTED_BIT | FAIL_BIT, pdFALSE, pdFALSE, timeout);
+    return bits & CONNECTED_BIT;
+}
+
+void wifi_fast_get_status(wifi_fast_status_t *out) {
+    taskENTER_CRITICAL(&status_lock);
+    *out = status;
+    taskEXIT_CRITICAL(&status_lock);
+}
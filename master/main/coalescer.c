@@ -0,0 +1,81 @@
+#include "coalescer.h"
+
+void coalescer_init(coalescer_t *c, uint32_t window_ms, bool power) {
+    *c = (coalescer_t) {
+        .window_ms = window_ms,
+        .sent_power = power,
+        .power = power,
+    };
+}
+
+void coalescer_push(coalescer_t *c, coalesce_input_t in, uint32_t now_ms) {
+    if (!c->pending) {
+        c->pending = true;
+        c->window_start = now_ms;
+    }
+    if (in == COALESCE_TOGGLE) {
+        c->power = !c->power;
+    } else {
+        c->reset = true;
+    }
+    c->stats.inputs++;
+}
+
+int coalescer_poll(coalescer_t *c, uint32_t now_ms, coalesce_emit_fn emit, void *ctx) {
+    if (!c->pending || (uint32_t)(now_ms - c->window_start) < c->window_ms) {
+        return 0;
+    }
+
+    int n = 0;
+    // Stop before reset so a "running -> stopped + reset" burst ends at zero,
+    // reset before start so a restarted counter begins from zero.
+    if (c->sent_power && !c->power) {
+        emit(COALESCE_EMIT_STOP, ctx);
+        n++;
+    }
+    if (c->reset) {
+        emit(COALESCE_EMIT_RESET, ctx);
+        n++;
+    }
+    if (!c->sent_power && c->power) {
+        emit(COALESCE_EMIT_START, ctx);
+        n++;
+    }
+
+    c->sent_power = c->power;
+    c->reset = false;
+    c->pending = false;
+    c->stats.sent += n;
+    c->stats.saved = c->stats.inputs - c->stats.sent;
+    c->stats.windows++;
+    return n;
+}
+
+static void count_emit(coalesce_cmd_t cmd, void *ctx) {
+    (*(uint32_t *)ctx)++;
+}
+
+// Bursts of 1-12 presses spaced 20-250 ms apart (a user hammering the
+// button), 10% of them resets, with 0.5-5 s of quiet between bursts
+void coalescer_simulate(uint32_t window_ms, coalesce_stats_t *out) {
+    coalescer_t sim;
+    uint32_t emitted = 0;
+    uint32_t now = 0;
+    uint32_t rng = 0x2545F491;
+
+    coalescer_init(&sim, window_ms, false);
+    for (int burst = 0; burst < 1000; burst++) {
+        rng = rng * 1664525 + 1013904223;
+        const int presses = 1 + (rng >> 16) % 12;
+        for (int i = 0; i < presses; i++) {
+            rng = rng * 1664525 + 1013904223;
+            coalescer_push(&sim, (rng >> 24) < 26 ? COALESCE_RESET : COALESCE_TOGGLE, now);
+            now += 20 + (rng >> 8) % 231;
+            coalescer_poll(&sim, now, count_emit, &emitted);
+        }
+        rng = rng * 1664525 + 1013904223;
+        now += 500 + (rng >> 8) % 4501;
+        coalescer_poll(&sim, now, count_emit, &emitted);
+    }
+    *out = sim.stats;
+}
@@ -0,0 +1,61 @@
+#ifndef COALESCER_H_
+#define COALESCER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Button intents fed to the coalescer. */
+typedef enum {
+    COALESCE_TOGGLE = 0,
+    COALESCE_RESET,
+} coalesce_input_t;
+
+/* Commands the coalescer asks the sender to put on the wire. */
+typedef enum {
+    COALESCE_EMIT_START = 0,
+    COALESCE_EMIT_STOP,
+    COALESCE_EMIT_RESET,
+} coalesce_cmd_t;
+
+typedef struct {
+    uint32_t inputs;        // intents pushed (toggles + resets)
+    uint32_t sent;          // commands actually emitted
+    uint32_t saved;         // inputs - sent, i.e. commands never sent
+    uint32_t windows;       // number of flushed windows
+} coalesce_stats_t;
+
+typedef struct {
+    uint32_t window_ms;
+    bool pending;           // a window is open
+    uint32_t window_start;  // time of the first intent in the open window
+    bool sent_power;        // power state last sent to the slave
+    bool power;             // net power state after the intents seen so far
+    bool reset;             // at least one reset seen in the open window
+    coalesce_stats_t stats;
+} coalescer_t;
+
+typedef void (*coalesce_emit_fn)(coalesce_cmd_t cmd, void *ctx);
+
+void coalescer_init(coalescer_t *c, uint32_t window_ms, bool power);
+
+/* Record an intent at time now_ms. Opens a window if none is pending. */
+void coalescer_push(coalescer_t *c, coalesce_input_t in, uint32_t now_ms);
+
+/* Flush the window once it is window_ms old. Commands are emitted in the
+ * order STOP, RESET, START so the slave ends in the net state of the burst;
+ * STOP and START never both, so at most two. The emit callback must keep
+ * them apart on the wire (see link_master_send()). Returns the number of
+ * commands emitted. */
+int coalescer_poll(coalescer_t *c, uint32_t now_ms, coalesce_emit_fn emit, void *ctx);
+
+/* Replay a fixed pseudo-random stress pattern of 1000 press bursts on a
+ * virtual clock and return the stats. Same result on every run, so the
+ * figures can be checked off the board. */
+void coalescer_simulate(uint32_t window_ms, coalesce_stats_t *out);
+
+/* Net power state including intents that are still pending. */
+static inline bool coalescer_power(const coalescer_t *c) {
+    return c->power;
+}
+
+#endif
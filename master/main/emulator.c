@@ -12,22 +12,45 @@
 #include "string.h"
 #include "driver/gpio.h"
 
+#include "coalescer.h"
+#include "link_proto.h"
+#include "telemetry.h"
+#include "link_master.h"
+#include "log_ids.h"
+
 static const int RX_BUF_SIZE = 1024;
 
+static const dlog_format_t log_formats[] = { MASTER_LOG_FORMATS(DLOG_FORMAT_ENTRY) };
+
 #define TXD_PIN (GPIO_NUM_4)
 #define RXD_PIN (GPIO_NUM_5)
 
 #define POWER_PIN 19
 #define RESET_PIN 20
 
+#define UART_BAUD 115200
+
 // To make both press and release button change power status
 bool POWER = false;
 bool POWER_BUTTON = false;
 bool RESET_BUTTON = false;
 
+static coalescer_t coalescer;
+
+// Rolling view of the slave, updated by rx_task and read by display/forwarding code
+static telemetry_agg_t telemetry;
+static telemetry_summary_t telemetry_summary;
+static portMUX_TYPE telemetry_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void get_telemetry_summary(telemetry_summary_t *out) {
+    taskENTER_CRITICAL(&telemetry_lock);
+    *out = telemetry_summary;
+    taskEXIT_CRITICAL(&telemetry_lock);
+}
+
 void init(void) {
     const uart_config_t uart_config = {
-        .baud_rate = 115200,
+        .baud_rate = UART_BAUD,
         .data_bits = UART_DATA_8_BITS,
         .parity = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
@@ -50,49 +73,68 @@ void init(void) {
     gpio_pulldown_dis(RESET_PIN);
 }
 
-int sendData(const char *logName, const char *data) {
-    const int len = strlen(data);
-    const int txBytes = uart_write_bytes(UART_NUM_1, data, len);
-    ESP_LOGI(logName, "Wrote %d bytes", txBytes);
-    return txBytes;
-}
-
 static void rx_task(void *arg) {
     static const char *RX_TASK_TAG = "RX_TASK";
     esp_log_level_set(RX_TASK_TAG, ESP_LOG_INFO);
-    uint8_t *data = (uint8_t *)malloc(RX_BUF_SIZE + 1);
+    uint8_t *data = (uint8_t *)malloc(RX_BUF_SIZE);
+    link_decoder_t decoder;
+    link_decoder_init(&decoder);
+    telemetry_agg_init(&telemetry);
     while (1) {
-        const int rxBytes = uart_read_bytes(UART_NUM_1, data, RX_BUF_SIZE, 1000 / portTICK_PERIOD_MS);
-        if (rxBytes > 0) {
-            data[rxBytes] = 0;
-            ESP_LOGI(RX_TASK_TAG, "Read %d bytes: '%s'", rxBytes, data);
-            ESP_LOG_BUFFER_HEXDUMP(RX_TASK_TAG, data, rxBytes, ESP_LOG_INFO);
+        // Short timeout so handshake replies are not held back behind a full buffer
+        const int rxBytes = uart_read_bytes(UART_NUM_1, data, RX_BUF_SIZE, 20 / portTICK_PERIOD_MS);
+        for (int i = 0; i < rxBytes; i++) {
+            if (!link_decoder_feed(&decoder, data[i])) {
+                continue;
+            }
+            DLOG(LOG_RX_FRAME, decoder.frame.type, decoder.frame.len);
+            link_master_on_frame(&decoder.frame);
+            link_telemetry_t t;
+            if (link_telemetry_unpack(&decoder.frame, &t)) {
+                telemetry_summary_t summary;
+                telemetry_agg_add(&telemetry, &t);
+                telemetry_agg_summary(&telemetry, &summary);
+                taskENTER_CRITICAL(&telemetry_lock);
+                telemetry_summary = summary;
+                taskEXIT_CRITICAL(&telemetry_lock);
+            }
         }
     }
     free(data);
 }
 
+static void send_coalesced(coalesce_cmd_t cmd, void *ctx) {
+    // Binary frame or legacy text, depending on what the slave negotiated
+    switch (cmd) {
+    case COALESCE_EMIT_START:
+        link_master_send(LINK_CMD_START);
+        break;
+    case COALESCE_EMIT_STOP:
+        link_master_send(LINK_CMD_STOP);
+        break;
+    case COALESCE_EMIT_RESET:
+        link_master_send(LINK_CMD_RESET);
+        break;
+    }
+}
+
 static void button_task(void *arg) {
     static const char *BUTTON_TASK_TAG = "BUTTON_CHECK";
     esp_log_level_set(BUTTON_TASK_TAG, ESP_LOG_INFO);
 
     while (1) {
+        const uint32_t now = pdTICKS_TO_MS(xTaskGetTickCount());
         if (gpio_get_level(POWER_PIN) == 0) {
             // Button is pressed
             POWER_BUTTON = true;
         } else {
             if (POWER_BUTTON) {
                 ESP_LOGI(BUTTON_TASK_TAG, "Button pressed");
-                // Change power status
-                POWER = !POWER;
                 // Set back button status
                 POWER_BUTTON = false;
-                // Send message to slave board based on power status
-                if (POWER) {
-                    sendData(BUTTON_TASK_TAG, "Power on - start counting");
-                } else {
-                    sendData(BUTTON_TASK_TAG, "Power off - stop counting time");
-                }
+                // Queue the toggle, the sender below decides what reaches the slave
+                coalescer_push(&coalescer, COALESCE_TOGGLE, now);
+                POWER = coalescer_power(&coalescer);
             }
         }
         if (gpio_get_level(RESET_PIN) == 0) {
@@ -101,19 +143,44 @@ static void button_task(void *arg) {
         } else {
             if (RESET_BUTTON) {
                 ESP_LOGI(BUTTON_TASK_TAG, "Button pressed");
-                // Change power status
                 // Set back button status
                 RESET_BUTTON = false;
-                // Send message to slave board
-                sendData(BUTTON_TASK_TAG, "RESET");
+                coalescer_push(&coalescer, COALESCE_RESET, now);
             }
         }
+        // Send the net change of the burst once its window has closed
+        if (coalescer_poll(&coalescer, now, send_coalesced, (void *)BUTTON_TASK_TAG) > 0) {
+            ESP_LOGD(BUTTON_TASK_TAG, "coalescer: %lu inputs, %lu sent, %lu saved",
+                     (unsigned long)coalescer.stats.inputs, (unsigned long)coalescer.stats.sent,
+                     (unsigned long)coalescer.stats.saved);
+        }
         vTaskDelay(100 / portTICK_PERIOD_MS); // Adjust delay as needed
     }
 }
 
+#if CONFIG_MASTER_COALESCE_SIMULATE
+static void coalesce_simulate(void) {
+    static const char *SIM_TAG = "COALESCE_SIM";
+    coalesce_stats_t stats;
+    coalescer_simulate(CONFIG_MASTER_COALESCE_WINDOW_MS, &stats);
+    ESP_LOGI(SIM_TAG, "window %d ms: %lu inputs, %lu sent, %lu saved (%lu%%)",
+             CONFIG_MASTER_COALESCE_WINDOW_MS, (unsigned long)stats.inputs,
+             (unsigned long)stats.sent, (unsigned long)stats.saved,
+             (unsigned long)(stats.inputs ? 100 * stats.saved / stats.inputs : 0));
+}
+#endif
+
 void app_main(void) {
+    dlog_init(log_formats, LOG_ID_COUNT);
+#if CONFIG_DLOG_BENCHMARK
+    dlog_benchmark(LOG_BENCH);
+#endif
     init();
+#if CONFIG_MASTER_COALESCE_SIMULATE
+    coalesce_simulate();
+#endif
+    coalescer_init(&coalescer, CONFIG_MASTER_COALESCE_WINDOW_MS, POWER);
+    link_master_start(UART_NUM_1, UART_BAUD);
     xTaskCreate(rx_task, "uart_rx_task", 1024 * 4, NULL, configMAX_PRIORITIES, NULL);
     xTaskCreate(button_task, "button_check", 1024 * 2, NULL, configMAX_PRIORITIES, NULL);
 }
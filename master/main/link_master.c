@@ -0,0 +1,179 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "link_master.h"
+#include "log_ids.h"
+
+#define HELLO_RETRIES 3
+#define HELLO_TIMEOUT_MS 300
+// Longer than the slave's wait for a frame at a new baud rate
+#define BAUD_REVERT_WAIT_MS 1200
+// Legacy slaves read for up to a second and take whatever arrived as one
+// command, so text commands closer together than this run into each other
+#define LEGACY_GAP_MS 1100
+
+#define NOTIFY_ACK BIT0
+#define NOTIFY_REDO BIT1
+
+static const char *TAG = "link";
+
+static uart_port_t link_uart;
+static uint32_t link_base_baud;
+static uint32_t link_baud;
+static TaskHandle_t link_task_handle;
+static volatile link_mode_t link_mode = LINK_MODE_LEGACY;
+static link_hello_t link_peer;      // negotiated capabilities
+static link_hello_t slave_caps;     // last HELLO_ACK, written by rx_task
+static volatile int64_t last_rx_us;
+static bool baud_switch_allowed = true;
+static int64_t last_text_us = INT64_MIN / 2;    // last legacy command, caller's task only
+
+static void local_caps(link_hello_t *out) {
+    *out = (link_hello_t) {
+        .version = LINK_PROTO_VERSION,
+        .max_payload = LINK_MAX_PAYLOAD,
+        .features = LINK_FEAT_BINARY_CMD | LINK_FEAT_TELEMETRY | (baud_switch_allowed ? LINK_FEAT_BAUD_SWITCH : 0),
+        .bauds = link_baud_mask(CONFIG_MASTER_UART_MAX_BAUD) | link_baud_mask(link_base_baud),
+    };
+}
+
+static void set_baud(uint32_t baud) {
+    if (baud == link_baud) {
+        return;
+    }
+    uart_wait_tx_done(link_uart, pdMS_TO_TICKS(100));
+    uart_set_baudrate(link_uart, baud);
+    link_baud = baud;
+}
+
+// Send HELLO and wait for the slave's HELLO_ACK
+static bool hello(link_hello_t *ack) {
+    link_hello_t caps;
+    uint8_t payload[LINK_HELLO_LEN];
+    uint8_t frame[LINK_MAX_FRAME];
+    local_caps(&caps);
+    link_hello_pack(&caps, payload);
+    const size_t len = link_encode(LINK_FRAME_HELLO, payload, sizeof(payload), frame);
+
+    for (int i = 0; i < HELLO_RETRIES; i++) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(NOTIFY_ACK, 0, NULL, 0);
+        uart_write_bytes(link_uart, frame, len);
+        if (xTaskNotifyWait(0, NOTIFY_ACK, &bits, pdMS_TO_TICKS(HELLO_TIMEOUT_MS)) == pdTRUE && (bits & NOTIFY_ACK)) {
+            *ack = slave_caps;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void handshake(void) {
+    link_hello_t caps, ack;
+    link_mode = LINK_MODE_LEGACY;
+    set_baud(link_base_baud);
+
+    while (1) {
+        if (!hello(&ack)) {
+            memset(&link_peer, 0, sizeof(link_peer));
+            ESP_LOGI(TAG, "no answer to HELLO, using legacy text commands");
+            return;
+        }
+        local_caps(&caps);
+        link_negotiate(&caps, &ack, &link_peer);
+        const uint32_t baud = link_baud_fastest(link_peer.bauds);
+        if (!(link_peer.features & LINK_FEAT_BAUD_SWITCH) || baud == 0 || baud == link_baud) {
+            break;
+        }
+        // The slave has already switched; follow and confirm at the new rate
+        set_baud(baud);
+        if (hello(&ack)) {
+            break;
+        }
+        ESP_LOGW(TAG, "no answer at %lu baud, staying at %lu", (unsigned long)baud, (unsigned long)link_base_baud);
+        set_baud(link_base_baud);
+        baud_switch_allowed = false;
+        vTaskDelay(pdMS_TO_TICKS(BAUD_REVERT_WAIT_MS));
+    }
+
+    link_mode = (link_peer.features & LINK_FEAT_BINARY_CMD) ? LINK_MODE_BINARY : LINK_MODE_LEGACY;
+    last_rx_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "slave speaks v%u, features 0x%x, %lu baud", link_peer.version, link_peer.features,
+             (unsigned long)link_baud);
+}
+
+static void link_task(void *arg) {
+    handshake();
+    while (1) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, NOTIFY_REDO, &bits, pdMS_TO_TICKS(1000));
+        if (bits & NOTIFY_REDO) {
+            handshake();
+        } else if ((link_peer.features & LINK_FEAT_TELEMETRY) &&
+                   esp_timer_get_time() - last_rx_us > CONFIG_MASTER_LINK_TIMEOUT_MS * 1000LL) {
+            // Telemetry stopped: the slave probably restarted at its base rate
+            ESP_LOGW(TAG, "slave silent, redoing capability exchange");
+            baud_switch_allowed = true;
+            handshake();
+        }
+    }
+}
+
+void link_master_start(uart_port_t uart, uint32_t base_baud) {
+    link_uart = uart;
+    link_base_baud = base_baud;
+    link_baud = base_baud;
+    xTaskCreate(link_task, "link_task", 1024 * 3, NULL, 5, &link_task_handle);
+}
+
+void link_master_on_frame(const link_frame_t *f) {
+    last_rx_us = esp_timer_get_time();
+    if (link_task_handle == NULL) {
+        return;
+    }
+    switch (f->type) {
+    case LINK_FRAME_HELLO_ACK:
+        if (link_hello_unpack(f, &slave_caps)) {
+            xTaskNotify(link_task_handle, NOTIFY_ACK, eSetBits);
+        }
+        break;
+    case LINK_FRAME_HELLO:
+        // Slave (re)started
+        baud_switch_allowed = true;
+        xTaskNotify(link_task_handle, NOTIFY_REDO, eSetBits);
+        break;
+    default:
+        break;
+    }
+}
+
+int link_master_send(link_cmd_t cmd) {
+    if (link_mode == LINK_MODE_BINARY) {
+        uint8_t frame[LINK_MAX_FRAME];
+        uint8_t payload[LINK_COMMAND_MAX_LEN];
+        const size_t n = link_command_pack(cmd, CONFIG_MASTER_CHANNEL, payload);
+        const size_t len = link_encode(LINK_FRAME_COMMAND, payload, n, frame);
+        const int txBytes = uart_write_bytes(link_uart, frame, len);
+        DLOG(LOG_TX_WROTE, (uintptr_t)TAG, txBytes);
+        return txBytes;
+    }
+    // Text commands cannot carry a channel
+    const char *text = CONFIG_MASTER_CHANNEL == 0 ? link_legacy_text(cmd) : NULL;
+    if (text == NULL) {
+        return 0;
+    }
+    const int64_t wait_us = last_text_us + LEGACY_GAP_MS * 1000LL - esp_timer_get_time();
+    if (wait_us > 0) {
+        vTaskDelay(pdMS_TO_TICKS(wait_us / 1000) + 1);
+    }
+    const int txBytes = uart_write_bytes(link_uart, text, strlen(text));
+    uart_wait_tx_done(link_uart, pdMS_TO_TICKS(LEGACY_GAP_MS));
+    last_text_us = esp_timer_get_time();
+    DLOG(LOG_TX_WROTE, (uintptr_t)TAG, txBytes);
+    return txBytes;
+}
+
+link_mode_t link_master_mode(void) {
+    return link_mode;
+}
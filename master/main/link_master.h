@@ -0,0 +1,36 @@
+#ifndef LINK_MASTER_H_
+#define LINK_MASTER_H_
+
+#include <stdint.h>
+#include "driver/uart.h"
+#include "link_proto.h"
+
+/* Master half of the capability exchange with the slave.
+ *
+ * At start-up, and whenever the slave announces itself with HELLO or goes
+ * silent for CONFIG_MASTER_LINK_TIMEOUT_MS, the master sends HELLO at the
+ * base baud rate. A slave that answers gets binary commands and, if both
+ * sides allow it, the fastest common baud rate; one that does not answer is
+ * treated as legacy and gets the original text commands. */
+typedef enum {
+    LINK_MODE_LEGACY = 0,
+    LINK_MODE_BINARY,
+} link_mode_t;
+
+/* Start the link supervisor task. base_baud is the rate the UART was
+ * configured with and the rate every handshake starts from. */
+void link_master_start(uart_port_t uart, uint32_t base_baud);
+
+/* Feed every frame decoded by the receive task. */
+void link_master_on_frame(const link_frame_t *f);
+
+/* Send a command for CONFIG_MASTER_CHANNEL in whatever form the slave
+ * understands. Returns the number of bytes written, 0 when a legacy slave
+ * cannot be addressed on that channel. Text commands are spaced more than a
+ * legacy slave's read timeout apart, so a second one within about a second
+ * blocks the caller until then. */
+int link_master_send(link_cmd_t cmd);
+
+link_mode_t link_master_mode(void);
+
+#endif
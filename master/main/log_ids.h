@@ -0,0 +1,18 @@
+#ifndef LOG_IDS_H_
+#define LOG_IDS_H_
+
+#include "dlog.h"
+
+/* Deferred log formats used on the master's UART hot paths: (id, tag, format).
+ * Arguments are raw 32-bit values, see dlog.h. */
+#define MASTER_LOG_FORMATS(X) \
+    X(LOG_TX_WROTE, "TX", "%s: Wrote %lu bytes") \
+    X(LOG_RX_FRAME, "RX_TASK", "Frame type %lu, %lu bytes") \
+    X(LOG_BENCH, "dlog_bench", "Record %lu")
+
+enum {
+    MASTER_LOG_FORMATS(DLOG_ID_ENTRY)
+    LOG_ID_COUNT
+};
+
+#endif
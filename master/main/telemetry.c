@@ -0,0 +1,78 @@
+#include <string.h>
+#include "telemetry.h"
+
+void telemetry_agg_init(telemetry_agg_t *a) {
+    memset(a, 0, sizeof(*a));
+}
+
+static const telemetry_sample_t *newest(const telemetry_agg_t *a) {
+    return &a->ring[(a->head + TELEMETRY_WINDOW - 1) % TELEMETRY_WINDOW];
+}
+
+static const telemetry_sample_t *oldest(const telemetry_agg_t *a) {
+    return &a->ring[(a->head + TELEMETRY_WINDOW - a->count) % TELEMETRY_WINDOW];
+}
+
+void telemetry_agg_add(telemetry_agg_t *a, const link_telemetry_t *t) {
+    if (a->count && t->uptime_ms < newest(a)->uptime_ms) {
+        // Slave rebooted, its counters restarted from zero
+        a->count = 0;
+        a->slave_restarts++;
+    }
+
+    a->ring[a->head] = (telemetry_sample_t) {
+        .uptime_ms = t->uptime_ms,
+        .counter_s = t->counter_s,
+        .rx_errors = t->rx_frame_errors + t->rx_overflows + t->rx_unknown,
+        .persist_writes = t->persist_writes,
+        .persist_errors = t->persist_errors,
+        .free_heap = t->free_heap,
+    };
+    a->head = (a->head + 1) % TELEMETRY_WINDOW;
+    if (a->count < TELEMETRY_WINDOW) {
+        a->count++;
+    }
+    a->running = t->flags & LINK_TELEMETRY_RUNNING;
+    a->counter_s = t->counter_s;
+    a->min_free_heap = t->min_free_heap;
+    a->total_frames++;
+}
+
+static uint32_t rate_milli(uint32_t delta, uint32_t span_ms) {
+    return span_ms ? (uint32_t)((uint64_t)delta * 1000000 / span_ms) : 0;
+}
+
+void telemetry_agg_summary(const telemetry_agg_t *a, telemetry_summary_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (a->count == 0) {
+        return;
+    }
+
+    const telemetry_sample_t *first = oldest(a);
+    const telemetry_sample_t *last = newest(a);
+    uint64_t heap_sum = 0;
+    out->free_heap.min = UINT32_MAX;
+    for (int i = 0; i < a->count; i++) {
+        const telemetry_sample_t *s = &a->ring[(a->head + TELEMETRY_WINDOW - 1 - i) % TELEMETRY_WINDOW];
+        heap_sum += s->free_heap;
+        if (s->free_heap < out->free_heap.min) {
+            out->free_heap.min = s->free_heap;
+        }
+        if (s->free_heap > out->free_heap.max) {
+            out->free_heap.max = s->free_heap;
+        }
+    }
+
+    out->frames = a->count;
+    out->span_ms = last->uptime_ms - first->uptime_ms;
+    out->running = a->running;
+    out->counter_s = a->counter_s;
+    out->min_free_heap = a->min_free_heap;
+    out->free_heap.avg = heap_sum / a->count;
+    // A reset on the slave makes the counter go down; treat that as no progress
+    out->counter_rate_milli = last->counter_s >= first->counter_s
+                              ? rate_milli(last->counter_s - first->counter_s, out->span_ms) : 0;
+    out->rx_error_rate_milli = rate_milli((uint16_t)(last->rx_errors - first->rx_errors), out->span_ms);
+    out->persist_rate_milli = rate_milli(last->persist_writes - first->persist_writes, out->span_ms);
+    out->persist_errors = (uint16_t)(last->persist_errors - first->persist_errors);
+}
@@ -0,0 +1,57 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+#include "link_proto.h"
+
+#define TELEMETRY_WINDOW 16     // frames kept for rolling aggregates
+
+typedef struct {
+    uint32_t uptime_ms;
+    uint32_t counter_s;
+    uint16_t rx_errors;         // frame errors + overflows + unknown, wraps like the slave's counters
+    uint16_t persist_errors;
+    uint32_t persist_writes;
+    uint32_t free_heap;
+} telemetry_sample_t;
+
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    uint32_t avg;
+} telemetry_range_t;
+
+/* Aggregates over the frames currently in the window. Rates are per second
+ * of slave uptime, scaled by 1000 to stay in integer arithmetic. */
+typedef struct {
+    uint32_t frames;            // frames in the window
+    uint32_t span_ms;           // slave uptime covered by the window
+    uint8_t running;            // state from the latest frame
+    uint32_t counter_s;         // latest counter value
+    uint32_t min_free_heap;     // low-water mark reported by the slave
+    telemetry_range_t free_heap;
+    uint32_t counter_rate_milli;    // counted seconds per second x1000
+    uint32_t rx_error_rate_milli;
+    uint32_t persist_rate_milli;
+    uint32_t persist_errors;    // new persist errors in the window
+} telemetry_summary_t;
+
+typedef struct {
+    telemetry_sample_t ring[TELEMETRY_WINDOW];
+    uint8_t head;               // next slot to write
+    uint8_t count;
+    uint8_t running;
+    uint32_t counter_s;
+    uint32_t min_free_heap;
+    uint32_t total_frames;
+    uint32_t slave_restarts;    // uptime went backwards
+} telemetry_agg_t;
+
+void telemetry_agg_init(telemetry_agg_t *a);
+void telemetry_agg_add(telemetry_agg_t *a, const link_telemetry_t *t);
+void telemetry_agg_summary(const telemetry_agg_t *a, telemetry_summary_t *out);
+
+/* Latest summary published by the master's rx_task. */
+void get_telemetry_summary(telemetry_summary_t *out);
+
+#endif
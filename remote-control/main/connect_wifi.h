@@ -11,6 +11,7 @@
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include "wifi_fast.h"
 #include "driver/gpio.h"
 #include <lwip/sockets.h>
 #include <lwip/sys.h>
@@ -0,0 +1,128 @@
+#include <string.h>
+#include "api_enc.h"
+
+#define CBOR_UINT 0
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+
+// Major type and argument in the shortest form
+static void cbor_head(api_enc_t *e, uint8_t major, uint64_t v) {
+    uint8_t b[9];
+    size_t n;
+    if (v < 24) {
+        b[0] = major << 5 | v;
+        n = 1;
+    } else if (v <= UINT8_MAX) {
+        b[0] = major << 5 | 24;
+        n = 2;
+    } else if (v <= UINT16_MAX) {
+        b[0] = major << 5 | 25;
+        n = 3;
+    } else if (v <= UINT32_MAX) {
+        b[0] = major << 5 | 26;
+        n = 5;
+    } else {
+        b[0] = major << 5 | 27;
+        n = 9;
+    }
+    for (size_t i = 1; i < n; i++) {
+        b[i] = v >> (8 * (n - 1 - i));
+    }
+    chunk_put(e->w, (const char *)b, n);
+}
+
+// JSON separator before an array item or a map key
+static void json_item(api_enc_t *e) {
+    if (e->after_key) {
+        e->after_key = false;
+        return;
+    }
+    if (!e->first[e->depth]) {
+        chunk_put(e->w, ",", 1);
+    }
+    e->first[e->depth] = false;
+}
+
+static void container(api_enc_t *e, uint8_t major, uint32_t count, char open, char close) {
+    if (e->cbor) {
+        cbor_head(e, major, count);
+        return;
+    }
+    json_item(e);
+    chunk_put(e->w, &open, 1);
+    if (e->depth + 1 < API_ENC_DEPTH) {
+        e->depth++;
+    }
+    e->first[e->depth] = true;
+    e->close[e->depth] = close;
+}
+
+void api_enc_init(api_enc_t *e, chunk_writer_t *w, bool cbor) {
+    memset(e, 0, sizeof(*e));
+    e->w = w;
+    e->cbor = cbor;
+    e->first[0] = true;
+}
+
+void api_enc_map(api_enc_t *e, uint32_t pairs) {
+    container(e, CBOR_MAP, pairs, '{', '}');
+}
+
+void api_enc_array(api_enc_t *e, uint32_t items) {
+    container(e, CBOR_ARRAY, items, '[', ']');
+}
+
+void api_enc_end(api_enc_t *e) {
+    if (e->cbor || e->depth == 0) {
+        return;
+    }
+    chunk_put(e->w, &e->close[e->depth], 1);
+    e->depth--;
+}
+
+void api_enc_key(api_enc_t *e, const char *key) {
+    if (e->cbor) {
+        api_enc_str(e, key);
+        return;
+    }
+    json_item(e);
+    chunk_put(e->w, "\"", 1);
+    chunk_put_str(e->w, key);
+    chunk_put(e->w, "\":", 2);
+    e->after_key = true;
+}
+
+void api_enc_uint(api_enc_t *e, uint64_t v) {
+    if (e->cbor) {
+        cbor_head(e, CBOR_UINT, v);
+        return;
+    }
+    json_item(e);
+    chunk_put_int(e->w, v);
+}
+
+void api_enc_bool(api_enc_t *e, bool v) {
+    if (e->cbor) {
+        const char b = v ? CBOR_TRUE : CBOR_FALSE;
+        chunk_put(e->w, &b, 1);
+        return;
+    }
+    json_item(e);
+    chunk_put_str(e->w, v ? "true" : "false");
+}
+
+void api_enc_str(api_enc_t *e, const char *s) {
+    const size_t len = strlen(s);
+    if (e->cbor) {
+        cbor_head(e, CBOR_TEXT, len);
+        chunk_put(e->w, s, len);
+        return;
+    }
+    json_item(e);
+    chunk_put(e->w, "\"", 1);
+    chunk_put(e->w, s, len);
+    chunk_put(e->w, "\"", 1);
+}
@@ -0,0 +1,39 @@
+#ifndef API_ENC_H_
+#define API_ENC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "chunk_writer.h"
+
+/* Structured encoder for the HTTP API, writing JSON or CBOR (RFC 8949)
+ * through a chunk writer from the same sequence of calls.
+ *
+ * Containers are definite-length, so their item count is given up front
+ * (CBOR needs it, JSON ignores it) and every one is closed with
+ * api_enc_end(). In a map each api_enc_key() is followed by exactly one
+ * value or container. Keys and strings are written as they are, so they
+ * must be plain ASCII without quotes or backslashes. No state lives
+ * outside api_enc_t and nothing is allocated. */
+#define API_ENC_DEPTH 6
+
+typedef struct {
+    chunk_writer_t *w;
+    bool cbor;
+    uint8_t depth;
+    bool after_key;                     // JSON: the next value belongs to a key
+    bool first[API_ENC_DEPTH];          // JSON: nothing written yet at this depth
+    char close[API_ENC_DEPTH];          // JSON: '}' or ']'
+} api_enc_t;
+
+void api_enc_init(api_enc_t *e, chunk_writer_t *w, bool cbor);
+
+void api_enc_map(api_enc_t *e, uint32_t pairs);
+void api_enc_array(api_enc_t *e, uint32_t items);
+void api_enc_end(api_enc_t *e);
+
+void api_enc_key(api_enc_t *e, const char *key);
+void api_enc_uint(api_enc_t *e, uint64_t v);
+void api_enc_bool(api_enc_t *e, bool v);
+void api_enc_str(api_enc_t *e, const char *s);
+
+#endif
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "channels.h"
+#include "chunk_writer.h"
+#include "api_enc.h"
+#include "longpoll.h"
+#include "api_state.h"
+
+static const char *TAG = "api_state";
+
+static uint16_t count;
+static persist_snapshot_fn_t take_snapshot;
+static int64_t *totals;
+static uint32_t *running;
+
+static bool wants_cbor(httpd_req_t *req) {
+    char buf[64];
+    char value[8];
+    if (httpd_req_get_url_query_str(req, buf, sizeof(buf)) == ESP_OK &&
+        httpd_query_key_value(buf, "format", value, sizeof(value)) == ESP_OK) {
+        return strcmp(value, "cbor") == 0;
+    }
+    return httpd_req_get_hdr_value_str(req, "Accept", buf, sizeof(buf)) == ESP_OK &&
+           strstr(buf, "application/cbor") != NULL;
+}
+
+static esp_err_t state_handler(httpd_req_t *req) {
+    const bool cbor = wants_cbor(req);
+    // Handlers run one at a time in the server task
+    static chunk_writer_t w;
+    api_enc_t e;
+    chunk_writer_init(&w, req);
+    api_enc_init(&e, &w, cbor);
+    httpd_resp_set_type(req, cbor ? "application/cbor" : "application/json");
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+
+    const uint32_t version = longpoll_version();
+    take_snapshot(totals, running);
+    api_enc_map(&e, 3);
+    api_enc_key(&e, "version");
+    api_enc_uint(&e, version);
+    api_enc_key(&e, "uptime_s");
+    api_enc_uint(&e, esp_timer_get_time() / 1000000);
+    api_enc_key(&e, "channels");
+    api_enc_array(&e, count);
+    for (uint16_t ch = 0; ch < count; ch++) {
+        api_enc_map(&e, 3);
+        api_enc_key(&e, "id");
+        api_enc_uint(&e, ch);
+        api_enc_key(&e, "running");
+        api_enc_bool(&e, running[ch / 32] & 1u << (ch % 32));
+        api_enc_key(&e, "total_s");
+        api_enc_uint(&e, totals[ch] / 1000000);
+        api_enc_end(&e);
+    }
+    api_enc_end(&e);
+    api_enc_end(&e);
+    return chunk_writer_end(&w) == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t api_state_init(uint16_t n, persist_snapshot_fn_t snapshot) {
+    count = n;
+    take_snapshot = snapshot;
+    totals = calloc(n, sizeof(int64_t));
+    running = calloc(CHANNELS_WORDS(n), sizeof(uint32_t));
+    if (totals == NULL || running == NULL) {
+        ESP_LOGE(TAG, "no memory for %u channels", n);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t api_state_register(httpd_handle_t server) {
+    const httpd_uri_t uri = {
+        .uri = API_STATE_URI,
+        .method = HTTP_GET,
+        .handler = state_handler,
+        .user_ctx = NULL
+    };
+    const esp_err_t err = httpd_register_uri_handler(server, &uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s not registered: %s", uri.uri, esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,24 @@
+#ifndef API_STATE_H_
+#define API_STATE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "persist_task.h"
+
+/* GET /api/state: the state of every channel as JSON, or as CBOR when the
+ * Accept header asks for application/cbor or the query has format=cbor.
+ *
+ *   {"version":N,"uptime_s":S,"channels":[{"id":0,"running":true,"total_s":T},...]}
+ *
+ * version is the /wait version, so a client can read the state here and
+ * then long-poll for the next change. Both encodings come from the same
+ * calls into api_enc and stream through a chunk writer; the snapshot
+ * buffers are allocated once by api_state_init(). */
+#define API_STATE_URI "/api/state"
+
+esp_err_t api_state_init(uint16_t count, persist_snapshot_fn_t snapshot);
+
+esp_err_t api_state_register(httpd_handle_t server);
+
+#endif
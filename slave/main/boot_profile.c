@@ -0,0 +1,46 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "boot_profile.h"
+
+static const char *TAG = "boot";
+
+static boot_phase_t phases[BOOT_PROFILE_MAX];
+static size_t count;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+void boot_mark(const char *name) {
+    const int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&lock);
+    bool seen = false;
+    for (size_t i = 0; i < count && !seen; i++) {
+        seen = strcmp(phases[i].name, name) == 0;
+    }
+    if (!seen && count < BOOT_PROFILE_MAX) {
+        phases[count].name = name;
+        phases[count].at_us = now;
+        count++;
+    }
+    taskEXIT_CRITICAL(&lock);
+}
+
+size_t boot_profile_get(boot_phase_t *out, size_t max) {
+    taskENTER_CRITICAL(&lock);
+    const size_t n = count < max ? count : max;
+    memcpy(out, phases, n * sizeof(out[0]));
+    taskEXIT_CRITICAL(&lock);
+    return n;
+}
+
+void boot_profile_log(void) {
+    boot_phase_t copy[BOOT_PROFILE_MAX];
+    const size_t n = boot_profile_get(copy, BOOT_PROFILE_MAX);
+    int64_t prev = 0;
+    for (size_t i = 0; i < n; i++) {
+        ESP_LOGI(TAG, "%-12s %7lld us (+%lld)", copy[i].name, (long long)copy[i].at_us,
+                 (long long)(copy[i].at_us - prev));
+        prev = copy[i].at_us;
+    }
+}
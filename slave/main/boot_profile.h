@@ -0,0 +1,32 @@
+#ifndef BOOT_PROFILE_H_
+#define BOOT_PROFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Boot phase timestamps.
+ *
+ * app_main marks the end of each phase it runs, and the phases that finish
+ * later in other tasks (Wi-Fi association, HTTP server, first SNTP sync)
+ * mark themselves when they get there. Times are esp_timer microseconds,
+ * which count from early in the second-stage startup, so the first mark
+ * also shows what ROM, bootloader and IDF startup cost. The table is fixed
+ * and never allocates; a name is recorded once, so phases that repeat on a
+ * reconnect keep their first time. */
+#define BOOT_PROFILE_MAX 20
+
+typedef struct {
+    const char *name;           // string literal passed to boot_mark()
+    int64_t at_us;
+} boot_phase_t;
+
+/* Safe from any task. */
+void boot_mark(const char *name);
+
+/* Copy up to max phases in the order they were marked; returns how many. */
+size_t boot_profile_get(boot_phase_t *out, size_t max);
+
+/* One log line per phase with its time and the step since the previous. */
+void boot_profile_log(void);
+
+#endif
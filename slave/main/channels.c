@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <string.h>
+#include "channels.h"
+
+esp_err_t channels_init(channels_t *c, uint16_t count) {
+    memset(c, 0, sizeof(*c));
+    c->running = calloc(CHANNELS_WORDS(count), sizeof(uint32_t));
+    c->start_us = calloc(count, sizeof(int64_t));
+    c->accumulated_us = calloc(count, sizeof(int64_t));
+    if (c->running == NULL || c->start_us == NULL || c->accumulated_us == NULL) {
+        channels_free(c);
+        return ESP_ERR_NO_MEM;
+    }
+    c->count = count;
+    return ESP_OK;
+}
+
+void channels_free(channels_t *c) {
+    free(c->running);
+    free(c->start_us);
+    free(c->accumulated_us);
+    memset(c, 0, sizeof(*c));
+}
+
+void channels_set_total(channels_t *c, uint16_t ch, int64_t total_us) {
+    c->accumulated_us[ch] = total_us;
+}
+
+bool channels_start(channels_t *c, uint16_t ch, int64_t now_us) {
+    if (channels_is_running(c, ch)) {
+        return false;
+    }
+    c->start_us[ch] = now_us;
+    c->running[ch / 32] |= 1u << (ch % 32);
+    return true;
+}
+
+bool channels_stop(channels_t *c, uint16_t ch, int64_t now_us, int64_t *run_us) {
+    if (!channels_is_running(c, ch)) {
+        return false;
+    }
+    *run_us = now_us - c->start_us[ch];
+    c->accumulated_us[ch] += *run_us;
+    c->running[ch / 32] &= ~(1u << (ch % 32));
+    return true;
+}
+
+int64_t channels_reset(channels_t *c, uint16_t ch, int64_t now_us) {
+    const int64_t was = channels_elapsed_us(c, ch, now_us);
+    c->accumulated_us[ch] = 0;
+    c->start_us[ch] = now_us;
+    return was;
+}
+
+int64_t channels_elapsed_us(const channels_t *c, uint16_t ch, int64_t now_us) {
+    if (!channels_is_running(c, ch)) {
+        return c->accumulated_us[ch];
+    }
+    return c->accumulated_us[ch] + (now_us - c->start_us[ch]);
+}
+
+int64_t channels_snapshot(const channels_t *c, int64_t now_us, int64_t *totals, uint32_t *running) {
+    int64_t sum = 0;
+    for (uint16_t w = 0; w < CHANNELS_WORDS(c->count); w++) {
+        const uint32_t bits = c->running[w];
+        running[w] = bits;
+        const uint16_t base = w * 32;
+        const uint16_t n = c->count - base < 32 ? c->count - base : 32;
+        for (uint16_t i = 0; i < n; i++) {
+            // Stopped channels only contribute their accumulated total
+            const int64_t live = (bits >> i & 1) ? now_us - c->start_us[base + i] : 0;
+            totals[base + i] = c->accumulated_us[base + i] + live;
+            sum += totals[base + i];
+        }
+    }
+    return sum;
+}
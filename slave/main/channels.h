@@ -0,0 +1,51 @@
+#ifndef CHANNELS_H_
+#define CHANNELS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Run-hour counters for several independent channels.
+ *
+ * Same accounting as run_timer.h (a total of finished runs plus, while
+ * running, the distance from the start timestamp to now), stored as a
+ * struct of arrays: one running bitmap and two int64 arrays. Snapshotting
+ * every channel is then a single linear pass over contiguous memory, which
+ * is what the once-a-second checkpoint poll and the persistence batch do.
+ * Arrays are allocated once by channels_init(); nothing allocates later.
+ * Not thread safe; callers hold their own lock. */
+#define CHANNELS_WORDS(count) (((count) + 31) / 32)
+
+typedef struct {
+    uint16_t count;
+    uint32_t *running;          // bit per channel
+    int64_t *start_us;          // clock value when the current run started
+    int64_t *accumulated_us;    // total of all finished runs
+} channels_t;
+
+esp_err_t channels_init(channels_t *c, uint16_t count);
+void channels_free(channels_t *c);
+
+static inline bool channels_is_running(const channels_t *c, uint16_t ch) {
+    return c->running[ch / 32] & (1u << (ch % 32));
+}
+
+void channels_set_total(channels_t *c, uint16_t ch, int64_t total_us);
+
+/* Return false when the channel was already running / already stopped.
+ * channels_stop() reports how long the run lasted (since start or the
+ * last reset). */
+bool channels_start(channels_t *c, uint16_t ch, int64_t now_us);
+bool channels_stop(channels_t *c, uint16_t ch, int64_t now_us, int64_t *run_us);
+
+/* Zero the total and return what it was; a running channel keeps running
+ * from now. */
+int64_t channels_reset(channels_t *c, uint16_t ch, int64_t now_us);
+
+int64_t channels_elapsed_us(const channels_t *c, uint16_t ch, int64_t now_us);
+
+/* Totals of every channel and a copy of the running bitmap in one pass.
+ * Returns the sum of the totals. */
+int64_t channels_snapshot(const channels_t *c, int64_t now_us, int64_t *totals, uint32_t *running);
+
+#endif
@@ -0,0 +1,90 @@
+#include "esp_log.h"
+#include "checkpoint.h"
+
+void checkpoint_init(checkpoint_t *c, uint32_t period_s, uint32_t idle_s, int64_t now_us, int64_t total_us) {
+    *c = (checkpoint_t) {
+        .period_s = period_s,
+        .idle_s = idle_s,
+        .last_write_us = now_us,
+        .saved_total_us = total_us,
+    };
+}
+
+checkpoint_reason_t checkpoint_due(checkpoint_t *c, int64_t now_us, int64_t total_us, bool running) {
+    if (total_us == c->saved_total_us) {
+        c->dirty_since_us = 0;
+        return CHECKPOINT_NONE;
+    }
+    if (c->dirty_since_us == 0) {
+        c->dirty_since_us = now_us;
+    }
+    if (running) {
+        if (now_us - c->last_write_us >= (int64_t)c->period_s * 1000000) {
+            return CHECKPOINT_PERIOD;
+        }
+    } else if (now_us - c->dirty_since_us >= (int64_t)c->idle_s * 1000000) {
+        return CHECKPOINT_IDLE;
+    }
+    return CHECKPOINT_NONE;
+}
+
+void checkpoint_done(checkpoint_t *c, checkpoint_reason_t reason, int64_t now_us, int64_t total_us) {
+    c->last_write_us = now_us;
+    c->saved_total_us = total_us;
+    c->dirty_since_us = 0;
+    c->writes[reason]++;
+}
+
+#if CONFIG_SLAVE_CHECKPOINT_SIMULATE
+#include "run_timer.h"
+
+// One day of a machine that runs for 5-120 minutes at a time with 1-60
+// minute pauses, polled once per second like the firmware does
+static void simulate_policy(uint32_t period_s, uint32_t idle_s) {
+    static const char *SIM_TAG = "CHECKPOINT_SIM";
+    const int64_t second = 1000000;
+    run_timer_t t;
+    checkpoint_t c;
+    uint32_t rng = 0x9E3779B9;
+    int64_t next_toggle = 0;
+    int64_t max_loss = 0;
+
+    run_timer_init(&t, 0);
+    checkpoint_init(&c, period_s, idle_s, 0, 0);
+    for (int64_t now = 0; now < 86400 * second; now += second) {
+        if (now >= next_toggle) {
+            rng = rng * 1664525 + 1013904223;
+            if (t.running) {
+                run_timer_stop(&t, now);
+                checkpoint_done(&c, CHECKPOINT_EVENT, now, run_timer_elapsed_us(&t, now));
+                next_toggle = now + (60 + (rng >> 8) % 3541) * second;
+            } else {
+                run_timer_start(&t, now);
+                next_toggle = now + (300 + (rng >> 8) % 6901) * second;
+            }
+        }
+        const int64_t total = run_timer_elapsed_us(&t, now);
+        // Loss if power were cut just before this poll
+        if (total - c.saved_total_us > max_loss) {
+            max_loss = total - c.saved_total_us;
+        }
+        const checkpoint_reason_t reason = checkpoint_due(&c, now, total, t.running);
+        if (reason != CHECKPOINT_NONE) {
+            checkpoint_done(&c, reason, now, total);
+        }
+    }
+
+    const uint32_t total_writes = c.writes[CHECKPOINT_EVENT] + c.writes[CHECKPOINT_PERIOD] + c.writes[CHECKPOINT_IDLE];
+    ESP_LOGI(SIM_TAG, "period %3lu s: %5lu writes/day (%lu event, %lu period, %lu idle), max loss %lld s",
+             (unsigned long)period_s, (unsigned long)total_writes, (unsigned long)c.writes[CHECKPOINT_EVENT],
+             (unsigned long)c.writes[CHECKPOINT_PERIOD], (unsigned long)c.writes[CHECKPOINT_IDLE],
+             (long long)(max_loss / second));
+}
+
+void checkpoint_simulate(void) {
+    static const uint32_t periods[] = { 1, 10, 60, 300, 900 };
+    for (int i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) {
+        simulate_policy(periods[i], CONFIG_SLAVE_CHECKPOINT_IDLE_S);
+    }
+}
+#endif
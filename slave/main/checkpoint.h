@@ -0,0 +1,48 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* When to write the run counter to flash.
+ *
+ * A write happens
+ *  - on STOP and RESET, unconditionally (the caller saves directly),
+ *  - on a power-fail warning, if anything is unsaved (see powerfail.h),
+ *  - while running, once the unsaved part is period_s old,
+ *  - while stopped, once an unsaved change has been left alone for idle_s
+ *    (e.g. a stop whose write failed, or a change made while stopped).
+ * A power cut while running therefore loses at most period_s plus one
+ * polling interval; a stopped counter loses nothing once idle_s has passed.
+ * Times are passed in so the policy can be replayed on a simulated clock. */
+typedef enum {
+    CHECKPOINT_NONE = 0,
+    CHECKPOINT_EVENT,           // STOP / RESET
+    CHECKPOINT_PERIOD,
+    CHECKPOINT_IDLE,
+    CHECKPOINT_POWERFAIL,       // supply is going away
+    CHECKPOINT_REASON_COUNT,
+} checkpoint_reason_t;
+
+typedef struct {
+    uint32_t period_s;
+    uint32_t idle_s;
+    int64_t last_write_us;
+    int64_t saved_total_us;     // total at the last successful write
+    int64_t dirty_since_us;     // first poll that saw an unsaved change, 0 if clean
+    uint32_t writes[CHECKPOINT_REASON_COUNT];
+} checkpoint_t;
+
+void checkpoint_init(checkpoint_t *c, uint32_t period_s, uint32_t idle_s, int64_t now_us, int64_t total_us);
+
+/* Whether the caller should write total_us now, and why. */
+checkpoint_reason_t checkpoint_due(checkpoint_t *c, int64_t now_us, int64_t total_us, bool running);
+
+/* Record a successful write. */
+void checkpoint_done(checkpoint_t *c, checkpoint_reason_t reason, int64_t now_us, int64_t total_us);
+
+/* Replay a synthetic day of usage against several periods and log write
+ * rates and worst-case loss. Only built with CONFIG_SLAVE_CHECKPOINT_SIMULATE. */
+void checkpoint_simulate(void);
+
+#endif
@@ -0,0 +1,78 @@
+#include <string.h>
+#include "chunk_writer.h"
+
+static void flush(chunk_writer_t *w) {
+    if (w->err == ESP_OK && w->len > 0) {
+        w->err = httpd_resp_send_chunk(w->req, w->buf, w->len);
+        w->sent += w->len;
+    }
+    w->len = 0;
+}
+
+void chunk_writer_init(chunk_writer_t *w, httpd_req_t *req) {
+    w->req = req;
+    w->err = ESP_OK;
+    w->len = 0;
+    w->sent = 0;
+}
+
+void chunk_put(chunk_writer_t *w, const char *s, size_t len) {
+    while (len > 0) {
+        if (w->len == sizeof(w->buf)) {
+            flush(w);
+        }
+        const size_t room = sizeof(w->buf) - w->len;
+        const size_t n = len < room ? len : room;
+        memcpy(&w->buf[w->len], s, n);
+        w->len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+void chunk_put_str(chunk_writer_t *w, const char *s) {
+    chunk_put(w, s, strlen(s));
+}
+
+void chunk_put_int(chunk_writer_t *w, int64_t v) {
+    char digits[20];
+    int n = sizeof(digits);
+    uint64_t u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+    do {
+        digits[--n] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (v < 0) {
+        chunk_put(w, "-", 1);
+    }
+    chunk_put(w, &digits[n], sizeof(digits) - n);
+}
+
+void chunk_put_us_as_seconds(chunk_writer_t *w, int64_t us) {
+    const uint64_t u = us < 0 ? -(uint64_t)us : (uint64_t)us;
+    char frac[7] = ".";
+    uint32_t f = u % 1000000;
+    for (int i = 6; i > 0; i--) {
+        frac[i] = '0' + f % 10;
+        f /= 10;
+    }
+    size_t len = sizeof(frac);
+    while (len > 1 && frac[len - 1] == '0') {
+        len--;
+    }
+    if (us < 0) {
+        chunk_put(w, "-", 1);
+    }
+    chunk_put_int(w, u / 1000000);
+    if (len > 1) {
+        chunk_put(w, frac, len);
+    }
+}
+
+esp_err_t chunk_writer_end(chunk_writer_t *w) {
+    flush(w);
+    if (w->err != ESP_OK) {
+        return w->err;
+    }
+    return httpd_resp_send_chunk(w->req, NULL, 0);
+}
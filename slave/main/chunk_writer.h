@@ -0,0 +1,39 @@
+#ifndef CHUNK_WRITER_H_
+#define CHUNK_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/* Streaming writer for chunked HTTP responses.
+ *
+ * Output collects in one fixed buffer that goes out as a chunk each time it
+ * fills, so a response of any length costs CHUNK_WRITER_SIZE bytes and
+ * nothing is allocated. Integers are formatted by hand rather than through
+ * printf. After a failed chunk the rest of the output is dropped and the
+ * error is kept for chunk_writer_end(). */
+#define CHUNK_WRITER_SIZE 512
+
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;              // first failed chunk
+    size_t len;
+    uint32_t sent;              // bytes handed to the server so far
+    char buf[CHUNK_WRITER_SIZE];
+} chunk_writer_t;
+
+void chunk_writer_init(chunk_writer_t *w, httpd_req_t *req);
+
+void chunk_put(chunk_writer_t *w, const char *s, size_t len);
+void chunk_put_str(chunk_writer_t *w, const char *s);
+void chunk_put_int(chunk_writer_t *w, int64_t v);
+
+/* Microseconds as decimal seconds, exact and without trailing zeros:
+ * 1500000 is "1.5", 127 is "0.000127". */
+void chunk_put_us_as_seconds(chunk_writer_t *w, int64_t us);
+
+/* Send what is buffered and the terminating chunk. */
+esp_err_t chunk_writer_end(chunk_writer_t *w);
+
+#endif
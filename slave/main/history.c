@@ -0,0 +1,147 @@
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "link_proto.h"
+#include "journal.h"
+#include "history.h"
+
+#define HISTORY_RECORD_LEN 16
+#define HISTORY_QUEUE_LEN 16
+// Any clock earlier than this has not been set by SNTP yet
+#define HISTORY_MIN_WALL_TIME 1700000000
+
+static const char *TAG = "history";
+
+static journal_t journal;
+static SemaphoreHandle_t journal_lock;
+static QueueHandle_t queue;
+static history_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void pack_event(const history_event_t *ev, uint8_t out[HISTORY_RECORD_LEN - JOURNAL_CRC_SIZE]) {
+    out[0] = ev->type;
+    out[1] = ev->flags;
+    link_put_u16(&out[2], ev->channel);
+    link_put_u32(&out[4], ev->time_s);
+    link_put_u32(&out[8], ev->duration_s);
+}
+
+static void count(uint32_t *counter) {
+    taskENTER_CRITICAL(&stats_lock);
+    (*counter)++;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+static void history_task(void *arg) {
+    history_event_t ev;
+    uint8_t rec[HISTORY_RECORD_LEN - JOURNAL_CRC_SIZE];
+    while (1) {
+        xQueueReceive(queue, &ev, portMAX_DELAY);
+        pack_event(&ev, rec);
+        xSemaphoreTake(journal_lock, portMAX_DELAY);
+        const esp_err_t err = journal_append(&journal, rec);
+        xSemaphoreGive(journal_lock);
+        if (err == ESP_OK) {
+            count(&stats.written);
+        } else {
+            ESP_LOGE(TAG, "append failed: %s", esp_err_to_name(err));
+            count(&stats.dropped);
+        }
+    }
+}
+
+esp_err_t history_init(void) {
+    journal_flash_t flash;
+    esp_err_t err = journal_partition_init(&flash, HISTORY_PARTITION);
+    if (err == ESP_OK) {
+        err = journal_mount(&journal, &flash, HISTORY_RECORD_LEN);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "partition \"%s\" unusable: %s", HISTORY_PARTITION, esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "%lu events retained, capacity %lu",
+             (unsigned long)(journal_end_index(&journal) - journal_first_index(&journal)),
+             (unsigned long)(journal.sectors - 1) * journal.records_per_sector);
+    journal_lock = xSemaphoreCreateMutex();
+    queue = xQueueCreate(HISTORY_QUEUE_LEN, sizeof(history_event_t));
+    xTaskCreate(history_task, "history_task", 1024 * 3, NULL, 2, NULL);
+    return ESP_OK;
+}
+
+void history_post(history_type_t type, uint16_t channel, uint32_t duration_s) {
+    if (queue == NULL) {
+        return;
+    }
+    history_event_t ev = {
+        .type = type,
+        .channel = channel,
+        .duration_s = duration_s,
+    };
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec >= HISTORY_MIN_WALL_TIME) {
+        ev.flags = HISTORY_WALL_TIME;
+        ev.time_s = tv.tv_sec;
+    } else {
+        ev.time_s = esp_timer_get_time() / 1000000;
+    }
+    if (xQueueSend(queue, &ev, 0) != pdTRUE) {
+        count(&stats.dropped);
+    }
+}
+
+void history_range(uint32_t *first, uint32_t *end) {
+    if (journal_lock == NULL) {
+        *first = *end = 0;
+        return;
+    }
+    xSemaphoreTake(journal_lock, portMAX_DELAY);
+    *first = journal_first_index(&journal);
+    *end = journal_end_index(&journal);
+    xSemaphoreGive(journal_lock);
+}
+
+esp_err_t history_read(uint32_t index, history_event_t *out) {
+    if (journal_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t rec[HISTORY_RECORD_LEN - JOURNAL_CRC_SIZE];
+    xSemaphoreTake(journal_lock, portMAX_DELAY);
+    const esp_err_t err = journal_read(&journal, index, rec);
+    xSemaphoreGive(journal_lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+    out->type = rec[0];
+    out->flags = rec[1];
+    out->channel = link_get_u16(&rec[2]);
+    out->time_s = link_get_u32(&rec[4]);
+    out->duration_s = link_get_u32(&rec[8]);
+    return ESP_OK;
+}
+
+const char *history_type_name(uint8_t type) {
+    switch (type) {
+    case HISTORY_BOOT:
+        return "boot";
+    case HISTORY_START:
+        return "start";
+    case HISTORY_STOP:
+        return "stop";
+    case HISTORY_RESET:
+        return "reset";
+    default:
+        return "unknown";
+    }
+}
+
+void history_get_stats(history_stats_t *out) {
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
@@ -0,0 +1,59 @@
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Run-session event log.
+ *
+ * Every boot, and every start, stop and reset of a channel, is appended as a 16-byte record to a
+ * journal on the "history" partition, which keeps the newest few thousand
+ * events and recycles the oldest sector as it fills. Events are posted into
+ * a fixed queue and written by a low-priority task, so callers never wait
+ * for flash and RAM use does not depend on how much history exists.
+ *
+ * Events are addressed by the journal's global index, which only grows, so
+ * an index works as a pagination cursor across appends and reboots. */
+#define HISTORY_PARTITION "history"
+
+typedef enum {
+    HISTORY_BOOT = 1,           // duration: sum of all channel totals at boot
+    HISTORY_START,
+    HISTORY_STOP,               // duration: length of the session just ended
+    HISTORY_RESET,              // duration: counter total that was cleared
+} history_type_t;
+
+#define HISTORY_WALL_TIME 0x01  // time_s is Unix time, otherwise seconds since boot
+#define HISTORY_ALL_CHANNELS 0xFFFF
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    uint16_t channel;           // HISTORY_ALL_CHANNELS for boot
+    uint32_t time_s;
+    uint32_t duration_s;
+} history_event_t;
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;           // queue full or write failed
+} history_stats_t;
+
+esp_err_t history_init(void);
+
+/* Timestamp an event now and queue it for writing. Never blocks. */
+void history_post(history_type_t type, uint16_t channel, uint32_t duration_s);
+
+/* Current cursor range: oldest retained index and one past the newest. */
+void history_range(uint32_t *first, uint32_t *end);
+
+/* ESP_ERR_NOT_FOUND once the index has been recycled or is not written
+ * yet, ESP_ERR_INVALID_CRC for a torn record. */
+esp_err_t history_read(uint32_t index, history_event_t *out);
+
+const char *history_type_name(uint8_t type);
+
+void history_get_stats(history_stats_t *out);
+
+#endif
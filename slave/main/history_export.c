@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "history.h"
+#include "chunk_writer.h"
+#include "history_export.h"
+
+static const char *TAG = "history_export";
+
+static history_export_stats_t stats;        // under lock
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void put_csv(chunk_writer_t *w, uint32_t index, const history_event_t *ev) {
+    chunk_put_int(w, index);
+    chunk_put(w, ",", 1);
+    chunk_put_str(w, history_type_name(ev->type));
+    chunk_put(w, ",", 1);
+    if (ev->channel != HISTORY_ALL_CHANNELS) {
+        chunk_put_int(w, ev->channel);
+    }
+    chunk_put(w, ",", 1);
+    chunk_put_int(w, ev->time_s);
+    chunk_put_str(w, ev->flags & HISTORY_WALL_TIME ? ",1," : ",0,");
+    chunk_put_int(w, ev->duration_s);
+    chunk_put(w, "\n", 1);
+}
+
+static void put_ndjson(chunk_writer_t *w, uint32_t index, const history_event_t *ev) {
+    chunk_put_str(w, "{\"index\":");
+    chunk_put_int(w, index);
+    chunk_put_str(w, ",\"type\":\"");
+    chunk_put_str(w, history_type_name(ev->type));
+    chunk_put_str(w, "\",\"channel\":");
+    if (ev->channel != HISTORY_ALL_CHANNELS) {
+        chunk_put_int(w, ev->channel);
+    } else {
+        chunk_put_str(w, "null");
+    }
+    chunk_put_str(w, ",\"time\":");
+    chunk_put_int(w, ev->time_s);
+    chunk_put_str(w, ev->flags & HISTORY_WALL_TIME ? ",\"wall_time\":true" : ",\"wall_time\":false");
+    chunk_put_str(w, ",\"duration_s\":");
+    chunk_put_int(w, ev->duration_s);
+    chunk_put_str(w, "}\n");
+}
+
+static esp_err_t export_handler(httpd_req_t *req) {
+    char query[80];
+    char value[12];
+    bool csv = false;
+    bool ranged = false;
+    uint32_t from = 0, to = UINT32_MAX;
+    int32_t channel = -1;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK) {
+            if (strcmp(value, "csv") == 0) {
+                csv = true;
+            } else if (strcmp(value, "ndjson") != 0) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "format is csv or ndjson");
+            }
+        }
+        if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK) {
+            from = strtoul(value, NULL, 10);
+            ranged = true;
+        }
+        if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK) {
+            to = strtoul(value, NULL, 10);
+            ranged = true;
+        }
+        if (httpd_query_key_value(query, "channel", value, sizeof(value)) == ESP_OK) {
+            char *end;
+            const unsigned long v = strtoul(value, &end, 10);
+            if (end == value || *end != '\0' || v >= CONFIG_SLAVE_CHANNEL_COUNT) {
+                return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such channel");
+            }
+            channel = v;
+        }
+    }
+    if (from > to) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "from is after to");
+    }
+
+    // Handlers run one at a time in the server task
+    static chunk_writer_t w;
+    chunk_writer_init(&w, req);
+    httpd_resp_set_type(req, csv ? "text/csv" : "application/x-ndjson");
+    httpd_resp_set_hdr(req, "Content-Disposition",
+                       csv ? "attachment; filename=\"history.csv\"" : "attachment; filename=\"history.ndjson\"");
+    if (csv) {
+        chunk_put_str(&w, "index,type,channel,time,wall_time,duration_s\n");
+    }
+    const int64_t start = esp_timer_get_time();
+    uint32_t first, end, records = 0, matched = 0;
+    history_range(&first, &end);
+    // Events appended from here on are left to the next export
+    for (uint32_t i = first; i < end && w.err == ESP_OK; i++) {
+        history_event_t ev;
+        if (history_read(i, &ev) != ESP_OK) {
+            continue;
+        }
+        records++;
+        if (ranged && (!(ev.flags & HISTORY_WALL_TIME) || ev.time_s < from || ev.time_s >= to)) {
+            continue;
+        }
+        if (channel >= 0 && ev.channel != channel && ev.channel != HISTORY_ALL_CHANNELS) {
+            continue;
+        }
+        matched++;
+        if (csv) {
+            put_csv(&w, i, &ev);
+        } else {
+            put_ndjson(&w, i, &ev);
+        }
+    }
+    const esp_err_t err = chunk_writer_end(&w);
+    const int64_t us = esp_timer_get_time() - start;
+    const uint32_t rate = us > 0 ? (uint64_t)w.sent * 1000000 / us : 0;
+    taskENTER_CRITICAL(&lock);
+    stats.exports += err == ESP_OK;
+    stats.records += records;
+    stats.matched += matched;
+    stats.bytes += w.sent;
+    stats.us += us;
+    stats.last_bytes_per_s = rate;
+    taskEXIT_CRITICAL(&lock);
+    ESP_LOGI(TAG, "%lu of %lu events, %lu bytes in %lld ms (%lu B/s)%s", (unsigned long)matched,
+             (unsigned long)records, (unsigned long)w.sent, (long long)us / 1000, (unsigned long)rate,
+             err == ESP_OK ? "" : ", client went away");
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t history_export_register(httpd_handle_t server) {
+    const httpd_uri_t uri = {
+        .uri = HISTORY_EXPORT_URI,
+        .method = HTTP_GET,
+        .handler = export_handler,
+        .user_ctx = NULL
+    };
+    const esp_err_t err = httpd_register_uri_handler(server, &uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s not registered: %s", uri.uri, esp_err_to_name(err));
+    }
+    return err;
+}
+
+void history_export_get_stats(history_export_stats_t *out) {
+    taskENTER_CRITICAL(&lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&lock);
+}
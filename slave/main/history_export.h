@@ -0,0 +1,36 @@
+#ifndef HISTORY_EXPORT_H_
+#define HISTORY_EXPORT_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/* Bulk export of the run history:
+ *
+ *   GET /history/export?format=csv|ndjson&from=<unix>&to=<unix>&channel=<n>
+ *
+ * Reads every retained event oldest first, one record at a time from
+ * flash, and streams the matches through a chunk writer, so an export of
+ * the whole partition needs no more RAM than one of a single event. With
+ * from or to only events stamped with wall time in [from, to) are
+ * exported; with channel, events of that channel and boot events. A
+ * channel that does not exist is 404 and from after to is 400. CSV has
+ * a header line; NDJSON has one object per line with the fields of
+ * /history. Every export logs its throughput, and the totals are kept for
+ * /metrics. */
+#define HISTORY_EXPORT_URI "/history/export"
+
+typedef struct {
+    uint32_t exports;           // completed exports
+    uint32_t records;           // events read from flash
+    uint32_t matched;           // of which exported
+    uint64_t bytes;
+    uint64_t us;                // total time spent exporting
+    uint32_t last_bytes_per_s;  // throughput of the last export
+} history_export_stats_t;
+
+esp_err_t history_export_register(httpd_handle_t server);
+
+void history_export_get_stats(history_export_stats_t *out);
+
+#endif
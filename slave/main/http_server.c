@@ -0,0 +1,180 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "boot_profile.h"
+#include "http_server.h"
+
+#if HTTP_SERVER_MAX_SESSIONS > CONFIG_LWIP_MAX_SOCKETS - 3
+#error "HTTP_SERVER_MAX_SESSIONS needs more sockets; raise CONFIG_LWIP_MAX_SOCKETS"
+#endif
+#if CONFIG_SLAVE_LIVE_MAX_CLIENTS + CONFIG_SLAVE_LONGPOLL_MAX_WAITERS > HTTP_SERVER_MAX_SESSIONS - 2
+#error "live subscribers and long-poll waiters leave fewer than two HTTP sessions for other requests"
+#endif
+
+static const char *TAG = "http_server";
+
+static httpd_handle_t server;
+static http_server_register_fn_t register_fn;
+static SemaphoreHandle_t lock;
+static http_server_stats_t stats;       // under lock
+
+static void start(void) {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_open_sockets = HTTP_SERVER_MAX_SESSIONS;
+    config.max_uri_handlers = HTTP_SERVER_MAX_URIS;
+    config.lru_purge_enable = true;
+    httpd_handle_t h = NULL;
+    const esp_err_t err = httpd_start(&h, &config);
+    if (err != ESP_OK) {
+        stats.start_failures++;
+        ESP_LOGE(TAG, "start failed: %s, retrying on the next address", esp_err_to_name(err));
+        return;
+    }
+    stats.starts++;
+    register_fn(h);
+    server = h;
+    if (stats.starts == 1) {
+        boot_mark("http");
+        boot_profile_log();
+    }
+}
+
+// Sessions opened on the old address
+static void close_sessions(void) {
+    int fds[CONFIG_LWIP_MAX_SOCKETS];
+    size_t n = sizeof(fds) / sizeof(fds[0]);
+    if (httpd_get_client_list(server, &n, fds) != ESP_OK) {
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (httpd_sess_trigger_close(server, fds[i]) == ESP_OK) {
+            stats.sessions_closed++;
+        }
+    }
+}
+
+static void got_ip(bool changed) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    stats.got_ip++;
+    if (server == NULL) {
+        start();
+    } else if (changed) {
+        stats.ip_changes++;
+        close_sessions();
+    }
+    xSemaphoreGive(lock);
+}
+
+static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
+    if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        const ip_event_got_ip_t *event = event_data;
+        got_ip(event->ip_changed);
+    }
+}
+
+esp_err_t http_server_init(http_server_register_fn_t register_uris) {
+    register_fn = register_uris;
+    lock = xSemaphoreCreateMutex();
+    return esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, NULL);
+}
+
+httpd_handle_t http_server_handle(void) {
+    return server;
+}
+
+void http_server_get_stats(http_server_stats_t *out) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(lock);
+}
+
+#if CONFIG_SLAVE_HTTP_STORM_TEST
+#include "lwip/sockets.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#define STORM_CYCLES 300
+#define STORM_WARMUP 10
+
+// Socket connected to our own server over loopback, or -1
+static int loopback_connect(void) {
+    const int s = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (s < 0) {
+        return -1;
+    }
+    const struct timeval tv = { .tv_sec = 2 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(80),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+// Time for one GET answered with 200, or -1
+static int64_t loopback_get(void) {
+    static const char request[] = "GET /boot HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    const int64_t start = esp_timer_get_time();
+    const int s = loopback_connect();
+    if (s < 0) {
+        return -1;
+    }
+    char status[13] = { 0 };
+    int got = 0;
+    if (send(s, request, sizeof(request) - 1, 0) == sizeof(request) - 1) {
+        got = recv(s, status, sizeof(status) - 1, MSG_WAITALL);
+    }
+    close(s);
+    return got == sizeof(status) - 1 && strcmp(status, "HTTP/1.1 200") == 0 ? esp_timer_get_time() - start : -1;
+}
+
+void http_server_storm_test(void) {
+    static const char *STORM_TAG = "http_storm";
+    got_ip(false);
+    uint32_t heap_start = 0;
+    int64_t worst_us = 0, sum_us = 0;
+    uint32_t failures = 0;
+    for (int i = 0; i < STORM_WARMUP + STORM_CYCLES; i++) {
+        // An idle client from "before the reconnect", which the change must close
+        const int stale = loopback_connect();
+        got_ip(i % 2);
+        const int64_t us = loopback_get();
+        if (stale >= 0) {
+            close(stale);
+        }
+        if (i == STORM_WARMUP) {
+            heap_start = esp_get_free_heap_size();
+        }
+        if (i < STORM_WARMUP) {
+            continue;
+        }
+        if (us < 0) {
+            failures++;
+        } else {
+            sum_us += us;
+            worst_us = us > worst_us ? us : worst_us;
+        }
+    }
+    // Let the server task finish closing the last sessions
+    vTaskDelay(pdMS_TO_TICKS(100));
+    http_server_stats_t s;
+    http_server_get_stats(&s);
+    ESP_LOGI(STORM_TAG, "%d address events: %lu server starts, %lu stale sessions closed",
+             STORM_CYCLES, (unsigned long)s.starts, (unsigned long)s.sessions_closed);
+    ESP_LOGI(STORM_TAG, "free heap %lu -> %lu bytes, minimum ever %lu",
+             (unsigned long)heap_start, (unsigned long)esp_get_free_heap_size(),
+             (unsigned long)esp_get_minimum_free_heap_size());
+    ESP_LOGI(STORM_TAG, "time to serve: avg %lld us, worst %lld us, %lu failed",
+             (long long)(STORM_CYCLES > failures ? sum_us / (STORM_CYCLES - failures) : 0),
+             (long long)worst_us, (unsigned long)failures);
+}
+#endif
@@ -0,0 +1,54 @@
+#ifndef HTTP_SERVER_H_
+#define HTTP_SERVER_H_
+
+#include <stdint.h>
+#include "esp_http_server.h"
+
+/* Lifecycle of the slave's HTTP server across Wi-Fi reconnects.
+ *
+ * The server is started on the first address and then kept for the life of
+ * the firmware. It listens on every address, so neither a reconnect nor a
+ * new lease needs a new instance. When the address changes, sessions
+ * accepted on the old one can never complete, so they are closed at once
+ * instead of holding a socket until their timeouts; least recently used
+ * sessions are also purged when all sockets are taken, so a burst of dead
+ * clients cannot lock new ones out. If the server failed to start, the
+ * next address tries again.
+ *
+ * Live subscribers and parked long-polls hold their sessions indefinitely,
+ * so their limits together must leave at least two for ordinary requests;
+ * the build checks it. */
+
+// Sessions the server accepts at once. Needs three fewer than
+// CONFIG_LWIP_MAX_SOCKETS for the server's own sockets.
+#define HTTP_SERVER_MAX_SESSIONS 7
+
+// URI handlers the server has room for; the slave registers 11, more than
+// the server's default of 8.
+#define HTTP_SERVER_MAX_URIS 16
+
+typedef void (*http_server_register_fn_t)(httpd_handle_t server);
+
+typedef struct {
+    uint32_t got_ip;            // address events seen
+    uint32_t ip_changes;        // of which with a new address
+    uint32_t starts;
+    uint32_t start_failures;
+    uint32_t sessions_closed;   // stale sessions closed on address changes
+} http_server_stats_t;
+
+/* Register the IP event handlers. register_uris is called once per
+ * started server. Needs the default event loop. */
+esp_err_t http_server_init(http_server_register_fn_t register_uris);
+
+/* NULL until the server has started. */
+httpd_handle_t http_server_handle(void);
+
+void http_server_get_stats(http_server_stats_t *out);
+
+/* Drive a few hundred lost/got address cycles through the lifecycle and
+ * log heap use and the time until a loopback request is served again.
+ * Only built with CONFIG_SLAVE_HTTP_STORM_TEST. */
+void http_server_storm_test(void);
+
+#endif
@@ -0,0 +1,526 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "link_proto.h"
+#include "channels.h"
+#include "http_server.h"
+#include "live.h"
+
+#if !CONFIG_HTTPD_WS_SUPPORT
+#error "/ws needs CONFIG_HTTPD_WS_SUPPORT (Component config > HTTP Server > WebSocket server support)"
+#endif
+
+#define LIVE_KEEPALIVE_POSTS 15         // idle ticks between keepalives
+#define LIVE_ENTRY_MAX 20               // "[65535,4294967295,1],"
+#define LIVE_JSON_MAX 72                // "{\"event\":\"state\",\"id\":...,\"up\":...,\"ch\":[" and "]}"
+#define LIVE_PREFIX_MAX 40              // "id: ...\nevent: state\ndata: ", or a WebSocket header
+#define LIVE_WS_COMMAND_MAX LINK_MAX_FRAME // longest WebSocket command message
+
+static const char *TAG = "live";
+
+typedef struct {
+    int fd;
+    bool ws;
+} client_t;
+
+// Everything but live_post() and live_get_stats() runs in the HTTP server task
+static struct {
+    uint16_t count;
+    persist_snapshot_fn_t snapshot;
+    uart_link_command_fn on_command;
+    int64_t *totals;
+    uint32_t *running;
+    uint32_t *sent_s;               // state in the last broadcast
+    uint32_t *sent_running;
+    // The one serialization all subscribers get: the update at
+    // buf + LIVE_PREFIX_MAX, each transport's framing written in front of it
+    char *buf;
+    client_t clients[CONFIG_SLAVE_LIVE_MAX_CLIENTS];
+    int n_clients;
+    uint32_t seq;
+    uint32_t idle_posts;
+    volatile bool force_full;       // every channel in every tick, for the benchmark
+} live;
+
+static bool queued;                 // under lock
+static live_stats_t stats;          // under lock
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static char *put_str(char *p, const char *s) {
+    const size_t len = strlen(s);
+    memcpy(p, s, len);
+    return p + len;
+}
+
+static char *put_u32(char *p, uint32_t v) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+// One update at live.buf + LIVE_PREFIX_MAX: every channel, or the ones
+// whose seconds or run state differ from the last broadcast. Returns its
+// length, 0 if no channel changed
+static size_t serialize(bool full) {
+    live.snapshot(live.totals, live.running);
+    const uint32_t id = full ? live.seq : live.seq + 1;
+    char *const start = live.buf + LIVE_PREFIX_MAX;
+    char *p = start;
+    p = put_str(p, full ? "{\"event\":\"state\",\"id\":" : "{\"event\":\"tick\",\"id\":");
+    p = put_u32(p, id);
+    p = put_str(p, ",\"up\":");
+    p = put_u32(p, esp_timer_get_time() / 1000000);
+    p = put_str(p, ",\"ch\":[");
+    const char *first = p;
+    // The state for the first subscriber is the baseline of the next tick;
+    // with others connected the baseline stays what they were last sent
+    const bool baseline = full && live.n_clients == 0;
+    for (uint16_t ch = 0; ch < live.count; ch++) {
+        const uint32_t bit = 1u << (ch % 32);
+        const uint32_t s = live.totals[ch] / 1000000;
+        const bool on = live.running[ch / 32] & bit;
+        if (!full && s == live.sent_s[ch] && on == !!(live.sent_running[ch / 32] & bit)) {
+            continue;
+        }
+        if (!full || baseline) {
+            live.sent_s[ch] = s;
+            live.sent_running[ch / 32] = on ? live.sent_running[ch / 32] | bit : live.sent_running[ch / 32] & ~bit;
+        }
+        if (p != first) {
+            *p++ = ',';
+        }
+        *p++ = '[';
+        p = put_u32(p, ch);
+        *p++ = ',';
+        p = put_u32(p, s);
+        p = put_str(p, on ? ",1]" : ",0]");
+    }
+    if (p == first && !full) {
+        return 0;
+    }
+    live.seq = id;
+    p = put_str(p, "]}");
+    return p - start;
+}
+
+// SSE framing around the serialized update; returns where the event starts
+static const char *sse_frame(bool full, size_t len, size_t *out_len) {
+    char prefix[LIVE_PREFIX_MAX];
+    char *p = put_str(prefix, "id: ");
+    p = put_u32(p, live.seq);
+    p = put_str(p, full ? "\nevent: state\ndata: " : "\nevent: tick\ndata: ");
+    const size_t plen = p - prefix;
+    char *const start = live.buf + LIVE_PREFIX_MAX - plen;
+    memcpy(start, prefix, plen);
+    memcpy(live.buf + LIVE_PREFIX_MAX + len, "\n\n", 2);
+    *out_len = plen + len + 2;
+    return start;
+}
+
+// Unmasked WebSocket header for one final message of the given opcode
+static const char *ws_frame(uint8_t opcode, size_t len, size_t *out_len) {
+    uint8_t header[10];
+    size_t hlen;
+    header[0] = 0x80 | opcode;
+    if (len < 126) {
+        header[1] = len;
+        hlen = 2;
+    } else if (len <= UINT16_MAX) {
+        header[1] = 126;
+        header[2] = len >> 8;
+        header[3] = len;
+        hlen = 4;
+    } else {
+        header[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = (uint64_t)len >> (56 - 8 * i);
+        }
+        hlen = 10;
+    }
+    char *const start = live.buf + LIVE_PREFIX_MAX - hlen;
+    memcpy(start, header, hlen);
+    *out_len = hlen + len;
+    return start;
+}
+
+static void set_subscribers(void) {
+    uint32_t ws = 0;
+    for (int i = 0; i < live.n_clients; i++) {
+        ws += live.clients[i].ws;
+    }
+    taskENTER_CRITICAL(&lock);
+    stats.subscribers = live.n_clients;
+    stats.ws_subscribers = ws;
+    taskEXIT_CRITICAL(&lock);
+}
+
+static void remove_client(int i) {
+    live.clients[i] = live.clients[--live.n_clients];
+    set_subscribers();
+}
+
+// Session free callback: the subscriber disconnected or was closed
+static void unsubscribe(void *ctx) {
+    const int fd = (intptr_t)ctx - 1;
+    for (int i = 0; i < live.n_clients; i++) {
+        if (live.clients[i].fd == fd) {
+            remove_client(i);
+            return;
+        }
+    }
+}
+
+// Same bytes to every subscriber of one transport; returns those dropped
+static uint32_t send_all(bool ws, const char *data, size_t len) {
+    uint32_t dropped = 0;
+    for (int i = 0; i < live.n_clients;) {
+        if (live.clients[i].ws != ws) {
+            i++;
+            continue;
+        }
+        // Never wait on a subscriber; a partial write would corrupt its stream
+        if (send(live.clients[i].fd, data, len, MSG_DONTWAIT) == (ssize_t)len) {
+            i++;
+            continue;
+        }
+        httpd_sess_trigger_close(http_server_handle(), live.clients[i].fd);
+        remove_client(i);
+        dropped++;
+    }
+    return dropped;
+}
+
+static void broadcast(void *arg) {
+    taskENTER_CRITICAL(&lock);
+    queued = false;
+    const uint32_t ws_subscribers = stats.ws_subscribers;
+    taskEXIT_CRITICAL(&lock);
+    if (live.n_clients == 0) {
+        return;
+    }
+    const int64_t start = esp_timer_get_time();
+    const size_t len = serialize(live.force_full);
+    uint32_t dropped = 0;
+    size_t sse_len = 0, ws_len = 0;
+    if (len > 0) {
+        live.idle_posts = 0;
+        // SSE first: the WebSocket header overwrites the SSE prefix
+        const char *sse = sse_frame(live.force_full, len, &sse_len);
+        dropped += send_all(false, sse, sse_len);
+        if (ws_subscribers > 0) {
+            const char *ws = ws_frame(HTTPD_WS_TYPE_TEXT, len, &ws_len);
+            dropped += send_all(true, ws, ws_len);
+        }
+    } else if (++live.idle_posts >= LIVE_KEEPALIVE_POSTS) {
+        live.idle_posts = 0;
+        static const char comment[] = ":\n\n";
+        static const char ping[] = { 0x80 | HTTPD_WS_TYPE_PING, 0 };
+        dropped += send_all(false, comment, sizeof(comment) - 1);
+        dropped += send_all(true, ping, sizeof(ping));
+    }
+    const uint32_t us = esp_timer_get_time() - start;
+    taskENTER_CRITICAL(&lock);
+    stats.dropped += dropped;
+    if (len > 0) {
+        stats.broadcasts++;
+        stats.last_bytes = sse_len > ws_len ? sse_len : ws_len;
+        stats.last_us = us;
+        stats.max_us = us > stats.max_us ? us : stats.max_us;
+        stats.total_us += us;
+    }
+    taskEXIT_CRITICAL(&lock);
+}
+
+static bool full(void) {
+    if (live.n_clients < CONFIG_SLAVE_LIVE_MAX_CLIENTS) {
+        return false;
+    }
+    taskENTER_CRITICAL(&lock);
+    stats.rejected++;
+    taskEXIT_CRITICAL(&lock);
+    return true;
+}
+
+static void add_client(httpd_req_t *req, bool ws) {
+    const int fd = httpd_req_to_sockfd(req);
+    live.clients[live.n_clients++] = (client_t) { .fd = fd, .ws = ws };
+    req->sess_ctx = (void *)(intptr_t)(fd + 1);
+    req->free_ctx = unsubscribe;
+    set_subscribers();
+}
+
+// GET /events: answers with the stream headers and the full state, then
+// keeps the session as a subscriber until it closes
+static esp_err_t events_handler(httpd_req_t *req) {
+    static const char headers[] = "HTTP/1.1 200 OK\r\n"
+                                  "Content-Type: text/event-stream\r\n"
+                                  "Cache-Control: no-cache\r\n"
+                                  "\r\n";
+    if (req->sess_ctx != NULL) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Already subscribed");
+    }
+    if (full()) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Too many subscribers", HTTPD_RESP_USE_STRLEN);
+    }
+    size_t len;
+    const char *event = sse_frame(true, serialize(true), &len);
+    if (httpd_send(req, headers, sizeof(headers) - 1) < 0 || httpd_send(req, event, len) < 0) {
+        return ESP_FAIL;
+    }
+    add_client(req, false);
+    return ESP_OK;
+}
+
+// Text command: a name or the legacy UART text, optionally followed by
+// " <channel>"
+static bool text_command(char *text) {
+    static const char *const names[] = {
+        [LINK_CMD_START] = "START",
+        [LINK_CMD_STOP] = "STOP",
+        [LINK_CMD_RESET] = "RESET",
+    };
+    uint16_t ch = 0;
+    char *space = strrchr(text, ' ');
+    if (space != NULL && space[1] >= '0' && space[1] <= '9') {
+        char *end;
+        const unsigned long v = strtoul(space + 1, &end, 10);
+        if (*end != 0 || v > UINT16_MAX) {
+            return false;
+        }
+        ch = v;
+        *space = 0;
+    }
+    link_cmd_t cmd = link_parse_legacy(text);
+    for (link_cmd_t c = LINK_CMD_START; c <= LINK_CMD_RESET && cmd == LINK_CMD_NONE; c++) {
+        if (strcmp(text, names[c]) == 0) {
+            cmd = c;
+        }
+    }
+    return live.on_command(LIVE_WS_PORT, cmd, ch);
+}
+
+// Binary command: exactly one link_proto COMMAND frame
+static bool frame_command(const uint8_t *data, size_t len) {
+    link_decoder_t decoder;
+    link_decoder_init(&decoder);
+    for (size_t i = 0; i < len; i++) {
+        if (link_decoder_feed(&decoder, data[i])) {
+            link_cmd_t cmd;
+            uint16_t ch;
+            return i == len - 1 && decoder.frame.type == LINK_FRAME_COMMAND &&
+                   link_command_unpack(&decoder.frame, &cmd, &ch) && live.on_command(LIVE_WS_PORT, cmd, ch);
+        }
+    }
+    return false;
+}
+
+// /ws: the server has done the handshake by the time the GET arrives here;
+// every later call is one message from the client
+static esp_err_t ws_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) {
+        if (full()) {
+            // Close with 1013, try again later
+            static const char close_frame[] = { 0x80 | HTTPD_WS_TYPE_CLOSE, 2, 0x03, 0xF5 };
+            httpd_send(req, close_frame, sizeof(close_frame));
+            return ESP_FAIL;
+        }
+        size_t len;
+        const char *msg = ws_frame(HTTPD_WS_TYPE_TEXT, serialize(true), &len);
+        if (httpd_send(req, msg, len) < 0) {
+            return ESP_FAIL;
+        }
+        add_client(req, true);
+        return ESP_OK;
+    }
+
+    uint8_t payload[LIVE_WS_COMMAND_MAX + 1];
+    httpd_ws_frame_t frame = { .payload = payload };
+    // Longer than any command: the error closes the session
+    const esp_err_t err = httpd_ws_recv_frame(req, &frame, LIVE_WS_COMMAND_MAX);
+    if (err != ESP_OK) {
+        return err;
+    }
+    bool ok;
+    if (frame.type == HTTPD_WS_TYPE_TEXT) {
+        payload[frame.len] = 0;
+        ok = text_command((char *)payload);
+    } else if (frame.type == HTTPD_WS_TYPE_BINARY) {
+        ok = frame_command(payload, frame.len);
+    } else {
+        return ESP_OK;
+    }
+    taskENTER_CRITICAL(&lock);
+    if (ok) {
+        stats.ws_commands++;
+    } else {
+        stats.ws_rejected++;
+    }
+    taskEXIT_CRITICAL(&lock);
+    const char *reply = ok ? "{\"event\":\"reply\",\"ok\":true}" : "{\"event\":\"reply\",\"ok\":false}";
+    httpd_ws_frame_t out = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)reply,
+        .len = strlen(reply),
+    };
+    return httpd_ws_send_frame(req, &out);
+}
+
+esp_err_t live_init(uint16_t count, persist_snapshot_fn_t snapshot, uart_link_command_fn on_command) {
+    live.count = count;
+    live.snapshot = snapshot;
+    live.on_command = on_command;
+    live.totals = calloc(count, sizeof(int64_t));
+    live.running = calloc(CHANNELS_WORDS(count), sizeof(uint32_t));
+    live.sent_s = calloc(count, sizeof(uint32_t));
+    live.sent_running = calloc(CHANNELS_WORDS(count), sizeof(uint32_t));
+    // Framing in front, "\n\n" behind
+    live.buf = malloc(LIVE_PREFIX_MAX + LIVE_JSON_MAX + (size_t)count * LIVE_ENTRY_MAX + 2);
+    if (live.totals == NULL || live.running == NULL || live.sent_s == NULL || live.sent_running == NULL ||
+        live.buf == NULL) {
+        ESP_LOGE(TAG, "no memory for %u channels", count);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t live_register(httpd_handle_t server) {
+    const httpd_uri_t events = {
+        .uri = LIVE_SSE_URI,
+        .method = HTTP_GET,
+        .handler = events_handler,
+        .user_ctx = NULL
+    };
+    const httpd_uri_t ws = {
+        .uri = LIVE_WS_URI,
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .user_ctx = NULL,
+        .is_websocket = true
+    };
+    const httpd_uri_t *const uris[] = { &events, &ws };
+    esp_err_t first = ESP_OK;
+    for (size_t i = 0; i < sizeof(uris) / sizeof(uris[0]); i++) {
+        const esp_err_t err = httpd_register_uri_handler(server, uris[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "%s not registered: %s", uris[i]->uri, esp_err_to_name(err));
+            first = first == ESP_OK ? err : first;
+        }
+    }
+    return first;
+}
+
+void live_post(void) {
+    httpd_handle_t server = http_server_handle();
+    if (server == NULL || live.buf == NULL) {
+        return;
+    }
+    taskENTER_CRITICAL(&lock);
+    const bool already = queued;
+    queued = true;
+    taskEXIT_CRITICAL(&lock);
+    if (!already && httpd_queue_work(server, broadcast, NULL) != ESP_OK) {
+        taskENTER_CRITICAL(&lock);
+        queued = false;
+        taskEXIT_CRITICAL(&lock);
+    }
+}
+
+void live_get_stats(live_stats_t *out) {
+    taskENTER_CRITICAL(&lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&lock);
+}
+
+#if CONFIG_SLAVE_LIVE_BENCHMARK
+#define BENCH_BROADCASTS 50
+
+// Loopback subscriber past the stream headers, or -1 if refused
+static int subscribe(void) {
+    static const char request[] = "GET " LIVE_SSE_URI " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    const int s = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (s < 0) {
+        return -1;
+    }
+    const struct timeval tv = { .tv_sec = 2 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(80),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    char status[13] = { 0 };
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        send(s, request, sizeof(request) - 1, 0) != sizeof(request) - 1 ||
+        recv(s, status, sizeof(status) - 1, MSG_WAITALL) != sizeof(status) - 1 ||
+        strcmp(status, "HTTP/1.1 200") != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static void drain(int s) {
+    char buf[256];
+    while (recv(s, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+}
+
+void live_benchmark(void) {
+    for (int i = 0; i < 300 && http_server_handle() == NULL; i++) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    if (http_server_handle() == NULL) {
+        ESP_LOGW(TAG, "benchmark skipped, the HTTP server did not start");
+        return;
+    }
+    int clients[CONFIG_SLAVE_LIVE_MAX_CLIENTS + 1];
+    int n = 0;
+    live.force_full = true;
+    while (n < CONFIG_SLAVE_LIVE_MAX_CLIENTS + 1) {
+        const int s = subscribe();
+        if (s < 0) {
+            break;
+        }
+        clients[n++] = s;
+        live_stats_t before, after;
+        live_get_stats(&before);
+        after = before;
+        for (int i = 0; i < BENCH_BROADCASTS; i++) {
+            const uint32_t done = after.broadcasts;
+            live_post();
+            for (int wait = 0; wait < 100 && after.broadcasts == done; wait++) {
+                vTaskDelay(1);
+                live_get_stats(&after);
+            }
+            for (int c = 0; c < n; c++) {
+                drain(clients[c]);
+            }
+        }
+        const uint32_t count = after.broadcasts - before.broadcasts;
+        ESP_LOGI(TAG, "%d subscribers, %u channels: %llu us per broadcast (max %lu), %lu bytes per event",
+                 n, live.count, (unsigned long long)(count ? (after.total_us - before.total_us) / count : 0),
+                 (unsigned long)after.max_us, (unsigned long)after.last_bytes);
+    }
+    live.force_full = false;
+    live_stats_t s;
+    live_get_stats(&s);
+    ESP_LOGI(TAG, "%d subscribers connected (limit %d), %lu rejected, %lu dropped",
+             n, CONFIG_SLAVE_LIVE_MAX_CLIENTS, (unsigned long)s.rejected, (unsigned long)s.dropped);
+    for (int c = 0; c < n; c++) {
+        close(clients[c]);
+    }
+}
+#endif
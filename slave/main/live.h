@@ -0,0 +1,75 @@
+#ifndef LIVE_H_
+#define LIVE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "persist_task.h"
+#include "uart_link.h"
+
+/* Live channel updates pushed over Server-Sent Events (GET /events) and
+ * WebSocket (/ws).
+ *
+ * A subscriber first gets one "state" update with every channel, then a
+ * "tick" update whenever a channel's whole seconds or run state changed,
+ * carrying only those channels:
+ *
+ *   {"event":"tick","id":42,"up":1234,"ch":[[0,3600,1],[3,17,0]]}
+ *
+ * where each entry is [channel, total seconds, running] and "up" is the
+ * uptime in seconds. SSE wraps it in "id:", "event:" and "data:" lines; a
+ * WebSocket subscriber gets it as one text message. Idle periods send an
+ * SSE comment or a WebSocket ping every few seconds so dead peers are
+ * noticed.
+ *
+ * Every live_post() queues one broadcast on the HTTP server task; posts
+ * made while one is queued are folded into it. The broadcast takes one
+ * snapshot, serializes the update once and writes the same bytes, behind
+ * each transport's framing, to every subscriber without blocking. A
+ * subscriber whose socket cannot take a whole update is closed rather than
+ * let a slow client stall the server task or the others. Each subscriber
+ * holds one of the server's sessions until it disconnects.
+ *
+ * WebSocket subscribers can also send commands, which go to the same
+ * dispatcher as the UART ports with port LIVE_WS_PORT:
+ *   - a text message with START, STOP, RESET or the legacy UART text,
+ *     optionally followed by a space and a channel number ("STOP 3");
+ *     channel 0 without one;
+ *   - a binary message holding one link_proto COMMAND frame.
+ * Each command is answered with {"event":"reply","ok":true|false}. */
+#define LIVE_SSE_URI "/events"
+#define LIVE_WS_URI "/ws"
+#define LIVE_WS_PORT (-1)
+
+typedef struct {
+    uint32_t subscribers;       // connected now, both transports
+    uint32_t ws_subscribers;    // of which WebSocket
+    uint32_t rejected;          // turned away at CONFIG_SLAVE_LIVE_MAX_CLIENTS
+    uint32_t dropped;           // closed on a failed or partial write
+    uint32_t broadcasts;        // updates sent, keepalives excluded
+    uint32_t ws_commands;       // WebSocket commands accepted
+    uint32_t ws_rejected;       // WebSocket commands the parser or dispatcher refused
+    uint32_t last_bytes;        // size of the last update
+    uint32_t last_us;           // CPU time of the last broadcast, snapshot to last write
+    uint32_t max_us;
+    uint64_t total_us;
+} live_stats_t;
+
+esp_err_t live_init(uint16_t count, persist_snapshot_fn_t snapshot, uart_link_command_fn on_command);
+
+/* Register LIVE_SSE_URI and LIVE_WS_URI on a started server. */
+esp_err_t live_register(httpd_handle_t server);
+
+/* Queue a broadcast of what changed since the last one. Never blocks;
+ * called on every tick and every start, stop or reset. */
+void live_post(void);
+
+void live_get_stats(live_stats_t *out);
+
+/* Connect loopback SSE subscribers one at a time up to the limit and log
+ * the CPU time and bytes per broadcast of every channel at each count.
+ * Waits for the server to start. Only built with
+ * CONFIG_SLAVE_LIVE_BENCHMARK. */
+void live_benchmark(void);
+
+#endif
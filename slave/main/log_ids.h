@@ -0,0 +1,20 @@
+#ifndef LOG_IDS_H_
+#define LOG_IDS_H_
+
+#include "dlog.h"
+
+/* Deferred log formats used on the slave's UART hot paths: (id, tag, format).
+ * Arguments are raw 32-bit values, see dlog.h. */
+#define SLAVE_LOG_FORMATS(X) \
+    X(LOG_RX_READ, "RX_TASK", "Port %lu read %lu bytes: %08lx %08lx ...") \
+    X(LOG_RX_START, "RX_TASK", "Start command received, channel %lu") \
+    X(LOG_RX_STOP, "RX_TASK", "Stop command received, channel %lu") \
+    X(LOG_RX_RESET, "RX_TASK", "Reset command received, channel %lu") \
+    X(LOG_BENCH, "dlog_bench", "Record %lu")
+
+enum {
+    SLAVE_LOG_FORMATS(DLOG_ID_ENTRY)
+    LOG_ID_COUNT
+};
+
+#endif
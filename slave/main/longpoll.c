@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "lwip/sockets.h"
+#include "channels.h"
+#include "http_server.h"
+#include "longpoll.h"
+
+#define LONGPOLL_ENTRY_MAX 20           // "[65535,4294967295,1],"
+#define LONGPOLL_BODY_MAX 48            // "{\"version\":...,\"up\":...,\"ch\":[" and "]}"
+
+static const char *TAG = "longpoll";
+
+typedef struct {
+    int fd;
+    uint32_t since;
+    int64_t deadline_us;
+} waiter_t;
+
+// Everything but longpoll_post() and longpoll_get_stats() runs in the HTTP server task
+static struct {
+    uint16_t count;
+    persist_snapshot_fn_t snapshot;
+    int64_t *totals;
+    uint32_t *running;
+    char *buf;
+    waiter_t waiters[CONFIG_SLAVE_LONGPOLL_MAX_WAITERS];
+    int parked;
+} lp;
+
+static bool queued;                 // under lock
+static longpoll_stats_t stats;      // under lock, including the version
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t longpoll_version(void) {
+    taskENTER_CRITICAL(&lock);
+    const uint32_t v = stats.version;
+    taskEXIT_CRITICAL(&lock);
+    return v;
+}
+
+static char *put_str(char *p, const char *s) {
+    const size_t len = strlen(s);
+    memcpy(p, s, len);
+    return p + len;
+}
+
+static char *put_u32(char *p, uint32_t v) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+// The answer body into lp.buf, returns its length
+static size_t serialize(uint32_t version) {
+    lp.snapshot(lp.totals, lp.running);
+    char *p = lp.buf;
+    p = put_str(p, "{\"version\":");
+    p = put_u32(p, version);
+    p = put_str(p, ",\"up\":");
+    p = put_u32(p, esp_timer_get_time() / 1000000);
+    p = put_str(p, ",\"ch\":[");
+    for (uint16_t ch = 0; ch < lp.count; ch++) {
+        if (ch) {
+            *p++ = ',';
+        }
+        *p++ = '[';
+        p = put_u32(p, ch);
+        *p++ = ',';
+        p = put_u32(p, lp.totals[ch] / 1000000);
+        p = put_str(p, lp.running[ch / 32] & 1u << (ch % 32) ? ",1]" : ",0]");
+    }
+    p = put_str(p, "]}");
+    return p - lp.buf;
+}
+
+static void remove_waiter(int i) {
+    lp.waiters[i] = lp.waiters[--lp.parked];
+    taskENTER_CRITICAL(&lock);
+    stats.parked = lp.parked;
+    taskEXIT_CRITICAL(&lock);
+}
+
+// Session free callback: a parked client gave up. remove_waiter() moves the
+// last waiter into the hole, so look at the same slot again
+static void unpark(void *ctx) {
+    const int fd = (intptr_t)ctx - 1;
+    for (int i = 0; i < lp.parked;) {
+        if (lp.waiters[i].fd == fd) {
+            remove_waiter(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+// A complete response written past the server, which has finished with the request
+static bool answer(int fd, const char *body, size_t len) {
+    char header[128];
+    const int n = snprintf(header, sizeof(header),
+                           "HTTP/1.1 200 OK\r\n"
+                           "Content-Type: application/json\r\n"
+                           "Cache-Control: no-cache\r\n"
+                           "Content-Length: %u\r\n"
+                           "\r\n", (unsigned)len);
+    return send(fd, header, n, MSG_DONTWAIT) == n && send(fd, body, len, MSG_DONTWAIT) == (ssize_t)len;
+}
+
+static void wake(void *arg) {
+    taskENTER_CRITICAL(&lock);
+    queued = false;
+    const uint32_t version = stats.version;
+    taskEXIT_CRITICAL(&lock);
+    const int64_t now = esp_timer_get_time();
+    size_t len = 0;
+    uint32_t woken = 0, timeouts = 0, dropped = 0;
+    for (int i = 0; i < lp.parked;) {
+        const waiter_t w = lp.waiters[i];
+        const bool changed = w.since != version;
+        if (!changed && now < w.deadline_us) {
+            i++;
+            continue;
+        }
+        if (len == 0) {
+            len = serialize(version);
+        }
+        remove_waiter(i);
+        if (!answer(w.fd, lp.buf, len)) {
+            httpd_sess_trigger_close(http_server_handle(), w.fd);
+            dropped++;
+        } else if (changed) {
+            woken++;
+        } else {
+            timeouts++;
+        }
+    }
+    taskENTER_CRITICAL(&lock);
+    stats.woken += woken;
+    stats.timeouts += timeouts;
+    stats.dropped += dropped;
+    taskEXIT_CRITICAL(&lock);
+}
+
+// GET /wait?since=<version>
+static esp_err_t wait_handler(httpd_req_t *req) {
+    char query[32];
+    char value[12];
+    const uint32_t version = longpoll_version();
+    bool parked = false;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+        parked = strtoul(value, NULL, 10) == version;
+    }
+    if (!parked) {
+        taskENTER_CRITICAL(&lock);
+        stats.immediate++;
+        taskEXIT_CRITICAL(&lock);
+        const size_t len = serialize(version);
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        return httpd_resp_send(req, lp.buf, len);
+    }
+    if (lp.parked == CONFIG_SLAVE_LONGPOLL_MAX_WAITERS) {
+        taskENTER_CRITICAL(&lock);
+        stats.rejected++;
+        taskEXIT_CRITICAL(&lock);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, "Too many waiters", HTTPD_RESP_USE_STRLEN);
+    }
+    const int fd = httpd_req_to_sockfd(req);
+    lp.waiters[lp.parked++] = (waiter_t) {
+        .fd = fd,
+        .since = version,
+        .deadline_us = esp_timer_get_time() + CONFIG_SLAVE_LONGPOLL_TIMEOUT_S * 1000000LL,
+    };
+    // The session outlives this request; keep-alive clients park on it again
+    if (req->sess_ctx == NULL) {
+        req->sess_ctx = (void *)(intptr_t)(fd + 1);
+        req->free_ctx = unpark;
+    }
+    taskENTER_CRITICAL(&lock);
+    stats.parked = lp.parked;
+    const bool moved = stats.version != version;
+    taskEXIT_CRITICAL(&lock);
+    // A change posted while there was no one to wake
+    if (moved) {
+        longpoll_post(false);
+    }
+    return ESP_OK;
+}
+
+esp_err_t longpoll_init(uint16_t count, persist_snapshot_fn_t snapshot) {
+    lp.count = count;
+    lp.snapshot = snapshot;
+    lp.totals = calloc(count, sizeof(int64_t));
+    lp.running = calloc(CHANNELS_WORDS(count), sizeof(uint32_t));
+    lp.buf = malloc(LONGPOLL_BODY_MAX + (size_t)count * LONGPOLL_ENTRY_MAX);
+    if (lp.totals == NULL || lp.running == NULL || lp.buf == NULL) {
+        ESP_LOGE(TAG, "no memory for %u channels", count);
+        return ESP_ERR_NO_MEM;
+    }
+    stats.version = esp_random();
+    return ESP_OK;
+}
+
+esp_err_t longpoll_register(httpd_handle_t server) {
+    const httpd_uri_t uri = {
+        .uri = LONGPOLL_URI,
+        .method = HTTP_GET,
+        .handler = wait_handler,
+        .user_ctx = NULL
+    };
+    const esp_err_t err = httpd_register_uri_handler(server, &uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s not registered: %s", uri.uri, esp_err_to_name(err));
+    }
+    return err;
+}
+
+void longpoll_post(bool changed) {
+    httpd_handle_t server = http_server_handle();
+    taskENTER_CRITICAL(&lock);
+    if (changed) {
+        stats.version++;
+    }
+    // Nothing to wake until someone waits
+    const bool wanted = server != NULL && stats.parked > 0 && !queued;
+    queued |= wanted;
+    taskEXIT_CRITICAL(&lock);
+    if (wanted && httpd_queue_work(server, wake, NULL) != ESP_OK) {
+        taskENTER_CRITICAL(&lock);
+        queued = false;
+        taskEXIT_CRITICAL(&lock);
+    }
+}
+
+void longpoll_get_stats(longpoll_stats_t *out) {
+    taskENTER_CRITICAL(&lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&lock);
+}
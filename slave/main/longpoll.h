@@ -0,0 +1,54 @@
+#ifndef LONGPOLL_H_
+#define LONGPOLL_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "persist_task.h"
+
+/* Change notification by long polling: GET /wait?since=<version>.
+ *
+ * The version changes on every start, stop and reset of a channel and
+ * starts from a random value at boot, so a version from before a reboot
+ * never matches. If since differs from the current version the request is
+ * answered at once; otherwise it is parked until the next change or
+ * CONFIG_SLAVE_LONGPOLL_TIMEOUT_S. Either way the answer is
+ *
+ *   {"version":N,"up":S,"ch":[[channel,total seconds,running],...]}
+ *
+ * and the client asks again with since=N. Running channels count on in
+ * between at one second per second, so a client can show live values
+ * while making one request per change or per timeout.
+ *
+ * A parked request holds its session but not the server task: the handler
+ * returns without a response and the answer is written to the socket later
+ * from a work item on the server task, one serialization shared by all
+ * waiters woken together. A waiter whose socket cannot take the whole
+ * answer is closed. */
+#define LONGPOLL_URI "/wait"
+
+typedef struct {
+    uint32_t version;
+    uint32_t parked;            // waiting now
+    uint32_t immediate;         // answered at once, the version had moved
+    uint32_t woken;             // answered on a change
+    uint32_t timeouts;          // answered on the timeout
+    uint32_t rejected;          // turned away at CONFIG_SLAVE_LONGPOLL_MAX_WAITERS
+    uint32_t dropped;           // closed on a failed or partial write
+} longpoll_stats_t;
+
+esp_err_t longpoll_init(uint16_t count, persist_snapshot_fn_t snapshot);
+
+/* Register LONGPOLL_URI on a started server. */
+esp_err_t longpoll_register(httpd_handle_t server);
+
+/* Wake the waiters, with a new version if changed. Called with false on
+ * every tick to expire timeouts. Never blocks. */
+void longpoll_post(bool changed);
+
+/* Current version, as /wait would report it. */
+uint32_t longpoll_version(void);
+
+void longpoll_get_stats(longpoll_stats_t *out);
+
+#endif
@@ -0,0 +1,243 @@
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "uart_link.h"
+#include "persist.h"
+#include "persist_task.h"
+#include "history.h"
+#include "history_export.h"
+#include "rollup.h"
+#include "http_server.h"
+#include "live.h"
+#include "longpoll.h"
+#include "wifi_fast.h"
+#include "metrics.h"
+
+static const char *TAG = "metrics";
+
+// Tasks whose stack headroom is reported, when they exist
+static const char *const tasks[] = {
+    "uart_rx_task", "persist_task", "rollup_task", "history_task", "powerfail_task",
+    "telemetry_task", "dlog_drain", "httpd", "tiT", "Tmr Svc",
+};
+
+static metrics_collect_fn_t app_collect;
+
+void metrics_family(chunk_writer_t *w, const char *name, const char *type, const char *help) {
+    chunk_put_str(w, "# HELP ");
+    chunk_put_str(w, name);
+    chunk_put(w, " ", 1);
+    chunk_put_str(w, help);
+    chunk_put_str(w, "\n# TYPE ");
+    chunk_put_str(w, name);
+    chunk_put(w, " ", 1);
+    chunk_put_str(w, type);
+    chunk_put(w, "\n", 1);
+}
+
+static void sample_name(chunk_writer_t *w, const char *name, const char *labels) {
+    chunk_put_str(w, name);
+    if (labels) {
+        chunk_put(w, "{", 1);
+        chunk_put_str(w, labels);
+        chunk_put(w, "}", 1);
+    }
+    chunk_put(w, " ", 1);
+}
+
+void metrics_sample(chunk_writer_t *w, const char *name, const char *labels, int64_t value) {
+    sample_name(w, name, labels);
+    chunk_put_int(w, value);
+    chunk_put(w, "\n", 1);
+}
+
+void metrics_sample_us(chunk_writer_t *w, const char *name, const char *labels, int64_t us) {
+    sample_name(w, name, labels);
+    chunk_put_us_as_seconds(w, us);
+    chunk_put(w, "\n", 1);
+}
+
+void metrics_sample_n(chunk_writer_t *w, const char *name, const char *label, uint32_t n, int64_t value) {
+    chunk_put_str(w, name);
+    chunk_put(w, "{", 1);
+    chunk_put_str(w, label);
+    chunk_put_str(w, "=\"");
+    chunk_put_int(w, n);
+    chunk_put_str(w, "\"} ");
+    chunk_put_int(w, value);
+    chunk_put(w, "\n", 1);
+}
+
+// A counter or gauge family with a single unlabelled sample
+static void single(chunk_writer_t *w, const char *name, const char *type, const char *help, int64_t value) {
+    metrics_family(w, name, type, help);
+    metrics_sample(w, name, NULL, value);
+}
+
+static void collect_system(chunk_writer_t *w) {
+    single(w, "slave_uptime_seconds", "gauge", "Time since boot.", esp_timer_get_time() / 1000000);
+    single(w, "slave_heap_free_bytes", "gauge", "Free heap now.", esp_get_free_heap_size());
+    single(w, "slave_heap_min_free_bytes", "gauge", "Lowest free heap since boot.",
+           esp_get_minimum_free_heap_size());
+    metrics_family(w, "slave_task_stack_free_bytes", "gauge", "Lowest unused stack of a task since it started.");
+    for (size_t i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++) {
+        TaskHandle_t task = xTaskGetHandle(tasks[i]);
+        if (task != NULL) {
+            chunk_put_str(w, "slave_task_stack_free_bytes{task=\"");
+            chunk_put_str(w, tasks[i]);
+            chunk_put_str(w, "\"} ");
+            chunk_put_int(w, uxTaskGetStackHighWaterMark(task));
+            chunk_put(w, "\n", 1);
+        }
+    }
+}
+
+static void collect_uart(chunk_writer_t *w) {
+    static const struct {
+        const char *name;
+        const char *help;
+        size_t offset;
+    } fields[] = {
+        { "slave_uart_rx_bytes_total", "Bytes received.", offsetof(uart_link_stats_t, rx_bytes) },
+        { "slave_uart_tx_bytes_total", "Bytes sent.", offsetof(uart_link_stats_t, tx_bytes) },
+        { "slave_uart_frames_total", "Binary frames received with a valid CRC.", offsetof(uart_link_stats_t, frames) },
+        { "slave_uart_commands_total", "Commands accepted.", offsetof(uart_link_stats_t, commands) },
+        { "slave_uart_rejected_total", "Commands rejected or frames failing the CRC.", offsetof(uart_link_stats_t, unknown) },
+        { "slave_uart_frame_errors_total", "UART framing and parity errors.", offsetof(uart_link_stats_t, frame_errors) },
+        { "slave_uart_overflows_total", "FIFO or buffer overflows and over-long commands.", offsetof(uart_link_stats_t, overflows) },
+    };
+    uart_link_stats_t ports[UART_LINK_MAX_PORTS];
+    const int count = uart_link_port_count();
+    for (int p = 0; p < count; p++) {
+        uart_link_get_stats(p, &ports[p]);
+    }
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+        metrics_family(w, fields[f].name, "counter", fields[f].help);
+        for (int p = 0; p < count; p++) {
+            const uint32_t *v = (const uint32_t *)((const uint8_t *)&ports[p] + fields[f].offset);
+            metrics_sample_n(w, fields[f].name, "port", p, *v);
+        }
+    }
+}
+
+static void collect_persist(chunk_writer_t *w) {
+    persist_stats_t ps;
+    persist_task_stats_t ts;
+    persist_get_stats(&ps);
+    persist_task_get_stats(&ts);
+    single(w, "slave_persist_writes_total", "counter", "Checkpoints saved.", ps.writes);
+    single(w, "slave_persist_errors_total", "counter", "Checkpoints that failed to save.", ps.errors);
+    single(w, "slave_persist_entries_total", "counter", "NVS entries or journal records written.", ps.entries);
+    single(w, "slave_persist_posts_total", "counter", "Snapshots posted to the persistence task.", ts.posts);
+    single(w, "slave_persist_coalesced_total", "counter", "Posts replaced before the task took them.",
+           ts.coalesced);
+    // The log2 buckets of the task's histogram, made cumulative. Bucket i
+    // ends below 2^(i+1) us, which for whole microseconds is le 2^(i+1)-1,
+    // written in seconds. The last bucket is open-ended and only counts
+    // towards +Inf.
+    metrics_family(w, "slave_persist_write_duration_seconds", "histogram", "Time to save a checkpoint.");
+    uint64_t count = 0;
+    for (int i = 0; i < PERSIST_HIST_BUCKETS - 1; i++) {
+        count += ts.write_us[i];
+        chunk_put_str(w, "slave_persist_write_duration_seconds_bucket{le=\"");
+        chunk_put_us_as_seconds(w, (2u << i) - 1);
+        chunk_put_str(w, "\"} ");
+        chunk_put_int(w, count);
+        chunk_put(w, "\n", 1);
+    }
+    count += ts.write_us[PERSIST_HIST_BUCKETS - 1];
+    metrics_sample(w, "slave_persist_write_duration_seconds_bucket", "le=\"+Inf\"", count);
+    metrics_sample_us(w, "slave_persist_write_duration_seconds_sum", NULL, ts.write_us_total);
+    metrics_sample(w, "slave_persist_write_duration_seconds_count", NULL, count);
+
+    history_stats_t hs;
+    history_get_stats(&hs);
+    single(w, "slave_history_written_total", "counter", "Run history events written.", hs.written);
+    single(w, "slave_history_dropped_total", "counter", "Run history events lost.", hs.dropped);
+    history_export_stats_t es;
+    history_export_get_stats(&es);
+    single(w, "slave_history_exports_total", "counter", "Completed history exports.", es.exports);
+    single(w, "slave_history_export_bytes_total", "counter", "Bytes sent by history exports.", es.bytes);
+    single(w, "slave_history_export_seconds_total", "counter", "Time spent in history exports.",
+           es.us / 1000000);
+    single(w, "slave_history_export_last_bytes_per_second", "gauge", "Throughput of the last export.",
+           es.last_bytes_per_s);
+    rollup_stats_t rs;
+    rollup_get_stats(&rs);
+    metrics_family(w, "slave_rollup_records_total", "counter", "Rollup records written per level.");
+    for (rollup_level_t l = 0; l < ROLLUP_LEVELS; l++) {
+        char labels[24] = "level=\"";
+        strcat(labels, rollup_level_name(l));
+        strcat(labels, "\"");
+        metrics_sample(w, "slave_rollup_records_total", labels, rs.records[l]);
+    }
+    single(w, "slave_rollup_errors_total", "counter", "Rollup records that failed to write.", rs.errors);
+}
+
+static void collect_network(chunk_writer_t *w) {
+    wifi_fast_status_t ws;
+    wifi_fast_get_status(&ws);
+    single(w, "slave_wifi_connected", "gauge", "1 while the station has an address.", ws.connected);
+    single(w, "slave_wifi_connects_total", "counter", "Connections that reached an address.", ws.connects);
+    metrics_family(w, "slave_wifi_last_connect_seconds", "gauge", "Attempt start to address, last connection.");
+    metrics_sample_us(w, "slave_wifi_last_connect_seconds", NULL, ws.ip_us);
+    http_server_stats_t hs;
+    http_server_get_stats(&hs);
+    single(w, "slave_http_starts_total", "counter", "HTTP server starts.", hs.starts);
+    single(w, "slave_http_ip_changes_total", "counter", "Address changes seen by the HTTP server.",
+           hs.ip_changes);
+    single(w, "slave_http_sessions_closed_total", "counter", "Sessions closed on address changes.",
+           hs.sessions_closed);
+    live_stats_t vs;
+    live_get_stats(&vs);
+    metrics_family(w, "slave_live_subscribers", "gauge", "Connected live update subscribers.");
+    metrics_sample(w, "slave_live_subscribers", "transport=\"sse\"", vs.subscribers - vs.ws_subscribers);
+    metrics_sample(w, "slave_live_subscribers", "transport=\"ws\"", vs.ws_subscribers);
+    single(w, "slave_live_broadcasts_total", "counter", "Live updates broadcast.", vs.broadcasts);
+    single(w, "slave_live_dropped_total", "counter", "Subscribers closed on a failed write.", vs.dropped);
+    metrics_family(w, "slave_live_ws_commands_total", "counter", "WebSocket commands by outcome.");
+    metrics_sample(w, "slave_live_ws_commands_total", "result=\"applied\"", vs.ws_commands);
+    metrics_sample(w, "slave_live_ws_commands_total", "result=\"rejected\"", vs.ws_rejected);
+    longpoll_stats_t ls;
+    longpoll_get_stats(&ls);
+    single(w, "slave_longpoll_parked", "gauge", "Requests waiting on /wait.", ls.parked);
+    metrics_family(w, "slave_longpoll_answers_total", "counter", "/wait answers by cause.");
+    metrics_sample(w, "slave_longpoll_answers_total", "cause=\"immediate\"", ls.immediate);
+    metrics_sample(w, "slave_longpoll_answers_total", "cause=\"change\"", ls.woken);
+    metrics_sample(w, "slave_longpoll_answers_total", "cause=\"timeout\"", ls.timeouts);
+}
+
+// GET /metrics
+static esp_err_t metrics_handler(httpd_req_t *req) {
+    // Handlers run one at a time in the server task
+    static chunk_writer_t w;
+    chunk_writer_init(&w, req);
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    collect_system(&w);
+    collect_uart(&w);
+    collect_persist(&w);
+    collect_network(&w);
+    if (app_collect) {
+        app_collect(&w);
+    }
+    return chunk_writer_end(&w);
+}
+
+esp_err_t metrics_register(httpd_handle_t server, metrics_collect_fn_t collect) {
+    app_collect = collect;
+    const httpd_uri_t uri = {
+        .uri = METRICS_URI,
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+        .user_ctx = NULL
+    };
+    const esp_err_t err = httpd_register_uri_handler(server, &uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "%s not registered: %s", uri.uri, esp_err_to_name(err));
+    }
+    return err;
+}
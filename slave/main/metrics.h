@@ -0,0 +1,38 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "chunk_writer.h"
+
+/* Prometheus text exposition on GET /metrics.
+ *
+ * The response is rendered through a chunk writer, so a scrape costs the
+ * same memory for 1 or 256 channels and nothing is allocated. The module
+ * stats (UART, persistence, history, rollups, HTTP, Wi-Fi, heap, task
+ * stacks) are collected here; the application adds its own families
+ * through the collect callback. Durations are kept in microseconds and
+ * exposed in seconds, the Prometheus base unit, with metrics_sample_us(). */
+#define METRICS_URI "/metrics"
+
+/* HELP and TYPE lines; type is "counter", "gauge" or "histogram". */
+void metrics_family(chunk_writer_t *w, const char *name, const char *type, const char *help);
+
+/* One sample. labels is NULL or the text between the braces, e.g.
+ * "port=\"0\"". */
+void metrics_sample(chunk_writer_t *w, const char *name, const char *labels, int64_t value);
+
+/* Same with one numeric label, e.g. name{channel="3"}. */
+void metrics_sample_n(chunk_writer_t *w, const char *name, const char *label, uint32_t n, int64_t value);
+
+/* One sample of a duration in microseconds, written in seconds. */
+void metrics_sample_us(chunk_writer_t *w, const char *name, const char *labels, int64_t us);
+
+typedef void (*metrics_collect_fn_t)(chunk_writer_t *w);
+
+/* Register METRICS_URI on a started server; collect is called on every
+ * scrape after the built-in families. */
+esp_err_t metrics_register(httpd_handle_t server, metrics_collect_fn_t collect);
+
+#endif
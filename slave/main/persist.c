@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "link_proto.h"
+#include "journal.h"
+#include "channels.h"
+#include "persist.h"
+
+// NVS stores entries of 32 bytes; a blob is an index entry plus a data chunk
+// made of a header entry and its data entries
+#define NVS_ENTRY_SIZE 32
+#define BLOB_ENTRIES(len) (2 + ((len) + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE)
+
+// NVS blob: version, channel count, totals, CRC-32
+#define BLOB_LEN(count) (4 + 8 * (count) + 4)
+// Journal record payload: version, channel, total (the journal adds the CRC)
+#define JOURNAL_PAYLOAD_LEN (PERSIST_RECORD_LEN - JOURNAL_CRC_SIZE)
+// Records packed per journal_append_many() call, one 256-byte program
+#define JOURNAL_CHUNK 16
+
+static const char *TAG = "persist";
+
+static const char *legacy_keys[] = { "seconds", "minutes", "hours", "days" };
+
+static persist_stats_t stats;
+
+#if CONFIG_SLAVE_PERSIST_JOURNAL
+static journal_t journal;
+static bool journal_mounted;
+#endif
+
+static uint8_t blob[BLOB_LEN(PERSIST_MAX_CHANNELS)];
+
+static void put_u64(uint8_t *p, int64_t v) {
+    link_put_u32(&p[0], (uint64_t)v);
+    link_put_u32(&p[4], (uint64_t)v >> 32);
+}
+
+static int64_t get_u64(const uint8_t *p) {
+    return (int64_t)((uint64_t)link_get_u32(&p[0]) | (uint64_t)link_get_u32(&p[4]) << 32);
+}
+
+/* Version 1 (single counter) is a 16-byte record: version, flags, total,
+ * CRC. It is what older firmware left in NVS and in the journal, and it
+ * always means channel 0. */
+static esp_err_t unpack_v1(const uint8_t *in, size_t len, int64_t *totals) {
+    if (len != 16 || link_get_u32(&in[12]) != esp_rom_crc32_le(0, in, 12)) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    totals[0] = get_u64(&in[4]);
+    return ESP_OK;
+}
+
+static size_t pack_blob(const int64_t *totals, uint16_t count) {
+    link_put_u16(&blob[0], PERSIST_RECORD_VERSION);
+    link_put_u16(&blob[2], count);
+    for (uint16_t ch = 0; ch < count; ch++) {
+        put_u64(&blob[4 + 8 * ch], totals[ch]);
+    }
+    link_put_u32(&blob[BLOB_LEN(count) - 4], esp_rom_crc32_le(0, blob, BLOB_LEN(count) - 4));
+    return BLOB_LEN(count);
+}
+
+// Channels missing from the record (it was saved with fewer) stay at 0;
+// channels past count (it was saved by firmware with more) are dropped
+static esp_err_t unpack_blob(const uint8_t *in, size_t len, int64_t *totals, uint16_t count) {
+    if (len < 4) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint16_t version = link_get_u16(&in[0]);
+    if (version == 1) {
+        return unpack_v1(in, len, totals);
+    }
+    if (version != PERSIST_RECORD_VERSION) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    const uint16_t stored = link_get_u16(&in[2]);
+    if (len != BLOB_LEN(stored) || link_get_u32(&in[len - 4]) != esp_rom_crc32_le(0, in, len - 4)) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    for (uint16_t ch = 0; ch < stored && ch < count; ch++) {
+        totals[ch] = get_u64(&in[4 + 8 * ch]);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t load_legacy(nvs_handle_t h, int64_t *total_us) {
+    int32_t v[4];
+    for (int i = 0; i < 4; i++) {
+        esp_err_t err = nvs_get_i32(h, legacy_keys[i], &v[i]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    *total_us = (((int64_t)v[3] * 24 + v[2]) * 3600 + (int64_t)v[1] * 60 + v[0]) * 1000000;
+    return ESP_OK;
+}
+
+static esp_err_t write_blob(nvs_handle_t h, const int64_t *totals, uint16_t count) {
+    const size_t len = pack_blob(totals, count);
+    esp_err_t err = nvs_set_blob(h, PERSIST_KEY, blob, len);
+    if (err == ESP_OK) {
+        err = nvs_commit(h);
+    }
+    if (err == ESP_OK) {
+        stats.writes++;
+        stats.entries += BLOB_ENTRIES(len);
+    } else {
+        stats.errors++;
+    }
+    return err;
+}
+
+static esp_err_t load_nvs(int64_t *totals, uint16_t count) {
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(PERSIST_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Firmware built with more channels leaves a record longer than blob
+    size_t len = 0;
+    err = nvs_get_blob(h, PERSIST_KEY, NULL, &len);
+    if (err == ESP_OK) {
+        uint8_t *in = len > sizeof(blob) ? malloc(len) : blob;
+        err = in ? nvs_get_blob(h, PERSIST_KEY, in, &len) : ESP_ERR_NO_MEM;
+        if (err == ESP_OK) {
+            err = unpack_blob(in, len, totals, count);
+        }
+        if (in != blob) {
+            free(in);
+        }
+        if (err == ESP_OK) {
+            nvs_close(h);
+            return ESP_OK;
+        }
+        ESP_LOGE(TAG, "stored record unusable: %s", esp_err_to_name(err));
+    }
+
+    // No usable record: migrate the four-key layout of older firmware
+    int64_t legacy_us;
+    if (load_legacy(h, &legacy_us) == ESP_OK) {
+        totals[0] = legacy_us;
+        err = write_blob(h, totals, count);
+        if (err == ESP_OK) {
+            for (int i = 0; i < 4; i++) {
+                nvs_erase_key(h, legacy_keys[i]);
+            }
+            err = nvs_commit(h);
+            ESP_LOGI(TAG, "migrated legacy keys, total %lld s", (long long)(legacy_us / 1000000));
+        }
+    }
+    nvs_close(h);
+    return err;
+}
+
+static esp_err_t save_nvs(const int64_t *totals, uint16_t count) {
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(PERSIST_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) {
+        stats.errors++;
+        return err;
+    }
+    err = write_blob(h, totals, count);
+    nvs_close(h);
+    return err;
+}
+
+#if CONFIG_SLAVE_PERSIST_JOURNAL || CONFIG_SLAVE_CHANNELS_BENCHMARK
+// One record per channel, in channel order, 16 records per flash program
+static esp_err_t append_batch(journal_t *j, const int64_t *totals, uint16_t count) {
+    uint8_t buf[JOURNAL_CHUNK * JOURNAL_PAYLOAD_LEN];
+    for (uint16_t first = 0; first < count; first += JOURNAL_CHUNK) {
+        const uint16_t n = count - first < JOURNAL_CHUNK ? count - first : JOURNAL_CHUNK;
+        for (uint16_t i = 0; i < n; i++) {
+            uint8_t *p = &buf[i * JOURNAL_PAYLOAD_LEN];
+            link_put_u16(&p[0], PERSIST_RECORD_VERSION);
+            link_put_u16(&p[2], first + i);
+            put_u64(&p[4], totals[first + i]);
+        }
+        esp_err_t err = journal_append_many(j, buf, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+#endif
+
+#if CONFIG_SLAVE_PERSIST_JOURNAL
+/* The newest batch is the last count records. Walking back up to two
+ * batches (plus a few torn slots) finds every channel even when the last
+ * batch was cut short; channels not seen (e.g. only version 1 records
+ * exist) stay at 0. */
+static bool load_journal(int64_t *totals, uint16_t count) {
+    uint32_t found[CHANNELS_WORDS(PERSIST_MAX_CHANNELS)] = { 0 };
+    uint16_t missing = count;
+    const uint32_t first = journal_first_index(&journal);
+    const uint32_t span = 2u * count + 4;
+    uint32_t index = journal_end_index(&journal);
+    const uint32_t stop = index - first > span ? index - span : first;
+    bool any = false;
+    uint8_t rec[JOURNAL_PAYLOAD_LEN];
+    while (missing > 0 && index > stop) {
+        if (journal_read(&journal, --index, rec) != ESP_OK) {
+            continue;
+        }
+        uint16_t ch;
+        const uint16_t version = link_get_u16(&rec[0]);
+        if (version == PERSIST_RECORD_VERSION) {
+            ch = link_get_u16(&rec[2]);
+        } else if (version == 1) {
+            ch = 0;
+        } else {
+            continue;
+        }
+        any = true;
+        if (ch < count && !(found[ch / 32] & 1u << (ch % 32))) {
+            found[ch / 32] |= 1u << (ch % 32);
+            totals[ch] = get_u64(&rec[4]);
+            missing--;
+        }
+    }
+    return any;
+}
+
+esp_err_t persist_load(int64_t *totals, uint16_t count) {
+    memset(totals, 0, count * sizeof(totals[0]));
+    journal_flash_t flash;
+    esp_err_t err = journal_partition_init(&flash, PERSIST_PARTITION);
+    if (err == ESP_OK) {
+        const int64_t start = esp_timer_get_time();
+        err = journal_mount(&journal, &flash, PERSIST_RECORD_LEN);
+        ESP_LOGI(TAG, "journal mounted in %lld us: %lu reads, %u sectors, record %lu",
+                 (long long)(esp_timer_get_time() - start), (unsigned long)journal.stats.mount_reads,
+                 journal.sectors, (unsigned long)journal_end_index(&journal));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "journal partition \"%s\" unusable: %s", PERSIST_PARTITION, esp_err_to_name(err));
+        return err;
+    }
+    journal_mounted = true;
+
+    if (load_journal(totals, count)) {
+        return ESP_OK;
+    }
+    // Empty journal: carry over what earlier firmware left in NVS
+    err = load_nvs(totals, count);
+    if (err == ESP_OK) {
+        err = persist_save(totals, count);
+    }
+    return err;
+}
+
+esp_err_t persist_save(const int64_t *totals, uint16_t count) {
+    if (!journal_mounted) {
+        stats.errors++;
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = append_batch(&journal, totals, count);
+    if (err == ESP_OK) {
+        stats.writes++;
+        stats.entries += count;
+    } else {
+        stats.errors++;
+    }
+    return err;
+}
+#else
+esp_err_t persist_load(int64_t *totals, uint16_t count) {
+    memset(totals, 0, count * sizeof(totals[0]));
+    return load_nvs(totals, count);
+}
+
+esp_err_t persist_save(const int64_t *totals, uint16_t count) {
+    return save_nvs(totals, count);
+}
+#endif
+
+void persist_get_stats(persist_stats_t *out) {
+    *out = stats;
+}
+
+int persist_entries_per_save(uint16_t count) {
+#if CONFIG_SLAVE_PERSIST_JOURNAL
+    return count;
+#else
+    return BLOB_ENTRIES(BLOB_LEN(count));
+#endif
+}
+
+int persist_legacy_entries_per_save(void) {
+    return sizeof(legacy_keys) / sizeof(legacy_keys[0]);
+}
+
+#if CONFIG_SLAVE_CHANNELS_BENCHMARK
+#include <stdlib.h>
+
+#define BENCH_ROUNDS 100
+#define BENCH_BATCHES 10
+
+void persist_benchmark(void) {
+    static const char *BENCH_TAG = "channels_bench";
+    static const uint16_t counts[] = { 1, 16, 64, 256, 512 };
+    journal_flash_t ram;
+    if (journal_ram_init(&ram, 64 * 1024, 4096) != ESP_OK) {
+        ESP_LOGE(BENCH_TAG, "no memory for the emulated partition");
+        return;
+    }
+    for (int k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+        const uint16_t n = counts[k];
+        channels_t c;
+        int64_t *totals = malloc(n * sizeof(int64_t));
+        uint32_t *running = malloc(CHANNELS_WORDS(n) * sizeof(uint32_t));
+        if (totals == NULL || running == NULL || channels_init(&c, n) != ESP_OK) {
+            free(totals);
+            free(running);
+            ESP_LOGE(BENCH_TAG, "no memory for %u channels", n);
+            break;
+        }
+        for (uint16_t ch = 0; ch < n; ch += 2) {
+            channels_start(&c, ch, 0);
+        }
+
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < BENCH_ROUNDS; i++) {
+            channels_snapshot(&c, esp_timer_get_time(), totals, running);
+        }
+        const int64_t tick_us = (esp_timer_get_time() - start) / BENCH_ROUNDS;
+
+        journal_t j;
+        journal_mount(&j, &ram, PERSIST_RECORD_LEN);
+        const uint32_t programs = j.stats.writes;
+        start = esp_timer_get_time();
+        for (int i = 0; i < BENCH_BATCHES; i++) {
+            append_batch(&j, totals, n);
+        }
+        const int64_t batch_us = (esp_timer_get_time() - start) / BENCH_BATCHES;
+
+        ESP_LOGI(BENCH_TAG, "%3u channels: snapshot %lld us, batch %lld us (RAM), %lu programs, %u bytes, NVS blob %d entries",
+                 n, (long long)tick_us, (long long)batch_us,
+                 (unsigned long)(j.stats.writes - programs) / BENCH_BATCHES, n * PERSIST_RECORD_LEN,
+                 BLOB_ENTRIES(BLOB_LEN(n)));
+        channels_free(&c);
+        free(totals);
+        free(running);
+    }
+    journal_ram_free(&ram);
+}
+#endif
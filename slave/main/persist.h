@@ -0,0 +1,54 @@
+#ifndef PERSIST_H_
+#define PERSIST_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+/* Persistent copy of the run counters.
+ *
+ * NVS holds every channel in one versioned blob (version, channel count,
+ * 64-bit totals in microseconds, CRC-32), so one nvs_set_blob + nvs_commit
+ * saves a consistent batch. Version 1 blobs from single-counter firmware
+ * load as channel 0, and the older "seconds"/"minutes"/"hours"/"days" keys
+ * are migrated on first boot and then erased.
+ *
+ * With CONFIG_SLAVE_PERSIST_JOURNAL each save appends one 16-byte record
+ * per channel (version, channel, total; the journal adds the CRC) to the
+ * "journal" partition, 16 records per flash program. Loading walks back at
+ * most two batches. Version 1 journal records count as channel 0, and NVS
+ * is only read once to seed an empty journal. */
+#define PERSIST_NAMESPACE "storage"
+#define PERSIST_KEY "timer"
+#define PERSIST_RECORD_VERSION 2
+#define PERSIST_RECORD_LEN 16
+#define PERSIST_PARTITION "journal"
+#define PERSIST_MAX_CHANNELS CONFIG_SLAVE_CHANNEL_COUNT
+
+typedef struct {
+    uint32_t writes;            // successful saves
+    uint32_t errors;            // failed saves
+    uint32_t entries;           // NVS entries or journal records written, for wear estimates
+} persist_stats_t;
+
+/* Read the stored totals of count channels (at most PERSIST_MAX_CHANNELS),
+ * migrating older layouts if needed. Channels with nothing stored read 0,
+ * as does everything when an error is returned; channels stored by firmware
+ * built with more are ignored. */
+esp_err_t persist_load(int64_t *totals, uint16_t count);
+
+esp_err_t persist_save(const int64_t *totals, uint16_t count);
+
+void persist_get_stats(persist_stats_t *out);
+
+/* Entries taken by one save of count channels with the configured backend
+ * (NVS entries or journal records), and NVS entries taken by one save of
+ * the legacy four-key layout. */
+int persist_entries_per_save(uint16_t count);
+int persist_legacy_entries_per_save(void);
+
+/* Snapshot and batch-persist cost for growing channel counts, on a RAM
+ * journal. Only built with CONFIG_SLAVE_CHANNELS_BENCHMARK. */
+void persist_benchmark(void);
+
+#endif
@@ -0,0 +1,249 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "persist.h"
+#include "channels.h"
+#include "rtc_state.h"
+#include "persist_task.h"
+
+static const char *TAG = "persist_task";
+
+#define COUNT CONFIG_SLAVE_CHANNEL_COUNT
+#define WORDS CHANNELS_WORDS(CONFIG_SLAVE_CHANNEL_COUNT)
+
+// The counters sealed as an RTC copy, so one snapshot feeds both the RTC
+// memory and the flash write
+typedef struct {
+    rtc_state_t rtc;
+    uint32_t gen;               // post order, to keep the newest
+} snapshot_t;
+
+// One snapshot each for the mailbox, the service task and a post being
+// filled, so posts snapshot and seal outside the lock and only swap
+// pointers under it
+static snapshot_t slots[3];
+
+static struct {
+    snapshot_t *snap;
+    uint32_t gen;               // newest post; snap is older if that post had no spare
+    int64_t posted_us;          // first unserved post, for the latency histogram
+    uint32_t reasons;           // bit per checkpoint_reason_t
+    bool full;
+} mailbox = { .snap = &slots[0] };
+static snapshot_t *spare = &slots[1];   // NULL while a post fills it
+static persist_snapshot_fn_t take_snapshot;
+static portMUX_TYPE mailbox_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t task_handle;
+
+// Orders RTC copies from posts racing on two cores
+static SemaphoreHandle_t rtc_lock;
+static uint32_t rtc_gen;                // under rtc_lock
+
+// Guards the policy state together with the write itself
+static SemaphoreHandle_t write_lock;
+static checkpoint_t checkpoint;
+
+static persist_task_stats_t stats;      // under mailbox_lock
+
+static void hist_add(uint32_t *hist, int64_t us) {
+    int bucket = 0;
+    while (us > 1 && bucket < PERSIST_HIST_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    hist[bucket]++;
+}
+
+static bool any_running(const snapshot_t *s) {
+    for (int w = 0; w < WORDS; w++) {
+        if (s->rtc.running[w]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int64_t sum_totals(const int64_t *totals) {
+    int64_t sum = 0;
+    for (int ch = 0; ch < COUNT; ch++) {
+        sum += totals[ch];
+    }
+    return sum;
+}
+
+// The policy sees all channels as one counter: their summed total, running
+// while any channel runs. Every write saves the whole batch.
+static void write_checkpoint(const snapshot_t *s, checkpoint_reason_t reason) {
+    const int64_t total = sum_totals(s->rtc.totals);
+    const bool running = any_running(s);
+    xSemaphoreTake(write_lock, portMAX_DELAY);
+    const int64_t now = esp_timer_get_time();
+    if (reason == CHECKPOINT_NONE) {
+        reason = checkpoint_due(&checkpoint, now, total, running);
+    } else if (reason == CHECKPOINT_POWERFAIL && total == checkpoint.saved_total_us) {
+        reason = CHECKPOINT_NONE;
+    }
+    if (reason != CHECKPOINT_NONE) {
+        const esp_err_t err = persist_save(s->rtc.totals, COUNT);
+        const int64_t took = esp_timer_get_time() - now;
+        taskENTER_CRITICAL(&mailbox_lock);
+        hist_add(stats.write_us, took);
+        stats.write_us_total += took;
+        taskEXIT_CRITICAL(&mailbox_lock);
+        if (err == ESP_OK) {
+            checkpoint_done(&checkpoint, reason, now, total);
+        } else {
+            ESP_LOGE(TAG, "Counter storage error");
+        }
+    }
+    xSemaphoreGive(write_lock);
+}
+
+// Outside any lock: the seqlock snapshot and the CRC over every channel
+static void fill(snapshot_t *s, uint32_t gen) {
+    take_snapshot(s->rtc.totals, s->rtc.running);
+    rtc_state_seal(&s->rtc, COUNT);
+    s->gen = gen;
+}
+
+// RAM only, so it is refreshed on every post rather than after the flash write
+static void store_rtc(const snapshot_t *s) {
+    xSemaphoreTake(rtc_lock, portMAX_DELAY);
+    if ((int32_t)(s->gen - rtc_gen) > 0) {
+        rtc_state_store(&s->rtc);
+        rtc_gen = s->gen;
+    }
+    xSemaphoreGive(rtc_lock);
+}
+
+// Under mailbox_lock
+static void publish(checkpoint_reason_t reason) {
+    if (mailbox.full) {
+        stats.coalesced++;
+    } else {
+        mailbox.posted_us = esp_timer_get_time();
+    }
+    stats.posts++;
+    mailbox.reasons |= 1u << reason;
+    mailbox.full = true;
+}
+
+static void log_hist(const char *name, const uint32_t *hist) {
+    char line[160];
+    int len = 0;
+    for (int i = 0; i < PERSIST_HIST_BUCKETS && len < sizeof(line); i++) {
+        if (hist[i] && i == PERSIST_HIST_BUCKETS - 1) {
+            len += snprintf(&line[len], sizeof(line) - len, " >=%lu:%lu", 1ul << i, (unsigned long)hist[i]);
+        } else if (hist[i]) {
+            len += snprintf(&line[len], sizeof(line) - len, " <%lu:%lu", 2ul << i, (unsigned long)hist[i]);
+        }
+    }
+    ESP_LOGI(TAG, "%s us%s", name, len ? line : " -");
+}
+
+static void persist_task(void *arg) {
+    // Traded with the mailbox on every pick-up
+    snapshot_t *snap = &slots[2];
+    const TickType_t stats_period = CONFIG_SLAVE_PERSIST_STATS_PERIOD_S > 0
+                                    ? pdMS_TO_TICKS(CONFIG_SLAVE_PERSIST_STATS_PERIOD_S * 1000) : portMAX_DELAY;
+    TickType_t last_stats = xTaskGetTickCount();
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, stats_period);
+
+        taskENTER_CRITICAL(&mailbox_lock);
+        const bool full = mailbox.full;
+        const uint32_t reasons = mailbox.reasons;
+        const uint32_t gen = mailbox.gen;
+        if (full) {
+            snapshot_t *const s = mailbox.snap;
+            mailbox.snap = snap;
+            snap = s;
+            hist_add(stats.latency, esp_timer_get_time() - mailbox.posted_us);
+        }
+        mailbox.full = false;
+        mailbox.reasons = 0;
+        taskEXIT_CRITICAL(&mailbox_lock);
+
+        if (full && snap->gen != gen) {
+            // The newest post found no spare and left the snapshot to us
+            fill(snap, gen);
+            store_rtc(snap);
+        }
+        if (full) {
+            checkpoint_reason_t reason = CHECKPOINT_NONE;
+            if (reasons & 1u << CHECKPOINT_EVENT) {
+                reason = CHECKPOINT_EVENT;
+            } else if (reasons & 1u << CHECKPOINT_POWERFAIL) {
+                reason = CHECKPOINT_POWERFAIL;
+            }
+            write_checkpoint(snap, reason);
+        }
+
+        if (stats_period != portMAX_DELAY && xTaskGetTickCount() - last_stats >= stats_period) {
+            last_stats = xTaskGetTickCount();
+            persist_task_stats_t s;
+            persist_task_get_stats(&s);
+            ESP_LOGI(TAG, "%lu posts, %lu coalesced", (unsigned long)s.posts, (unsigned long)s.coalesced);
+            log_hist("queue latency", s.latency);
+            log_hist("write duration", s.write_us);
+        }
+    }
+}
+
+void persist_task_start(const int64_t *saved_totals, persist_snapshot_fn_t snapshot) {
+    take_snapshot = snapshot;
+    write_lock = xSemaphoreCreateMutex();
+    rtc_lock = xSemaphoreCreateMutex();
+    checkpoint_init(&checkpoint, CONFIG_SLAVE_CHECKPOINT_PERIOD_S, CONFIG_SLAVE_CHECKPOINT_IDLE_S,
+                    esp_timer_get_time(), sum_totals(saved_totals));
+    xTaskCreate(persist_task, "persist_task", 1024 * 3, NULL, 5, &task_handle);
+}
+
+void persist_task_post(checkpoint_reason_t reason) {
+    taskENTER_CRITICAL(&mailbox_lock);
+    snapshot_t *s = spare;
+    spare = NULL;
+    const uint32_t gen = ++mailbox.gen;
+    if (s == NULL) {
+        // Another post is filling the spare; the task snapshots for this one
+        publish(reason);
+        taskEXIT_CRITICAL(&mailbox_lock);
+        xTaskNotifyGive(task_handle);
+        return;
+    }
+    taskEXIT_CRITICAL(&mailbox_lock);
+
+    fill(s, gen);
+    store_rtc(s);
+
+    taskENTER_CRITICAL(&mailbox_lock);
+    if ((int32_t)(gen - mailbox.snap->gen) > 0) {
+        snapshot_t *const older = mailbox.snap;
+        mailbox.snap = s;
+        s = older;
+    }
+    spare = s;
+    publish(reason);
+    taskEXIT_CRITICAL(&mailbox_lock);
+    xTaskNotifyGive(task_handle);
+}
+
+void persist_task_flush(void) {
+    // Only the power-fail task flushes
+    static snapshot_t snap;
+    taskENTER_CRITICAL(&mailbox_lock);
+    const uint32_t gen = ++mailbox.gen;
+    taskEXIT_CRITICAL(&mailbox_lock);
+    fill(&snap, gen);
+    store_rtc(&snap);
+    write_checkpoint(&snap, CHECKPOINT_POWERFAIL);
+}
+
+void persist_task_get_stats(persist_task_stats_t *out) {
+    taskENTER_CRITICAL(&mailbox_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&mailbox_lock);
+}
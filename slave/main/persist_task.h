@@ -0,0 +1,47 @@
+#ifndef PERSIST_TASK_H_
+#define PERSIST_TASK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "checkpoint.h"
+
+/* Counter persistence service.
+ *
+ * Posters (the 1 s timer callback, the command handler) only snapshot every
+ * channel, refresh the RTC copy and notify the service task. The snapshot
+ * and its CRC are made in a spare buffer with interrupts enabled; only the
+ * swap into the one-slot mailbox is a critical section. A newer post
+ * replaces an unserved one and their reasons are merged, so a STOP still
+ * forces its write. The task runs the checkpoint policy and does the flash
+ * write, keeping blocking I/O out of the timer service task and the UART
+ * task. */
+
+// log2 microsecond buckets: bucket i holds [2^i, 2^(i+1)), bucket 0 also 0-1
+// and the last one everything from 2^23 up
+#define PERSIST_HIST_BUCKETS 24
+
+typedef struct {
+    uint32_t posts;
+    uint32_t coalesced;                         // posts that replaced an unserved one
+    uint32_t latency[PERSIST_HIST_BUCKETS];     // post to pick-up by the task
+    uint32_t write_us[PERSIST_HIST_BUCKETS];    // persist_save() duration
+    uint64_t write_us_total;
+} persist_task_stats_t;
+
+/* Fills CONFIG_SLAVE_CHANNEL_COUNT totals and the running bitmap. Called
+ * from every poster's task, possibly on both cores at once. */
+typedef void (*persist_snapshot_fn_t)(int64_t *totals, uint32_t *running);
+
+/* saved_totals is what persist_load() returned, so a difference restored
+ * from RTC memory is written out by the policy. */
+void persist_task_start(const int64_t *saved_totals, persist_snapshot_fn_t snapshot);
+
+void persist_task_post(checkpoint_reason_t reason);
+
+/* Write from the calling task without going through the mailbox, for the
+ * power-fail path which cannot wait for a lower-priority task. */
+void persist_task_flush(void);
+
+void persist_task_get_stats(persist_task_stats_t *out);
+
+#endif
@@ -0,0 +1,95 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "powerfail.h"
+
+static const char *TAG = "powerfail";
+
+#if CONFIG_SLAVE_POWERFAIL_ENABLE
+#define POWERFAIL_PIN CONFIG_SLAVE_POWERFAIL_GPIO
+#if CONFIG_SLAVE_POWERFAIL_ACTIVE_HIGH
+#define POWERFAIL_ACTIVE 1
+#define POWERFAIL_INTR GPIO_INTR_HIGH_LEVEL
+#else
+#define POWERFAIL_ACTIVE 0
+#define POWERFAIL_INTR GPIO_INTR_LOW_LEVEL
+#endif
+
+static TaskHandle_t powerfail_task_handle;
+
+// Level triggered, so a warning already present at start-up is not missed;
+// the interrupt stays off until the task has seen the input go idle again
+static void IRAM_ATTR powerfail_isr(void *arg) {
+    BaseType_t woken = pdFALSE;
+    gpio_intr_disable(POWERFAIL_PIN);
+    vTaskNotifyGiveFromISR(powerfail_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void powerfail_task(void *arg) {
+    powerfail_flush_fn_t flush = arg;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        const int64_t start = esp_timer_get_time();
+        flush();
+        // Only reached with time to spare, or when the supply recovered
+        ESP_LOGW(TAG, "Power-fail flush took %lld us", (long long)(esp_timer_get_time() - start));
+        while (gpio_get_level(POWERFAIL_PIN) == POWERFAIL_ACTIVE) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        gpio_intr_enable(POWERFAIL_PIN);
+    }
+}
+#endif
+
+void powerfail_start(powerfail_flush_fn_t flush) {
+#if CONFIG_SLAVE_POWERFAIL_ENABLE
+    if (xTaskCreate(powerfail_task, "powerfail_task", 1024 * 3, flush, configMAX_PRIORITIES - 1,
+                    &powerfail_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Power-fail task creation failed");
+        return;
+    }
+    gpio_reset_pin(POWERFAIL_PIN);
+    gpio_set_direction(POWERFAIL_PIN, GPIO_MODE_INPUT);
+    if (!POWERFAIL_ACTIVE) {
+        gpio_pullup_en(POWERFAIL_PIN);
+    }
+    gpio_set_intr_type(POWERFAIL_PIN, POWERFAIL_INTR);
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(POWERFAIL_PIN, powerfail_isr, NULL);
+    ESP_LOGI(TAG, "Power-fail input on GPIO%d", POWERFAIL_PIN);
+#endif
+}
+
+#if CONFIG_SLAVE_POWERFAIL_SIMULATE
+#include "powerfail_sim.h"
+
+void powerfail_simulate(void) {
+    static const char *SIM_TAG = "POWERFAIL_SIM";
+    for (int mode = 0; mode < 4; mode++) {
+        const powerfail_sim_config_t cfg = {
+            .period_s = CONFIG_SLAVE_CHECKPOINT_PERIOD_S,
+            .idle_s = CONFIG_SLAVE_CHECKPOINT_IDLE_S,
+            .holdup_us = CONFIG_SLAVE_POWERFAIL_HOLDUP_MS * 1000LL,
+            .warning = mode & 1,
+            .at_op = mode & 2,
+            .trials = 100,
+        };
+        powerfail_sim_result_t r;
+        if (powerfail_sim_run(&cfg, &r) != ESP_OK) {
+            ESP_LOGE(TAG, "no memory for the emulated partition");
+            return;
+        }
+        ESP_LOGI(SIM_TAG, "%s warning, cuts %s: max loss %lld ms, mean %lld ms, bound %lld ms",
+                 cfg.warning ? "with" : "no", cfg.at_op ? "during flash ops" : "at random times",
+                 (long long)(r.max_loss_us / 1000), (long long)(r.mean_loss_us / 1000), (long long)(r.bound_us / 1000));
+        if (r.max_loss_us > r.bound_us) {
+            ESP_LOGE(SIM_TAG, "loss bound exceeded");
+        }
+    }
+}
+#endif
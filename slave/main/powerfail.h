@@ -0,0 +1,23 @@
+#ifndef POWERFAIL_H_
+#define POWERFAIL_H_
+
+/* Last-moment counter write when the supply fails.
+ *
+ * The ESP-IDF brownout detector resets the chip from its own interrupt and
+ * offers no hook, so the warning comes from a GPIO driven by an external
+ * supply monitor that trips while the bulk capacitance still holds the rail
+ * up. The interrupt wakes a top-priority task that calls the flush
+ * function once; the input must return to its idle level before the next
+ * warning is taken. With the journal backend the flush is a single record
+ * program into space that is already erased, well inside a few ms of
+ * hold-up. */
+typedef void (*powerfail_flush_fn_t)(void);
+
+void powerfail_start(powerfail_flush_fn_t flush);
+
+/* Run powerfail_sim.h with the configured policy and hold-up, with and
+ * without the warning, and log the time lost in each case. Only built with
+ * CONFIG_SLAVE_POWERFAIL_SIMULATE. */
+void powerfail_simulate(void);
+
+#endif
@@ -0,0 +1,203 @@
+#include <string.h>
+#include "run_timer.h"
+#include "checkpoint.h"
+#include "powerfail_sim.h"
+
+#define SIM_SECOND 1000000LL
+#define SIM_HORIZON (2 * 3600 * SIM_SECOND)
+#define SIM_SIZE (64 * 1024)
+#define SIM_SECTOR 4096
+#define SIM_RECORD 16
+// Typical SPI NOR timings: a short page program and a 4 KiB sector erase
+#define SIM_PROGRAM_US 200
+#define SIM_ERASE_US 45000
+
+/* The journal on a RAM partition with a simulated clock. Program and erase
+ * advance the clock; one that is still running when power dies leaves a
+ * torn record (half programmed) or a sector that may not be erased, and
+ * everything after it fails until the next boot. */
+typedef struct {
+    journal_flash_t ram;
+    int64_t now_us;
+    int64_t death_us;
+    int64_t holdup_us;
+    uint32_t ops;
+    uint32_t cut_op;            // the warning lands inside this op, UINT32_MAX for a timed cut
+    uint32_t cut_permille;      // where inside it
+    bool dead;
+} sim_flash_t;
+
+static bool sim_op(sim_flash_t *f, int64_t dur_us) {
+    if (f->ops++ == f->cut_op) {
+        f->death_us = f->now_us + dur_us * f->cut_permille / 1000 + f->holdup_us;
+    }
+    if (f->now_us + dur_us > f->death_us) {
+        f->now_us = f->death_us;
+        f->dead = true;
+        return false;
+    }
+    f->now_us += dur_us;
+    return true;
+}
+
+static esp_err_t sim_read(void *ctx, uint32_t offset, void *buf, size_t len) {
+    sim_flash_t *f = ctx;
+    return f->dead ? ESP_FAIL : f->ram.read(f->ram.ctx, offset, buf, len);
+}
+
+static esp_err_t sim_write(void *ctx, uint32_t offset, const void *buf, size_t len) {
+    sim_flash_t *f = ctx;
+    if (f->dead) {
+        return ESP_FAIL;
+    }
+    if (!sim_op(f, SIM_PROGRAM_US)) {
+        f->ram.write(f->ram.ctx, offset, buf, len / 2);
+        return ESP_FAIL;
+    }
+    return f->ram.write(f->ram.ctx, offset, buf, len);
+}
+
+static esp_err_t sim_erase(void *ctx, uint32_t offset, size_t len) {
+    sim_flash_t *f = ctx;
+    if (f->dead) {
+        return ESP_FAIL;
+    }
+    const int64_t start = f->now_us;
+    if (!sim_op(f, SIM_ERASE_US)) {
+        if (f->now_us - start > SIM_ERASE_US / 2) {
+            f->ram.erase(f->ram.ctx, offset, len);
+        }
+        return ESP_FAIL;
+    }
+    return f->ram.erase(f->ram.ctx, offset, len);
+}
+
+static uint32_t sim_rand(uint32_t *rng) {
+    *rng = *rng * 1664525 + 1013904223;
+    return *rng >> 8;
+}
+
+static bool sim_save(journal_t *j, checkpoint_t *c, checkpoint_reason_t reason, int64_t now, int64_t total) {
+    uint8_t rec[SIM_RECORD - JOURNAL_CRC_SIZE] = { 0 };
+    memcpy(rec, &total, sizeof(total));
+    if (journal_append(j, rec) != ESP_OK) {
+        return false;
+    }
+    checkpoint_done(c, reason, now, total);
+    return true;
+}
+
+// Boot after a cut: the power is back and the counter is whatever the journal holds
+static int64_t sim_boot(sim_flash_t *f, const journal_flash_t *flash, journal_t *j) {
+    uint8_t rec[SIM_RECORD - JOURNAL_CRC_SIZE];
+    int64_t total = 0;
+    f->now_us = 0;
+    f->dead = false;
+    f->death_us = SIM_HORIZON;
+    f->cut_op = UINT32_MAX;
+    if (journal_mount(j, flash, SIM_RECORD) == ESP_OK && journal_read_last(j, rec) == ESP_OK) {
+        memcpy(&total, rec, sizeof(total));
+    }
+    return total;
+}
+
+/* One boot of the slave with the same start/stop pattern and checkpoint
+ * policy as checkpoint_simulate(), ending in a power cut. Returns the
+ * counted time the next boot no longer finds. */
+static int64_t sim_trial(sim_flash_t *f, const journal_flash_t *flash, const powerfail_sim_config_t *cfg,
+                         uint32_t *rng) {
+    const bool warning = cfg->warning;
+    journal_t j;
+    int64_t total = sim_boot(f, flash, &j);
+
+    run_timer_t t;
+    checkpoint_t c;
+    run_timer_init(&t, total);
+    checkpoint_init(&c, cfg->period_s, cfg->idle_s, 0, total);
+    if (cfg->at_op) {
+        // Roughly the number of writes a two-hour run makes
+        f->cut_op = f->ops + sim_rand(rng) % (SIM_HORIZON / SIM_SECOND / cfg->period_s + 1);
+        f->cut_permille = sim_rand(rng) % 1000;
+    } else {
+        f->death_us = sim_rand(rng) % (SIM_HORIZON / SIM_SECOND) * SIM_SECOND + sim_rand(rng) % SIM_SECOND;
+    }
+
+    bool flushed = !warning;
+    int64_t next_toggle = 0;
+    // Runs until the cut, at the latest at the end of the horizon
+    for (int64_t tick = 0;; tick += SIM_SECOND) {
+        const int64_t warn_us = f->death_us - f->holdup_us;
+        if (!flushed && warn_us < tick) {
+            // The warning waits for an operation already in progress
+            if (f->now_us < warn_us) {
+                f->now_us = warn_us;
+            }
+            flushed = true;
+            total = run_timer_elapsed_us(&t, f->now_us);
+            if (total != c.saved_total_us) {
+                sim_save(&j, &c, CHECKPOINT_POWERFAIL, f->now_us, total);
+            }
+        }
+        if (f->now_us < tick) {
+            f->now_us = tick;
+        }
+        if (f->dead || f->now_us >= f->death_us) {
+            break;
+        }
+        if (tick >= next_toggle) {
+            if (t.running) {
+                run_timer_stop(&t, f->now_us);
+                sim_save(&j, &c, CHECKPOINT_EVENT, f->now_us, run_timer_elapsed_us(&t, f->now_us));
+                next_toggle = tick + (60 + sim_rand(rng) % 3541) * SIM_SECOND;
+            } else {
+                run_timer_start(&t, f->now_us);
+                next_toggle = tick + (300 + sim_rand(rng) % 6901) * SIM_SECOND;
+            }
+        }
+        total = run_timer_elapsed_us(&t, f->now_us);
+        const checkpoint_reason_t reason = checkpoint_due(&c, f->now_us, total, t.running);
+        if (reason != CHECKPOINT_NONE) {
+            sim_save(&j, &c, reason, f->now_us, total);
+        }
+    }
+
+    const int64_t counted = run_timer_elapsed_us(&t, f->death_us);
+    return counted - sim_boot(f, flash, &j);
+}
+
+esp_err_t powerfail_sim_run(const powerfail_sim_config_t *cfg, powerfail_sim_result_t *out) {
+    journal_flash_t ram;
+    esp_err_t err = journal_ram_init(&ram, SIM_SIZE, SIM_SECTOR);
+    if (err != ESP_OK) {
+        return err;
+    }
+    sim_flash_t f = {
+        .ram = ram,
+        .holdup_us = cfg->holdup_us,
+    };
+    const journal_flash_t flash = {
+        .read = sim_read,
+        .write = sim_write,
+        .erase = sim_erase,
+        .ctx = &f,
+        .size = ram.size,
+        .sector_size = ram.sector_size,
+    };
+    // Without a warning the policy bounds the loss; with one, the hold-up
+    // time plus an erase that cannot be interrupted
+    out->bound_us = cfg->warning ? cfg->holdup_us + SIM_ERASE_US + 2 * SIM_PROGRAM_US
+                                 : (cfg->period_s + 1) * SIM_SECOND;
+    uint32_t rng = cfg->at_op ? 0x2545F491 : 0x9E3779B9;
+    int64_t sum_loss = 0;
+    out->max_loss_us = 0;
+    for (uint32_t i = 0; i < cfg->trials; i++) {
+        const int64_t loss = sim_trial(&f, &flash, cfg, &rng);
+        sum_loss += loss;
+        if (loss > out->max_loss_us) {
+            out->max_loss_us = loss;
+        }
+    }
+    out->mean_loss_us = cfg->trials ? sum_loss / cfg->trials : 0;
+    journal_ram_free(&ram);
+    return ESP_OK;
+}
@@ -0,0 +1,35 @@
+#ifndef POWERFAIL_SIM_H_
+#define POWERFAIL_SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "journal.h"
+
+/* Power cuts against the counter's journal, on a RAM partition with a
+ * simulated clock in which programs and erases take time and can be torn.
+ * Each trial boots, runs a start/stop pattern under the checkpoint policy
+ * and dies at a random time or inside a random flash operation; the next
+ * boot's counter is compared with what had been counted. With the warning
+ * the journal gets the hold-up time for one last write.
+ *
+ * Target independent: powerfail_simulate() runs it on the board and
+ * tests/host/powerfail_sim_test.c on the host. */
+typedef struct {
+    uint32_t period_s;          // checkpoint policy
+    uint32_t idle_s;
+    int64_t holdup_us;          // warning to power loss
+    bool warning;               // whether the power-fail warning is wired
+    bool at_op;                 // cut inside a flash operation, else at a random time
+    uint32_t trials;
+} powerfail_sim_config_t;
+
+typedef struct {
+    int64_t max_loss_us;
+    int64_t mean_loss_us;
+    int64_t bound_us;           // what the design promises for this config
+} powerfail_sim_result_t;
+
+esp_err_t powerfail_sim_run(const powerfail_sim_config_t *cfg, powerfail_sim_result_t *out);
+
+#endif
@@ -0,0 +1,756 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "link_proto.h"
+#include "journal.h"
+#include "channels.h"
+#include "rollup.h"
+
+#define ROLLUP_RECORD_LEN 32
+#define ROLLUP_PAYLOAD_LEN (ROLLUP_RECORD_LEN - JOURNAL_CRC_SIZE)
+#define ROLLUP_HEADER_LEN 7
+// Records per journal_append_many(), one 256-byte program
+#define ROLLUP_BATCH 8
+#define ROLLUP_MAX_BLOCK 60
+
+static const char *TAG = "rollup";
+
+static const uint32_t bucket_s[ROLLUP_LEVELS] = { 60, 3600, 86400 };
+// Buckets per written block: an hour of minutes, a day of hours, one day
+static const uint16_t block_len[ROLLUP_LEVELS] = { 60, 24, 1 };
+static const char *const partitions[ROLLUP_LEVELS] = {
+    ROLLUP_MINUTE_PARTITION, ROLLUP_HOUR_PARTITION, ROLLUP_DAY_PARTITION,
+};
+
+typedef struct {
+    uint16_t channel;
+    uint32_t first;             // bucket index since the epoch
+    uint8_t count;
+} block_t;
+
+typedef struct {
+    journal_t journal[ROLLUP_LEVELS];
+    SemaphoreHandle_t lock;
+    uint16_t count;
+    bool started;               // baseline taken with a valid clock
+    uint32_t minute;            // open minute since the epoch
+    uint8_t flushed;            // closed minutes of the open hour already written
+    int64_t *last_us;           // channel totals at the previous update
+    int64_t *open_us;           // runtime in the open minute
+    uint8_t *minute_s;          // count x 60, closed minutes of the open hour
+    uint16_t *hour_s;           // count x 24, closed hours of the open day
+    uint8_t batch[ROLLUP_BATCH * ROLLUP_PAYLOAD_LEN];
+    uint8_t batched;
+    rollup_stats_t stats;
+} rollup_t;
+
+static rollup_t rollup;
+static persist_snapshot_fn_t take_snapshot;
+// Snapshot buffers of the rollup task, sized by the channel count
+static int64_t *snap_totals;
+static uint32_t *snap_running;
+static TaskHandle_t task_handle;
+
+static size_t put_varint(uint8_t *out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = v | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+static size_t varint_len(uint32_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static bool get_varint(const uint8_t *in, size_t len, size_t *pos, uint32_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 32 && *pos < len; shift += 7) {
+        const uint8_t b = in[(*pos)++];
+        *v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Delta from the previous value (0 before the first), zigzagged so small
+ * drops stay small. A zero delta is followed by how many more values
+ * repeat it. Returns how many values fit into cap bytes. */
+static uint16_t encode(const uint32_t *v, uint16_t n, uint8_t *out, size_t cap) {
+    uint32_t prev = 0;
+    size_t pos = 0;
+    uint16_t i = 0;
+    while (i < n) {
+        if (v[i] == prev) {
+            uint16_t run = 1;
+            while (i + run < n && v[i + run] == prev) {
+                run++;
+            }
+            if (pos + 1 + varint_len(run - 1) > cap) {
+                break;
+            }
+            out[pos++] = 0;
+            pos += put_varint(&out[pos], run - 1);
+            i += run;
+        } else {
+            const int32_t d = (int32_t)(v[i] - prev);
+            const uint32_t z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+            if (pos + varint_len(z) > cap) {
+                break;
+            }
+            pos += put_varint(&out[pos], z);
+            prev = v[i++];
+        }
+    }
+    return i;
+}
+
+static bool decode(const uint8_t *in, size_t len, uint32_t *v, uint16_t n) {
+    uint32_t prev = 0;
+    size_t pos = 0;
+    uint16_t i = 0;
+    while (i < n) {
+        uint32_t z;
+        if (!get_varint(in, len, &pos, &z)) {
+            return false;
+        }
+        if (z == 0) {
+            uint32_t run;
+            if (!get_varint(in, len, &pos, &run) || run >= n - i) {
+                return false;
+            }
+            for (uint32_t k = 0; k <= run; k++) {
+                v[i++] = prev;
+            }
+        } else {
+            prev += (uint32_t)((z >> 1) ^ -(z & 1));
+            v[i++] = prev;
+        }
+    }
+    return true;
+}
+
+static esp_err_t read_block(journal_t *j, uint32_t index, block_t *b, uint32_t *values) {
+    uint8_t rec[ROLLUP_PAYLOAD_LEN];
+    const esp_err_t err = journal_read(j, index, rec);
+    if (err != ESP_OK) {
+        return err;
+    }
+    b->channel = link_get_u16(&rec[0]);
+    b->first = link_get_u32(&rec[2]);
+    b->count = rec[6];
+    if (b->count == 0 || b->count > ROLLUP_MAX_BLOCK) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (values != NULL && !decode(&rec[ROLLUP_HEADER_LEN], ROLLUP_PAYLOAD_LEN - ROLLUP_HEADER_LEN, values, b->count)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+static void flush_batch(rollup_t *r, rollup_level_t level) {
+    if (r->batched == 0) {
+        return;
+    }
+    const esp_err_t err = journal_append_many(&r->journal[level], r->batch, r->batched);
+    if (err == ESP_OK) {
+        r->stats.records[level] += r->batched;
+    } else {
+        ESP_LOGE(TAG, "%s append failed: %s", partitions[level], esp_err_to_name(err));
+        r->stats.errors++;
+    }
+    r->batched = 0;
+}
+
+// Queue one channel's values for buckets first..first+n-1, or at the day
+// level one bucket's values for channels ch..ch+n-1. Zero runs at either
+// end are trimmed, so an idle channel writes nothing.
+static void write_block(rollup_t *r, rollup_level_t level, uint16_t ch, uint32_t first, const uint32_t *v, uint16_t n) {
+    const bool across = level == ROLLUP_DAY;
+    while (n > 0 && v[n - 1] == 0) {
+        n--;
+    }
+    uint16_t done = 0;
+    while (true) {
+        while (done < n && v[done] == 0) {
+            done++;
+        }
+        if (done == n) {
+            break;
+        }
+        uint8_t *rec = &r->batch[r->batched * ROLLUP_PAYLOAD_LEN];
+        memset(rec, 0, ROLLUP_PAYLOAD_LEN);
+        const uint16_t left = n - done < ROLLUP_MAX_BLOCK ? n - done : ROLLUP_MAX_BLOCK;
+        const uint16_t k = encode(&v[done], left, &rec[ROLLUP_HEADER_LEN], ROLLUP_PAYLOAD_LEN - ROLLUP_HEADER_LEN);
+        link_put_u16(&rec[0], across ? ch + done : ch);
+        link_put_u32(&rec[2], across ? first : first + done);
+        rec[6] = k;
+        done += k;
+        if (++r->batched == ROLLUP_BATCH) {
+            flush_batch(r, level);
+        }
+    }
+}
+
+static uint32_t hour_sum(const rollup_t *r, uint16_t ch) {
+    uint32_t s = 0;
+    for (int m = 0; m < 60; m++) {
+        s += r->minute_s[ch * 60 + m];
+    }
+    return s;
+}
+
+static uint32_t day_sum(const rollup_t *r, uint16_t ch) {
+    uint32_t s = 0;
+    for (int h = 0; h < 24; h++) {
+        s += r->hour_s[ch * 24 + h];
+    }
+    return s;
+}
+
+// Write closed minutes of the open hour from flushed up to (not including) end
+static void write_minutes(rollup_t *r, uint8_t end) {
+    uint32_t v[60];
+    const uint32_t hour_first = r->minute / 60 * 60;
+    for (uint16_t ch = 0; ch < r->count; ch++) {
+        for (int m = r->flushed; m < end; m++) {
+            v[m] = r->minute_s[ch * 60 + m];
+        }
+        write_block(r, ROLLUP_MINUTE, ch, hour_first + r->flushed, &v[r->flushed], end - r->flushed);
+    }
+    flush_batch(r, ROLLUP_MINUTE);
+    r->flushed = end;
+}
+
+static void close_minute(rollup_t *r) {
+    const int m = r->minute % 60;
+    for (uint16_t ch = 0; ch < r->count; ch++) {
+        int64_t s = r->open_us[ch] / 1000000;
+        if (s > 60) {
+            s = 60;
+        }
+        r->minute_s[ch * 60 + m] = s;
+        // The sub-second rest, or a tick that straddled the boundary, carries over
+        r->open_us[ch] -= s * 1000000;
+    }
+}
+
+static void close_hour(rollup_t *r) {
+    write_minutes(r, 60);
+    const int h = r->minute / 60 % 24;
+    for (uint16_t ch = 0; ch < r->count; ch++) {
+        r->hour_s[ch * 24 + h] = hour_sum(r, ch);
+    }
+    memset(r->minute_s, 0, r->count * 60);
+    r->flushed = 0;
+}
+
+static void close_day(rollup_t *r) {
+    uint32_t v[24];
+    const uint32_t day = r->minute / 1440;
+    for (uint16_t ch = 0; ch < r->count; ch++) {
+        for (int h = 0; h < 24; h++) {
+            v[h] = r->hour_s[ch * 24 + h];
+        }
+        write_block(r, ROLLUP_HOUR, ch, day * 24, v, 24);
+    }
+    flush_batch(r, ROLLUP_HOUR);
+    // Channels in batches of one record's worth, so no buffer scales with the count
+    for (uint16_t ch = 0; ch < r->count; ch += ROLLUP_MAX_BLOCK) {
+        const uint16_t n = r->count - ch < ROLLUP_MAX_BLOCK ? r->count - ch : ROLLUP_MAX_BLOCK;
+        uint32_t totals[ROLLUP_MAX_BLOCK];
+        for (uint16_t k = 0; k < n; k++) {
+            totals[k] = day_sum(r, ch + k);
+        }
+        write_block(r, ROLLUP_DAY, ch, day, totals, n);
+    }
+    flush_batch(r, ROLLUP_DAY);
+    memset(r->hour_s, 0, r->count * 24 * sizeof(r->hour_s[0]));
+}
+
+// Move the open minute forward, closing whatever hour and day it leaves.
+// Skipped buckets need no work: they are zero and zeros are not written.
+static void advance(rollup_t *r, uint32_t minute) {
+    close_minute(r);
+    if (minute / 60 != r->minute / 60) {
+        close_hour(r);
+        if (minute / 1440 != r->minute / 1440) {
+            close_day(r);
+        }
+    }
+    r->minute = minute;
+}
+
+// Rebuild the open hour and day around r->minute from the minute journal
+static void load(rollup_t *r) {
+    journal_t *j = &r->journal[ROLLUP_MINUTE];
+    const uint32_t hour_first = r->minute / 60 * 60;
+    const uint32_t day_first = r->minute / 1440 * 1440;
+    uint32_t v[ROLLUP_MAX_BLOCK];
+    block_t b;
+    for (uint32_t i = journal_end_index(j); i-- > journal_first_index(j);) {
+        if (read_block(j, i, &b, v) != ESP_OK) {
+            continue;
+        }
+        if (b.first / 60 * 60 + 60 <= day_first) {
+            break;
+        }
+        if (b.channel >= r->count) {
+            continue;
+        }
+        for (int k = 0; k < b.count; k++) {
+            const uint32_t m = b.first + k;
+            if (m < day_first || m >= r->minute) {
+                continue;
+            }
+            if (m >= hour_first) {
+                r->minute_s[b.channel * 60 + m % 60] = v[k];
+                if (m % 60 + 1 > r->flushed) {
+                    r->flushed = m % 60 + 1;
+                }
+            } else {
+                r->hour_s[b.channel * 24 + m / 60 % 24] += v[k];
+            }
+        }
+    }
+}
+
+static bool newest_bucket(rollup_t *r, rollup_level_t level, uint32_t *bucket) {
+    uint8_t rec[ROLLUP_PAYLOAD_LEN];
+    if (journal_read_last(&r->journal[level], rec) != ESP_OK) {
+        return false;
+    }
+    *bucket = link_get_u32(&rec[2]);
+    if (level != ROLLUP_DAY) {
+        *bucket += rec[6] - 1;
+    }
+    return true;
+}
+
+/* First update with a valid clock. Picks up where the minute journal stops:
+ * the hour that was open at the last flush is reopened, and if the day it
+ * belongs to was never closed (the device was off at midnight) it is
+ * closed now from its minutes, before moving on to the present. */
+static void restore(rollup_t *r, uint32_t now_minute) {
+    r->minute = now_minute;
+    uint32_t last;
+    if (!newest_bucket(r, ROLLUP_MINUTE, &last) || last >= now_minute) {
+        load(r);
+        return;
+    }
+    uint32_t last_day;
+    if (last / 1440 < now_minute / 1440 &&
+        newest_bucket(r, ROLLUP_DAY, &last_day) && last_day >= last / 1440) {
+        // That day was closed normally
+        return;
+    }
+    r->minute = last + 1;
+    load(r);
+    if (r->minute != now_minute) {
+        advance(r, now_minute);
+    }
+}
+
+static void update(rollup_t *r, uint32_t now_s, const int64_t *totals) {
+    const uint32_t minute = now_s / 60;
+    if (!r->started) {
+        memcpy(r->last_us, totals, r->count * sizeof(totals[0]));
+        restore(r, minute);
+        r->started = true;
+        return;
+    }
+    for (uint16_t ch = 0; ch < r->count; ch++) {
+        int64_t d = totals[ch] - r->last_us[ch];
+        if (d < 0) {
+            // Reset since the last update: count what ran after it
+            d = totals[ch];
+        }
+        r->open_us[ch] += d;
+        r->last_us[ch] = totals[ch];
+    }
+    // A clock that stepped back keeps filling the open minute until it catches up
+    if (minute > r->minute) {
+        advance(r, minute);
+    }
+}
+
+static void flush(rollup_t *r) {
+    if (r->started) {
+        write_minutes(r, r->minute % 60);
+    }
+}
+
+static uint32_t block_first(rollup_level_t level, uint32_t bucket) {
+    return bucket / block_len[level] * block_len[level];
+}
+
+// Buckets not on flash yet, overwriting what the journal said about them
+static void overlay_open(const rollup_t *r, rollup_level_t level, uint16_t ch, uint32_t first, uint16_t n, uint32_t *out) {
+    if (!r->started) {
+        return;
+    }
+    const uint32_t open_s = r->open_us[ch] / 1000000;
+    const uint32_t hour_s = hour_sum(r, ch) + open_s;
+    uint32_t base;
+    uint16_t len;
+    uint32_t v[60];
+    switch (level) {
+    case ROLLUP_MINUTE:
+        base = r->minute / 60 * 60;
+        len = r->minute % 60 + 1;
+        for (int m = 0; m < len; m++) {
+            v[m] = r->minute_s[ch * 60 + m];
+        }
+        v[len - 1] = open_s;
+        break;
+    case ROLLUP_HOUR:
+        base = r->minute / 1440 * 24;
+        len = r->minute / 60 % 24 + 1;
+        for (int h = 0; h < len; h++) {
+            v[h] = r->hour_s[ch * 24 + h];
+        }
+        v[len - 1] = hour_s;
+        break;
+    default:
+        base = r->minute / 1440;
+        len = 1;
+        v[0] = day_sum(r, ch) + hour_s;
+        break;
+    }
+    for (uint16_t k = 0; k < len; k++) {
+        if (base + k >= first && base + k - first < n) {
+            out[base + k - first] = v[k];
+        }
+    }
+}
+
+static void query(rollup_t *r, rollup_level_t level, uint16_t ch, uint32_t first, uint16_t n, uint32_t *out) {
+    memset(out, 0, n * sizeof(out[0]));
+    journal_t *j = &r->journal[level];
+    const uint32_t end = first + n;
+    // Blocks are appended in time order: binary-search the first one that
+    // starts after the range, then walk back until blocks end before it.
+    // A torn record only moves the search later, which costs a few reads.
+    block_t b;
+    uint32_t lo = journal_first_index(j);
+    uint32_t hi = journal_end_index(j);
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (read_block(j, mid, &b, NULL) == ESP_OK && block_first(level, b.first) >= end) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    uint32_t v[ROLLUP_MAX_BLOCK];
+    for (uint32_t i = lo; i-- > journal_first_index(j);) {
+        if (read_block(j, i, &b, v) != ESP_OK) {
+            continue;
+        }
+        if (block_first(level, b.first) + block_len[level] <= first) {
+            break;
+        }
+        if (level == ROLLUP_DAY) {
+            if (ch >= b.channel && ch - b.channel < b.count && b.first >= first && b.first < end) {
+                out[b.first - first] = v[ch - b.channel];
+            }
+            continue;
+        }
+        if (b.channel != ch) {
+            continue;
+        }
+        for (int k = 0; k < b.count; k++) {
+            if (b.first + k >= first && b.first + k < end) {
+                out[b.first + k - first] = v[k];
+            }
+        }
+    }
+    overlay_open(r, level, ch, first, n, out);
+}
+
+static esp_err_t rollup_alloc(rollup_t *r, uint16_t count) {
+    r->count = count;
+    r->last_us = calloc(count, sizeof(int64_t));
+    r->open_us = calloc(count, sizeof(int64_t));
+    r->minute_s = calloc(count, 60);
+    r->hour_s = calloc(count * 24, sizeof(uint16_t));
+    r->lock = xSemaphoreCreateMutex();
+    if (r->last_us == NULL || r->open_us == NULL || r->minute_s == NULL || r->hour_s == NULL || r->lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void rollup_task(void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        if (tv.tv_sec < ROLLUP_MIN_WALL_TIME) {
+            continue;
+        }
+        take_snapshot(snap_totals, snap_running);
+        xSemaphoreTake(rollup.lock, portMAX_DELAY);
+        update(&rollup, tv.tv_sec, snap_totals);
+        xSemaphoreGive(rollup.lock);
+    }
+}
+
+esp_err_t rollup_init(uint16_t count, persist_snapshot_fn_t snapshot) {
+    for (int level = 0; level < ROLLUP_LEVELS; level++) {
+        journal_flash_t flash;
+        esp_err_t err = journal_partition_init(&flash, partitions[level]);
+        if (err == ESP_OK) {
+            err = journal_mount(&rollup.journal[level], &flash, ROLLUP_RECORD_LEN);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "partition \"%s\" unusable: %s", partitions[level], esp_err_to_name(err));
+            return err;
+        }
+    }
+    snap_totals = calloc(count, sizeof(int64_t));
+    snap_running = calloc(CHANNELS_WORDS(count), sizeof(uint32_t));
+    if (snap_totals == NULL || snap_running == NULL || rollup_alloc(&rollup, count) != ESP_OK) {
+        ESP_LOGE(TAG, "no memory for %u channels", count);
+        return ESP_ERR_NO_MEM;
+    }
+    take_snapshot = snapshot;
+    xTaskCreate(rollup_task, "rollup_task", 1024 * 3, NULL, 2, &task_handle);
+    return ESP_OK;
+}
+
+void rollup_post(void) {
+    if (task_handle != NULL) {
+        xTaskNotifyGive(task_handle);
+    }
+}
+
+void rollup_flush(void) {
+    if (rollup.lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(rollup.lock, portMAX_DELAY);
+    flush(&rollup);
+    xSemaphoreGive(rollup.lock);
+}
+
+esp_err_t rollup_query(rollup_level_t level, uint16_t channel, uint32_t from_s, uint16_t count, uint32_t *out_s) {
+    if (level >= ROLLUP_LEVELS || count > ROLLUP_QUERY_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rollup.lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (channel >= rollup.count) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreTake(rollup.lock, portMAX_DELAY);
+    query(&rollup, level, channel, from_s / bucket_s[level], count, out_s);
+    xSemaphoreGive(rollup.lock);
+    return ESP_OK;
+}
+
+uint32_t rollup_bucket_s(rollup_level_t level) {
+    return level < ROLLUP_LEVELS ? bucket_s[level] : 0;
+}
+
+const char *rollup_level_name(rollup_level_t level) {
+    switch (level) {
+    case ROLLUP_MINUTE:
+        return "minute";
+    case ROLLUP_HOUR:
+        return "hour";
+    case ROLLUP_DAY:
+        return "day";
+    default:
+        return "unknown";
+    }
+}
+
+void rollup_get_stats(rollup_stats_t *out) {
+    if (rollup.lock == NULL) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(rollup.lock, portMAX_DELAY);
+    *out = rollup.stats;
+    xSemaphoreGive(rollup.lock);
+}
+
+#if CONFIG_SLAVE_ROLLUP_BENCHMARK
+#define BENCH_CHANNELS 8
+#define BENCH_DAYS 30
+#define BENCH_TICK_S 10
+#define BENCH_START 1704067200  // 2024-01-01 00:00 UTC
+#define BENCH_QUERIES 20
+
+static uint32_t bench_rand(uint32_t *state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+// A mix of the loads a site sees: always on, never on, a day shift, a
+// compressor cycling 2 min on / 3 min off, and four irregular machines
+static bool bench_running(uint16_t ch, uint32_t t, bool was, uint32_t *seed) {
+    const uint32_t sod = t % 86400;
+    switch (ch) {
+    case 0:
+        return true;
+    case 1:
+        return false;
+    case 2:
+        return sod >= 8 * 3600 && sod < 16 * 3600;
+    case 3:
+        return t % 300 < 120;
+    default:
+        // Mean session about 10 minutes, duty between 20 and 80 %
+        if (bench_rand(seed) % 60 == 0) {
+            return bench_rand(seed) % 10 < 2 + (ch - 4) * 2;
+        }
+        return was;
+    }
+}
+
+static void bench_mount(rollup_t *r, journal_flash_t *flash) {
+    for (int level = 0; level < ROLLUP_LEVELS; level++) {
+        journal_mount(&r->journal[level], &flash[level], ROLLUP_RECORD_LEN);
+    }
+}
+
+static void bench_free(rollup_t *r) {
+    free(r->last_us);
+    free(r->open_us);
+    free(r->minute_s);
+    free(r->hour_s);
+    vSemaphoreDelete(r->lock);
+    memset(r, 0, sizeof(*r));
+}
+
+esp_err_t rollup_benchmark(void) {
+    static const char *BENCH_TAG = "rollup_bench";
+    static const uint32_t ram_size[ROLLUP_LEVELS] = { 64 * 1024, 16 * 1024, 12 * 1024 };
+    // As in partitions.csv, for the retention estimate
+    static const uint32_t part_size[ROLLUP_LEVELS] = { 256 * 1024, 64 * 1024, 32 * 1024 };
+    static rollup_t r;
+    journal_flash_t flash[ROLLUP_LEVELS] = { 0 };
+    uint32_t *out = malloc(ROLLUP_QUERY_MAX * sizeof(uint32_t));
+    bool ok = out != NULL;
+    uint32_t mismatches = 0;
+    for (int level = 0; level < ROLLUP_LEVELS && ok; level++) {
+        ok = journal_ram_init(&flash[level], ram_size[level], 4096) == ESP_OK;
+    }
+    if (!ok || rollup_alloc(&r, BENCH_CHANNELS) != ESP_OK) {
+        ESP_LOGE(BENCH_TAG, "no memory for the emulated partitions");
+        mismatches = BENCH_CHANNELS;
+        goto out;
+    }
+    bench_mount(&r, flash);
+
+    int64_t totals[BENCH_CHANNELS] = { 0 };
+    bool running[BENCH_CHANNELS] = { false };
+    uint32_t seed = 1;
+    const uint32_t end = BENCH_START + BENCH_DAYS * 86400;
+    // Power cut with a flush late on the second-to-last day, then a remount
+    const uint32_t reboot = end - 86400 - 7 * 3600 - 1234;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t t = BENCH_START; t < end; t += BENCH_TICK_S) {
+        for (uint16_t ch = 0; ch < BENCH_CHANNELS; ch++) {
+            if (running[ch]) {
+                totals[ch] += BENCH_TICK_S * 1000000LL;
+            }
+            running[ch] = bench_running(ch, t, running[ch], &seed);
+        }
+        update(&r, t, totals);
+        if (t == reboot) {
+            flush(&r);
+            const rollup_stats_t stats = r.stats;
+            bench_free(&r);
+            rollup_alloc(&r, BENCH_CHANNELS);
+            bench_mount(&r, flash);
+            r.stats = stats;
+        }
+    }
+    const int64_t sim_us = esp_timer_get_time() - start;
+    ESP_LOGI(BENCH_TAG, "%d channels, %d days at %d s ticks: %lld us per update",
+             BENCH_CHANNELS, BENCH_DAYS, BENCH_TICK_S, (long long)sim_us / (BENCH_DAYS * 86400 / BENCH_TICK_S));
+    for (int level = 0; level < ROLLUP_LEVELS; level++) {
+        const uint32_t bytes = r.stats.records[level] * ROLLUP_RECORD_LEN / BENCH_DAYS;
+        // Against a plain u32 per bucket and channel
+        const uint32_t raw = 86400 / bucket_s[level] * BENCH_CHANNELS * 4;
+        // One sector is always the erased spare
+        const uint32_t capacity = (part_size[level] / 4096 - 1) * ((4096 - JOURNAL_HEADER_SIZE) / ROLLUP_RECORD_LEN);
+        ESP_LOGI(BENCH_TAG, "%-6s %5lu bytes/day (raw %6lu, %lu%%), %lu records, %lu days in %lu KiB",
+                 rollup_level_name(level), (unsigned long)bytes, (unsigned long)raw,
+                 (unsigned long)(bytes * 100 / raw), (unsigned long)r.stats.records[level],
+                 (unsigned long)(capacity * BENCH_DAYS / r.stats.records[level]), (unsigned long)part_size[level] / 1024);
+    }
+
+    // Last complete day, which includes the reboot: every level must agree
+    const uint32_t day = end / 86400 - 1;
+    for (uint16_t ch = 0; ch < BENCH_CHANNELS; ch++) {
+        uint32_t minutes = 0, hours = 0;
+        query(&r, ROLLUP_MINUTE, ch, day * 1440, 1440, out);
+        for (int i = 0; i < 1440; i++) {
+            minutes += out[i];
+        }
+        query(&r, ROLLUP_HOUR, ch, day * 24, 24, out);
+        for (int i = 0; i < 24; i++) {
+            hours += out[i];
+        }
+        query(&r, ROLLUP_DAY, ch, day, 1, out);
+        if (minutes != hours || hours != out[0]) {
+            ESP_LOGW(BENCH_TAG, "ch %u: minutes %lu, hours %lu, day %lu", ch,
+                     (unsigned long)minutes, (unsigned long)hours, (unsigned long)out[0]);
+            mismatches++;
+        }
+    }
+    ESP_LOGI(BENCH_TAG, "levels agree on %d of %d channels", BENCH_CHANNELS - mismatches, BENCH_CHANNELS);
+
+    static const struct {
+        rollup_level_t level;
+        uint16_t count;
+    } queries[] = {
+        { ROLLUP_MINUTE, 1440 },
+        { ROLLUP_MINUTE, 60 },
+        { ROLLUP_HOUR, 24 * 7 },
+        { ROLLUP_DAY, BENCH_DAYS },
+    };
+    for (int q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        const rollup_level_t level = queries[q].level;
+        // Ending at the open bucket, the usual dashboard request
+        const uint32_t first = (end - BENCH_TICK_S) / bucket_s[level] + 1 - queries[q].count;
+        const uint32_t reads = r.journal[level].stats.reads;
+        start = esp_timer_get_time();
+        for (int i = 0; i < BENCH_QUERIES; i++) {
+            query(&r, level, 5, first, queries[q].count, out);
+        }
+        ESP_LOGI(BENCH_TAG, "query %4u %s buckets: %lld us (RAM), %lu record reads",
+                 queries[q].count, rollup_level_name(level),
+                 (long long)(esp_timer_get_time() - start) / BENCH_QUERIES,
+                 (unsigned long)(r.journal[level].stats.reads - reads) / BENCH_QUERIES);
+    }
+    bench_free(&r);
+out:
+    for (int level = 0; level < ROLLUP_LEVELS; level++) {
+        if (flash[level].ctx != NULL) {
+            journal_ram_free(&flash[level]);
+        }
+    }
+    free(out);
+    return mismatches ? ESP_FAIL : ESP_OK;
+}
+#endif
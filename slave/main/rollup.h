@@ -0,0 +1,83 @@
+#ifndef ROLLUP_H_
+#define ROLLUP_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "persist_task.h"
+
+/* Per-minute, per-hour and per-day runtime of every channel.
+ *
+ * Each level is a journal on its own partition, so the finer levels recycle
+ * without touching the coarser ones: with the default layout minutes are
+ * kept for weeks, hours and days for months. Buckets are aligned to Unix
+ * time and hold the seconds a channel ran in them.
+ *
+ * Maintenance is incremental. Every rollup_post() (the once-a-second tick
+ * and every stop or reset) adds the runtime since the previous snapshot to
+ * the open minute; closing a minute folds it into the open hour, closing an
+ * hour writes that hour's minutes and closing a day writes the day's hours
+ * and its total. Only closed blocks reach flash, one channel per record:
+ *
+ *   [u16 channel][u32 first bucket][u8 count][varint values...]
+ *
+ * Values are stored as zigzag varint deltas from the previous bucket, with
+ * a zero delta followed by a repeat count, so a channel that ran or stood
+ * still for the whole block costs a few bytes and a channel that never ran
+ * costs nothing. A block that does not fit one record continues in the
+ * next with its own first bucket, so every record decodes on its own and
+ * recycling never orphans a fragment. Day records run across channels
+ * instead: one record holds a day's totals for consecutive channels
+ * starting at the channel field.
+ *
+ * Runtime is bucketed from the first tick with a valid wall clock; runtime
+ * before the first SNTP sync after boot is in the counters but in no
+ * bucket. */
+#define ROLLUP_MINUTE_PARTITION "rollup_min"
+#define ROLLUP_HOUR_PARTITION "rollup_hour"
+#define ROLLUP_DAY_PARTITION "rollup_day"
+
+typedef enum {
+    ROLLUP_MINUTE,
+    ROLLUP_HOUR,
+    ROLLUP_DAY,
+    ROLLUP_LEVELS,
+} rollup_level_t;
+
+#define ROLLUP_QUERY_MAX 1440   // buckets per query, one day of minutes
+// Any clock earlier than this has not been set by SNTP yet
+#define ROLLUP_MIN_WALL_TIME 1700000000
+
+typedef struct {
+    uint32_t records[ROLLUP_LEVELS];    // records written per level
+    uint32_t errors;
+} rollup_stats_t;
+
+esp_err_t rollup_init(uint16_t count, persist_snapshot_fn_t snapshot);
+
+/* Wake the rollup task to fold in the runtime since the last call. Never
+ * blocks. */
+void rollup_post(void);
+
+/* Write the closed minutes of the open hour now, for the power-fail path.
+ * They are read back into the open hour on the next boot. */
+void rollup_flush(void);
+
+/* Seconds run by a channel in count consecutive buckets of a level, the
+ * first being the one containing from_s (Unix time). Buckets not written
+ * or already recycled read as zero; the open buckets are included as they
+ * stand. count is at most ROLLUP_QUERY_MAX. */
+esp_err_t rollup_query(rollup_level_t level, uint16_t channel, uint32_t from_s, uint16_t count, uint32_t *out_s);
+
+/* Bucket length in seconds and a short name, for the HTTP API. */
+uint32_t rollup_bucket_s(rollup_level_t level);
+const char *rollup_level_name(rollup_level_t level);
+
+void rollup_get_stats(rollup_stats_t *out);
+
+/* Stored bytes per day and query latency over a month of synthetic
+ * traffic on RAM journals, with a reboot in between. ESP_FAIL if the
+ * minute, hour and day sums of the last day disagree. Only built with
+ * CONFIG_SLAVE_ROLLUP_BENCHMARK; tests/host runs it too. */
+esp_err_t rollup_benchmark(void);
+
+#endif
@@ -0,0 +1,50 @@
+#include <stddef.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "channels.h"
+#include "rtc_state.h"
+
+#define RTC_STATE_MAGIC 0x52544332      // "RTC2"
+
+static RTC_NOINIT_ATTR rtc_state_t state;
+
+static uint32_t state_crc(const rtc_state_t *s) {
+    return esp_rom_crc32_le(0, (const uint8_t *)s, offsetof(rtc_state_t, crc));
+}
+
+void rtc_state_seal(rtc_state_t *s, uint16_t count) {
+    const size_t words = CHANNELS_WORDS(count);
+    memset(&s->running[words], 0, sizeof(s->running) - words * sizeof(uint32_t));
+    memset(&s->totals[count], 0, sizeof(s->totals) - count * sizeof(int64_t));
+    s->magic = RTC_STATE_MAGIC;
+    s->count = count;
+    s->crc = state_crc(s);
+}
+
+void rtc_state_store(const rtc_state_t *s) {
+    memcpy(&state, s, sizeof(state));
+}
+
+bool rtc_state_restore(int64_t *totals, uint32_t *running, uint16_t count) {
+    switch (esp_reset_reason()) {
+    case ESP_RST_SW:
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_DEEPSLEEP:
+        break;
+    default:
+        // Power-on, brownout and external resets leave RTC memory undefined
+        return false;
+    }
+    if (state.magic != RTC_STATE_MAGIC || state.count != count || state.crc != state_crc(&state)) {
+        return false;
+    }
+    memcpy(running, state.running, CHANNELS_WORDS(count) * sizeof(uint32_t));
+    memcpy(totals, state.totals, count * sizeof(int64_t));
+    return true;
+}
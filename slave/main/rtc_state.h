@@ -0,0 +1,38 @@
+#ifndef RTC_STATE_H_
+#define RTC_STATE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "channels.h"
+
+/* Copy of the live counters in RTC no-init memory.
+ *
+ * The copy is refreshed on every checkpoint poll and command, costs no
+ * flash writes, and survives software restarts, panics, watchdog resets and
+ * deep sleep. Power loss and brownout clear it, which is what the flash
+ * checkpoints are for. A magic value and a CRC reject the random contents
+ * found after power-on and a copy torn by a reset mid-update. */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t running[CHANNELS_WORDS(CONFIG_SLAVE_CHANNEL_COUNT)];
+    int64_t totals[CONFIG_SLAVE_CHANNEL_COUNT];
+    uint32_t crc;               // over the fields above
+} rtc_state_t;
+
+/* Finish a copy whose first count totals and running bits the caller
+ * filled in: clear the rest, set the magic and count, compute the CRC.
+ * Touches only *s, so it needs no lock. count is at most
+ * CONFIG_SLAVE_CHANNEL_COUNT. */
+void rtc_state_seal(rtc_state_t *s, uint16_t count);
+
+/* Make a sealed copy the one kept in RTC memory. Not reentrant. */
+void rtc_state_store(const rtc_state_t *s);
+
+/* The saved counters, if the last reset kept RTC memory, the copy is intact
+ * and it was made with the same channel count. */
+bool rtc_state_restore(int64_t *totals, uint32_t *running, uint16_t count);
+
+#endif
@@ -0,0 +1,43 @@
+#include "run_timer.h"
+
+void run_timer_init(run_timer_t *t, int64_t total_us) {
+    t->running = false;
+    t->start_us = 0;
+    t->accumulated_us = total_us;
+}
+
+void run_timer_start(run_timer_t *t, int64_t now_us) {
+    if (!t->running) {
+        t->start_us = now_us;
+        t->running = true;
+    }
+}
+
+void run_timer_stop(run_timer_t *t, int64_t now_us) {
+    if (t->running) {
+        t->accumulated_us += now_us - t->start_us;
+        t->running = false;
+    }
+}
+
+void run_timer_reset(run_timer_t *t, int64_t now_us) {
+    t->accumulated_us = 0;
+    t->start_us = now_us;
+}
+
+int64_t run_timer_elapsed_us(const run_timer_t *t, int64_t now_us) {
+    if (!t->running) {
+        return t->accumulated_us;
+    }
+    return t->accumulated_us + (now_us - t->start_us);
+}
+
+void run_timer_to_dhms(int64_t us, run_timer_dhms_t *out) {
+    int64_t s = us / 1000000;
+    out->seconds = s % 60;
+    s /= 60;
+    out->minutes = s % 60;
+    s /= 60;
+    out->hours = s % 24;
+    out->days = s / 24;
+}
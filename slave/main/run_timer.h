@@ -0,0 +1,46 @@
+#ifndef RUN_TIMER_H_
+#define RUN_TIMER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Elapsed-time accounting for the run counter.
+ *
+ * The counter is never incremented. It is the total accumulated over
+ * finished runs plus, while running, the distance from the start timestamp
+ * to now on the monotonic microsecond clock (esp_timer_get_time()). A late
+ * or skipped tick therefore changes nothing, and the value has microsecond
+ * resolution. Timestamps are passed in so the arithmetic can be exercised
+ * off-target with a simulated clock (tests/host/run_timer_test.c).
+ *
+ * The live counters moved to channels.c, which keeps the same accounting
+ * per channel; this single-counter form remains for the checkpoint and
+ * power-fail simulations and for the day/hour/minute/second split of /test. */
+typedef struct {
+    bool running;
+    int64_t start_us;           // clock value when the current run started
+    int64_t accumulated_us;     // total of all finished runs
+} run_timer_t;
+
+void run_timer_init(run_timer_t *t, int64_t total_us);
+
+/* No effect if already running / already stopped. */
+void run_timer_start(run_timer_t *t, int64_t now_us);
+void run_timer_stop(run_timer_t *t, int64_t now_us);
+
+/* Zero the total; a running timer keeps running from now. */
+void run_timer_reset(run_timer_t *t, int64_t now_us);
+
+int64_t run_timer_elapsed_us(const run_timer_t *t, int64_t now_us);
+
+/* Split a duration into the days/hours/minutes/seconds shown to users. */
+typedef struct {
+    int32_t days;
+    int32_t hours;
+    int32_t minutes;
+    int32_t seconds;
+} run_timer_dhms_t;
+
+void run_timer_to_dhms(int64_t us, run_timer_dhms_t *out);
+
+#endif
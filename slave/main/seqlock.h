@@ -0,0 +1,43 @@
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sequence lock: readers copy shared data without locking and retry if a
+ * write overlapped the copy; writers never wait for readers.
+ *
+ * The sequence is odd while a write is in progress. Writers must already
+ * be serialized among themselves and must not be preempted between begin
+ * and end, or a reader on the same core would spin until they resume; a
+ * write done inside taskENTER_CRITICAL satisfies both. A reader result is
+ * only valid once seqlock_read_retry() returned false, so the read side
+ * must not act on what it copied before that. */
+typedef struct {
+    uint32_t seq;
+} seqlock_t;
+
+static inline void seqlock_write_begin(seqlock_t *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    // The odd sequence is visible before any of the data stores
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlock_write_end(seqlock_t *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t seqlock_read_begin(const seqlock_t *s) {
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1) {
+    }
+    return seq;
+}
+
+static inline bool seqlock_read_retry(const seqlock_t *s, uint32_t seq) {
+    // The data loads complete before the sequence is checked again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq;
+}
+
+#endif
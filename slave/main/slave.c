@@ -1,270 +1,545 @@
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/event_groups.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/timers.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "esp_http_server.h"
+#include "esp_sntp.h"
+#include "link_proto.h"
+#include "log_ids.h"
+#include "uart_link.h"
+#include "run_timer.h"
+#include "channels.h"
+#include "persist.h"
+#include "checkpoint.h"
+#include "journal.h"
+#include "rtc_state.h"
+#include "powerfail.h"
+#include "persist_task.h"
+#include "history.h"
+#include "rollup.h"
+#include "boot_profile.h"
+#include "wifi_fast.h"
+#include "http_server.h"
+#include "live.h"
+#include "longpoll.h"
+#include "seqlock.h"
+#include "metrics.h"
+#include "history_export.h"
+#include "api_state.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
-static const int RX_BUF_SIZE = 1024;
+static const dlog_format_t log_formats[] = { SLAVE_LOG_FORMATS(DLOG_FORMAT_ENTRY) };
 static TimerHandle_t timer; // Global timer handle variable
-static int seconds = 0;
-static int minutes = 0;
-static int hours = 0;
-static int days = 0;
-
-#define TXD_PIN (GPIO_NUM_4)
-#define RXD_PIN (GPIO_NUM_5)
-#define START_COMMAND "Power on - start counting" // Command to start the timer
-#define STOP_COMMAND "Power off - stop counting time" // Command to stop the timer
-#define RESET_COMMAND "RESET"
+// Counted time per channel, derived from esp_timer timestamps rather than tick counts
+#define CHANNEL_COUNT CONFIG_SLAVE_CHANNEL_COUNT
+// Written under channels_lock by the command dispatcher, read without any
+// lock through channels_seq by HTTP, telemetry, persistence and rollups
+static channels_t channels;
+static portMUX_TYPE channels_lock = portMUX_INITIALIZER_UNLOCKED;
+static seqlock_t channels_seq;
+
+// Applied commands by type and rejected ones; the dispatcher runs on the UART
+// and HTTP server tasks, so they are bumped atomically
+static uint32_t commands_applied[LINK_CMD_RESET + 1];
+static uint32_t commands_rejected;
+
+// Timer service ticks against esp_timer, for the drift metrics
+#define TICK_PERIOD_MS 1000
+static portMUX_TYPE tick_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t ticks;
+static int64_t tick_first_us;
+static int64_t tick_last_us;
+static int64_t tick_jitter_max_us;      // worst distance of one period from TICK_PERIOD_MS
 
 #define EXAMPLE_ESP_WIFI_SSID      "" //add your SSID wifi
 #define EXAMPLE_ESP_WIFI_PASS      "" //add your password wifi
 #define EXAMPLE_ESP_MAXIMUM_RETRY 10
 
-/* FreeRTOS event group to signal when we are connected*/
-static EventGroupHandle_t s_wifi_event_group;
-
-/* The event group allows multiple bits for each event, but we only care about two events:
- * - we are connected to the AP with an IP
- * - we failed to connect after the maximum amount of retries */
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
-
 static const char *TAG = "wifi station";
 
 const char *html_page = "<html><body><h1>Hello HA DO</h1></body></html>";
-httpd_handle_t server = NULL;
 
-static int s_retry_num = 0;
+static void channels_write_begin(void) {
+    taskENTER_CRITICAL(&channels_lock);
+    seqlock_write_begin(&channels_seq);
+}
+
+static void channels_write_end(void) {
+    seqlock_write_end(&channels_seq);
+    taskEXIT_CRITICAL(&channels_lock);
+}
+
+// Total and run state of one channel as of one instant
+static int64_t counter_read(uint16_t ch, bool *running) {
+    int64_t us;
+    bool on;
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&channels_seq);
+        on = channels_is_running(&channels, ch);
+        us = channels_elapsed_us(&channels, ch, esp_timer_get_time());
+    } while (seqlock_read_retry(&channels_seq, seq));
+    if (running) {
+        *running = on;
+    }
+    return us;
+}
+
+static int64_t counter_elapsed_us(uint16_t ch) {
+    return counter_read(ch, NULL);
+}
+
+static bool counter_running(uint16_t ch) {
+    bool running;
+    counter_read(ch, &running);
+    return running;
+}
+
+// Called by persist_task from every poster, and by the rollup, live update
+// and long-poll code
+static void snapshot_channels(int64_t *totals, uint32_t *running) {
+    uint32_t seq;
+    do {
+        seq = seqlock_read_begin(&channels_seq);
+        channels_snapshot(&channels, esp_timer_get_time(), totals, running);
+    } while (seqlock_read_retry(&channels_seq, seq));
+}
 
+// Channel from a "channel" query parameter, 0 when absent; false if out of range
+static bool query_channel(httpd_req_t *req, uint16_t *ch) {
+    char query[32];
+    char value[8];
+    *ch = 0;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "channel", value, sizeof(value)) == ESP_OK) {
+        const unsigned long v = strtoul(value, NULL, 10);
+        if (v >= CHANNEL_COUNT) {
+            return false;
+        }
+        *ch = v;
+    }
+    return true;
+}
+
+// GET /test: legacy text for channel 0 or ?channel=; /api/state is the structured form
 static esp_err_t root_handler(httpd_req_t *req) {
-    char message[50];
-    snprintf(message, sizeof(message), "Timer: %d days %d hours %d minutes %d seconds", days, hours, minutes, seconds);
+    // Room for every field at its int32 maximum
+    char message[96];
+    uint16_t ch;
+    if (!query_channel(req, &ch)) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such channel");
+    }
+    run_timer_dhms_t t;
+    run_timer_to_dhms(counter_elapsed_us(ch), &t);
+    snprintf(message, sizeof(message), "Timer: %ld days %ld hours %ld minutes %ld seconds",
+             (long)t.days, (long)t.hours, (long)t.minutes, (long)t.seconds);
     // Set the HTTP response content type to plain text
     httpd_resp_set_type(req, "text/plain");
     httpd_resp_send(req, message, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
-static void start_http_server(void) {
-    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+// GET /channels: every channel, streamed one per chunk
+static esp_err_t channels_handler(httpd_req_t *req) {
+    char buf[80];
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send_chunk(req, "{\"channels\":[", HTTPD_RESP_USE_STRLEN);
+    for (uint16_t ch = 0; ch < CHANNEL_COUNT; ch++) {
+        bool running;
+        const int64_t us = counter_read(ch, &running);
+        snprintf(buf, sizeof(buf), "%s{\"id\":%u,\"running\":%s,\"total_s\":%lld}",
+                 ch ? "," : "", ch, running ? "true" : "false", (long long)(us / 1000000));
+        if (httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
 
-    if (httpd_start(&server, &config) == ESP_OK) {
-        httpd_uri_t test_page_uri = {
-            .uri = "/test",
-            .method = HTTP_GET,
-            .handler = root_handler,
-            .user_ctx = NULL
-        };
-        httpd_register_uri_handler(server, &test_page_uri);
+#define HISTORY_PAGE_DEFAULT 20
+#define HISTORY_PAGE_MAX 100
+
+// GET /history?cursor=<index>&limit=<n>: events oldest first, streamed one
+// at a time so the response needs no buffer proportional to the page
+static esp_err_t history_handler(httpd_req_t *req) {
+    uint32_t first, end;
+    history_range(&first, &end);
+    uint32_t cursor = first;
+    uint32_t limit = HISTORY_PAGE_DEFAULT;
+    char query[48];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "cursor", value, sizeof(value)) == ESP_OK) {
+            cursor = strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "limit", value, sizeof(value)) == ESP_OK) {
+            limit = strtoul(value, NULL, 10);
+        }
+    }
+    if (limit == 0 || limit > HISTORY_PAGE_MAX) {
+        limit = HISTORY_PAGE_MAX;
+    }
+    // Events before first have been recycled; the client sees the jump in "index"
+    if (cursor < first) {
+        cursor = first;
+    }
+    if (cursor > end) {
+        cursor = end;
     }
+    const uint32_t stop = end - cursor > limit ? cursor + limit : end;
+
+    char buf[144];
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf), "{\"first\":%lu,\"end\":%lu,\"events\":[", (unsigned long)first, (unsigned long)end);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    bool comma = false;
+    for (uint32_t i = cursor; i < stop; i++) {
+        history_event_t ev;
+        if (history_read(i, &ev) != ESP_OK) {
+            continue;
+        }
+        char channel[8] = "null";
+        if (ev.channel != HISTORY_ALL_CHANNELS) {
+            snprintf(channel, sizeof(channel), "%u", ev.channel);
+        }
+        snprintf(buf, sizeof(buf), "%s{\"index\":%lu,\"type\":\"%s\",\"channel\":%s,\"time\":%lu,\"wall_time\":%s,\"duration_s\":%lu}",
+                 comma ? "," : "", (unsigned long)i, history_type_name(ev.type), channel, (unsigned long)ev.time_s,
+                 ev.flags & HISTORY_WALL_TIME ? "true" : "false", (unsigned long)ev.duration_s);
+        if (httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        comma = true;
+    }
+    snprintf(buf, sizeof(buf), "],\"next\":%lu}", (unsigned long)stop);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-static void event_handler(void *arg, esp_event_base_t event_base,
-                          int32_t event_id, void *event_data) {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+#define ROLLUP_VALUES_PER_CHUNK 16
+
+// GET /rollup?level=minute|hour|day&channel=<n>&from=<unix>&count=<n>: seconds
+// run per bucket; without from, the count buckets ending with the open one
+static esp_err_t rollup_handler(httpd_req_t *req) {
+    rollup_level_t level = ROLLUP_MINUTE;
+    uint16_t ch = 0;
+    uint32_t count = 60;
+    uint32_t from = 0;
+    bool have_from = false;
+    char query[96];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "level", value, sizeof(value)) == ESP_OK) {
+            level = ROLLUP_LEVELS;
+            for (rollup_level_t l = 0; l < ROLLUP_LEVELS; l++) {
+                if (strcmp(value, rollup_level_name(l)) == 0) {
+                    level = l;
+                }
+            }
+        }
+        if (httpd_query_key_value(query, "channel", value, sizeof(value)) == ESP_OK) {
+            const unsigned long v = strtoul(value, NULL, 10);
+            if (v >= CHANNEL_COUNT) {
+                return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such channel");
+            }
+            ch = v;
+        }
+        if (httpd_query_key_value(query, "count", value, sizeof(value)) == ESP_OK) {
+            count = strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK) {
+            from = strtoul(value, NULL, 10);
+            have_from = true;
+        }
+    }
+    if (level >= ROLLUP_LEVELS || count == 0 || count > ROLLUP_QUERY_MAX) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad level or count");
+    }
+    const uint32_t step = rollup_bucket_s(level);
+    if (!have_from) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        if (tv.tv_sec < ROLLUP_MIN_WALL_TIME) {
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            httpd_resp_set_hdr(req, "Retry-After", "10");
+            return httpd_resp_send(req, "Clock not set", HTTPD_RESP_USE_STRLEN);
         }
-        ESP_LOGI(TAG, "connect to the AP fail");
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        from = tv.tv_sec - (tv.tv_sec % step) - (count - 1) * step;
+    }
+    from -= from % step;
+    uint32_t *values = malloc(count * sizeof(uint32_t));
+    if (values == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+    }
+    if (rollup_query(level, ch, from, count, values) != ESP_OK) {
+        free(values);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Rollups unavailable");
+    }
 
-        start_http_server();
+    char buf[ROLLUP_VALUES_PER_CHUNK * 7 + 8];
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf), "{\"level\":\"%s\",\"channel\":%u,\"from\":%lu,\"step\":%lu,\"values\":[",
+             rollup_level_name(level), ch, (unsigned long)from, (unsigned long)step);
+    esp_err_t err = httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+    for (uint32_t i = 0; i < count && err == ESP_OK; i += ROLLUP_VALUES_PER_CHUNK) {
+        int len = 0;
+        for (uint32_t k = i; k < count && k < i + ROLLUP_VALUES_PER_CHUNK; k++) {
+            len += snprintf(&buf[len], sizeof(buf) - len, "%s%lu", k ? "," : "", (unsigned long)values[k]);
+        }
+        err = httpd_resp_send_chunk(req, buf, len);
+    }
+    free(values);
+    if (err != ESP_OK) {
+        return ESP_FAIL;
     }
+    httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-void wifi_init_sta(void) {
-    s_wifi_event_group = xEventGroupCreate();
+// GET /boot: when each boot phase finished, in us since startup
+static esp_err_t boot_handler(httpd_req_t *req) {
+    boot_phase_t phases[BOOT_PROFILE_MAX];
+    const size_t n = boot_profile_get(phases, BOOT_PROFILE_MAX);
+    char buf[64];
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send_chunk(req, "{\"phases\":[", HTTPD_RESP_USE_STRLEN);
+    for (size_t i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"us\":%lld}",
+                 i ? "," : "", phases[i].name, (long long)phases[i].at_us);
+        if (httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
 
-    ESP_ERROR_CHECK(esp_netif_init());
+// Application families of GET /metrics, after the module ones
+static void collect_metrics(chunk_writer_t *w) {
+    static const char *const command_labels[] = {
+        [LINK_CMD_START] = "type=\"start\"",
+        [LINK_CMD_STOP] = "type=\"stop\"",
+        [LINK_CMD_RESET] = "type=\"reset\"",
+    };
+    metrics_family(w, "slave_commands_total", "counter", "Commands applied by type.");
+    for (int cmd = LINK_CMD_START; cmd <= LINK_CMD_RESET; cmd++) {
+        metrics_sample(w, "slave_commands_total", command_labels[cmd], commands_applied[cmd]);
+    }
+    metrics_family(w, "slave_commands_rejected_total", "counter", "Commands for an unknown type or channel.");
+    metrics_sample(w, "slave_commands_rejected_total", NULL, commands_rejected);
+
+    taskENTER_CRITICAL(&tick_lock);
+    const uint32_t n = ticks;
+    const int64_t span_us = tick_last_us - tick_first_us;
+    const int64_t jitter_us = tick_jitter_max_us;
+    taskEXIT_CRITICAL(&tick_lock);
+    metrics_family(w, "slave_timer_ticks_total", "counter", "Checkpoint timer ticks.");
+    metrics_sample(w, "slave_timer_ticks_total", NULL, n);
+    metrics_family(w, "slave_timer_drift_seconds", "gauge", "Tick timer lead over esp_timer since the first tick.");
+    metrics_sample_us(w, "slave_timer_drift_seconds", NULL, n ? (int64_t)(n - 1) * TICK_PERIOD_MS * 1000 - span_us : 0);
+    metrics_family(w, "slave_timer_jitter_max_seconds", "gauge", "Largest error of a single tick period.");
+    metrics_sample_us(w, "slave_timer_jitter_max_seconds", NULL, jitter_us);
+
+    metrics_family(w, "slave_channel_runtime_seconds", "counter", "Counted run time per channel.");
+    for (uint16_t ch = 0; ch < CHANNEL_COUNT; ch++) {
+        metrics_sample_n(w, "slave_channel_runtime_seconds", "channel", ch, counter_elapsed_us(ch) / 1000000);
+    }
+    metrics_family(w, "slave_channel_running", "gauge", "1 while a channel runs.");
+    for (uint16_t ch = 0; ch < CHANNEL_COUNT; ch++) {
+        metrics_sample_n(w, "slave_channel_running", "channel", ch, counter_running(ch));
+    }
+}
 
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+// Called by http_server each time it starts a server. The modules log
+// their own failures; a refused handler usually means HTTP_SERVER_MAX_URIS
+// is too low.
+static void register_uris(httpd_handle_t server) {
+    static const httpd_uri_t uris[] = {
+        { .uri = "/test", .method = HTTP_GET, .handler = root_handler },
+        { .uri = "/history", .method = HTTP_GET, .handler = history_handler },
+        { .uri = "/channels", .method = HTTP_GET, .handler = channels_handler },
+        { .uri = "/rollup", .method = HTTP_GET, .handler = rollup_handler },
+        { .uri = "/boot", .method = HTTP_GET, .handler = boot_handler },
+    };
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(uris) / sizeof(uris[0]); i++) {
+        const esp_err_t err = httpd_register_uri_handler(server, &uris[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "%s not registered: %s", uris[i].uri, esp_err_to_name(err));
+            failed++;
+        }
+    }
+    failed += history_export_register(server) != ESP_OK;
+    failed += live_register(server) != ESP_OK;
+    failed += longpoll_register(server) != ESP_OK;
+    failed += metrics_register(server, collect_metrics) != ESP_OK;
+    failed += api_state_register(server) != ESP_OK;
+    if (failed) {
+        ESP_LOGE(TAG, "%d URI registrations failed", failed);
+    }
+}
 
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+// Connection and retries are handled by wifi_fast, the server by http_server
+static void event_handler(void *arg, esp_event_base_t event_base,
+                          int32_t event_id, void *event_data) {
+    if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        boot_mark("wifi_ip");
+    }
+}
 
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
+// Starts association and returns; the rest happens in the event handlers,
+// which stay registered so later disconnects are retried the same way
+void wifi_init_sta(void) {
+    ESP_ERROR_CHECK(wifi_fast_init());
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
                                                         IP_EVENT_STA_GOT_IP,
                                                         &event_handler,
                                                         NULL,
-                                                        &instance_got_ip));
-
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = EXAMPLE_ESP_WIFI_SSID,
-            .password = EXAMPLE_ESP_WIFI_PASS,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-        },
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
+                                                        NULL));
+    // After event_handler, so the address is marked before the server start
+    ESP_ERROR_CHECK(http_server_init(register_uris));
+    ESP_ERROR_CHECK(wifi_fast_connect(EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS, EXAMPLE_ESP_MAXIMUM_RETRY));
 
     ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-    }
-
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip));
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id));
-    vEventGroupDelete(s_wifi_event_group);
-}
-
-void init(void) {
-    const uart_config_t uart_config = {
-        .baud_rate = 115200,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        .source_clk = UART_SCLK_DEFAULT,
-    };
-    uart_driver_install(UART_NUM_1, RX_BUF_SIZE * 2, 0, 0, NULL, 0);
-    uart_param_config(UART_NUM_1, &uart_config);
-    uart_set_pin(UART_NUM_1, TXD_PIN, RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
 }
 
-int sendData(const char *logName, const char *data) {
-    const int len = strlen(data);
-    const int txBytes = uart_write_bytes(UART_NUM_1, data, len);
-    ESP_LOGI(logName, "Wrote %d bytes", txBytes);
-    return txBytes;
+// Command dispatcher shared by every UART port and the WebSocket
+static bool handle_command(int port, link_cmd_t cmd, uint16_t ch) {
+    if (ch >= CHANNEL_COUNT) {
+        __atomic_fetch_add(&commands_rejected, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    const int64_t now = esp_timer_get_time();
+    bool changed;
+    int64_t us = 0;
+    switch (cmd) {
+    case LINK_CMD_START:
+        DLOG(LOG_RX_START, ch);
+        channels_write_begin();
+        changed = channels_start(&channels, ch, now);
+        channels_write_end();
+        persist_task_post(CHECKPOINT_NONE);
+        live_post();
+        longpoll_post(changed);
+        if (changed) {
+            history_post(HISTORY_START, ch, 0);
+        }
+        break;
+    case LINK_CMD_STOP:
+        DLOG(LOG_RX_STOP, ch);
+        channels_write_begin();
+        changed = channels_stop(&channels, ch, now, &us);
+        channels_write_end();
+        persist_task_post(CHECKPOINT_EVENT);
+        rollup_post();
+        live_post();
+        longpoll_post(changed);
+        if (changed) {
+            history_post(HISTORY_STOP, ch, us / 1000000);
+        }
+        break;
+    case LINK_CMD_RESET:
+        DLOG(LOG_RX_RESET, ch);
+        channels_write_begin();
+        us = channels_reset(&channels, ch, now);
+        channels_write_end();
+        persist_task_post(CHECKPOINT_EVENT);
+        rollup_post();
+        live_post();
+        longpoll_post(true);
+        history_post(HISTORY_RESET, ch, us / 1000000);
+        break;
+    default:
+        __atomic_fetch_add(&commands_rejected, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    __atomic_fetch_add(&commands_applied[cmd], 1, __ATOMIC_RELAXED);
+    return true;
 }
 
-static void rx_task(void *arg) {
-    static const char *RX_TASK_TAG = "RX_TASK";
-    esp_log_level_set(RX_TASK_TAG, ESP_LOG_INFO);
-    uint8_t *data = (uint8_t *)malloc(RX_BUF_SIZE + 1);
+#if CONFIG_SLAVE_TELEMETRY_PERIOD_MS > 0
+static void telemetry_task(void *arg) {
+    uint8_t frame[LINK_MAX_FRAME];
+    uint8_t payload[LINK_TELEMETRY_LEN];
+    TickType_t last_wake = xTaskGetTickCount();
     while (1) {
-        const int rxBytes = uart_read_bytes(UART_NUM_1, data, RX_BUF_SIZE, 1000 / portTICK_PERIOD_MS);
-        if (rxBytes > 0) {
-            data[rxBytes] = 0;
-            ESP_LOGI(RX_TASK_TAG, "Read %d bytes: '%s'", rxBytes, data);
-            ESP_LOG_BUFFER_HEXDUMP(RX_TASK_TAG, data, rxBytes, ESP_LOG_INFO);
-
-            if (strcmp((char *)data, START_COMMAND) == 0) {
-                ESP_LOGI(RX_TASK_TAG, "Start command received");
-                xTimerStart(timer, 0);
-            } else if (strcmp((char *)data, STOP_COMMAND) == 0) {
-                ESP_LOGI(RX_TASK_TAG, "Stop command received");
-                xTimerStop(timer, 0);
-            } else if (strcmp((char *)data, RESET_COMMAND) == 0) {
-                ESP_LOGI(RX_TASK_TAG, "Reset command received");
-                seconds = 0;
-                minutes = 0;
-                hours = 0;
-                days = 0;
-                nvs_handle_t nvs_handle;
-                esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-                if (err == ESP_OK) {
-                    err = nvs_set_i32(nvs_handle, "seconds", 0);
-                    if (err == ESP_OK) {
-                        err = nvs_set_i32(nvs_handle, "minutes", 0);
-                        if (err == ESP_OK) {
-                            err = nvs_set_i32(nvs_handle, "hours", 0);
-                            if (err == ESP_OK) {
-                                err = nvs_set_i32(nvs_handle, "days", 0);
-                                if (err == ESP_OK) {
-                                    err = nvs_commit(nvs_handle);
-                                }
-                            }
-                        }
-                    }
-                    nvs_close(nvs_handle);
-                }
-            }
-        }
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_SLAVE_TELEMETRY_PERIOD_MS));
+        uart_link_stats_t rx;
+        persist_stats_t ps;
+        uart_link_get_totals(&rx);
+        persist_get_stats(&ps);
+        const link_telemetry_t t = {
+            .version = LINK_TELEMETRY_VERSION,
+            // The frame predates channels and reports channel 0
+            .flags = counter_running(0) ? LINK_TELEMETRY_RUNNING : 0,
+            .uptime_ms = esp_timer_get_time() / 1000,
+            .counter_s = counter_elapsed_us(0) / 1000000,
+            .rx_frame_errors = rx.frame_errors,
+            .rx_overflows = rx.overflows,
+            .rx_unknown = rx.unknown,
+            .persist_writes = ps.writes,
+            .persist_errors = ps.errors,
+            .free_heap = esp_get_free_heap_size(),
+            .min_free_heap = esp_get_minimum_free_heap_size(),
+        };
+        link_telemetry_pack(&t, payload);
+        const size_t len = link_encode(LINK_FRAME_TELEMETRY, payload, sizeof(payload), frame);
+        uart_link_broadcast(LINK_FEAT_TELEMETRY, frame, len);
     }
-    free(data);
 }
+#endif
 
 void timer_callback(TimerHandle_t xTimer) {
-    seconds++;
-
-    if (seconds >= 60) {
-        minutes++;
-        seconds -= 60;
-    }
-    if (minutes >= 60) {
-        hours++;
-        minutes -= 60;
-    }
-    if (hours >= 24) {
-        days++;
-        hours -= 24;
-    }
-
-    // Store counting time in NVS
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (err == ESP_OK) {
-        err = nvs_set_i32(nvs_handle, "seconds", seconds);
-        if (err == ESP_OK) {
-            err = nvs_set_i32(nvs_handle, "minutes", minutes);
-            if (err == ESP_OK) {
-                err = nvs_set_i32(nvs_handle, "hours", hours);
-                if (err == ESP_OK) {
-                    err = nvs_set_i32(nvs_handle, "days", days);
-                    if (err == ESP_OK) {
-                        err = nvs_commit(nvs_handle);
-                    }
-                }
-            }
-        }
-        nvs_close(nvs_handle);
+    // The period only paces the checkpoint policy; the value itself comes from esp_timer.
+    // Runs in the timer service task, so the flash write is left to persist_task
+    const int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&tick_lock);
+    if (ticks == 0) {
+        tick_first_us = now;
+    } else {
+        const int64_t error = now - tick_last_us - TICK_PERIOD_MS * 1000;
+        const int64_t jitter = error < 0 ? -error : error;
+        tick_jitter_max_us = jitter > tick_jitter_max_us ? jitter : tick_jitter_max_us;
     }
+    tick_last_us = now;
+    ticks++;
+    taskEXIT_CRITICAL(&tick_lock);
+    persist_task_post(CHECKPOINT_NONE);
+    rollup_post();
+    live_post();
+    longpoll_post(false);
+}
 
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "NVS storage error");
-    }
+static void time_synced(struct timeval *tv) {
+    boot_mark("sntp");
+}
 
+// Power-fail warning: the counters first, then the rollup minutes of the open hour
+static void powerfail_flush(void) {
+    persist_task_flush();
+    rollup_flush();
 }
 
 void app_main(void) {
+    boot_mark("app_main");
+    dlog_init(log_formats, LOG_ID_COUNT);
+#if CONFIG_DLOG_BENCHMARK
+    dlog_benchmark(LOG_BENCH);
+#endif
+
     // Initialize NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -272,38 +547,96 @@ void app_main(void) {
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    boot_mark("nvs");
+
+#if CONFIG_SLAVE_CHECKPOINT_SIMULATE
+    checkpoint_simulate();
+#endif
+#if CONFIG_JOURNAL_BENCHMARK
+    journal_benchmark();
+#endif
+#if CONFIG_SLAVE_POWERFAIL_SIMULATE
+    powerfail_simulate();
+#endif
+#if CONFIG_SLAVE_CHANNELS_BENCHMARK
+    persist_benchmark();
+#endif
+#if CONFIG_SLAVE_ROLLUP_BENCHMARK
+    rollup_benchmark();
+#endif
+
+    // Load counting time from flash; static as they scale with the channel count
+    static int64_t saved_us[CHANNEL_COUNT];
+    static int64_t totals[CHANNEL_COUNT];
+    static uint32_t running[CHANNELS_WORDS(CHANNEL_COUNT)];
+    esp_err_t err = persist_load(saved_us, CHANNEL_COUNT);
+    // After a soft reset the RTC copy is newer than the last checkpoint
+    memcpy(totals, saved_us, sizeof(totals));
+    if (rtc_state_restore(totals, running, CHANNEL_COUNT)) {
+        ESP_LOGI(TAG, "Counters restored from RTC memory");
+    }
+    ESP_ERROR_CHECK(channels_init(&channels, CHANNEL_COUNT));
+    boot_mark("load");
+    history_init();
+    int64_t sum_us = 0;
+    const int64_t now = esp_timer_get_time();
+    for (uint16_t ch = 0; ch < CHANNEL_COUNT; ch++) {
+        channels_set_total(&channels, ch, totals[ch]);
+        if (running[ch / 32] & 1u << (ch % 32)) {
+            channels_start(&channels, ch, now);
+            history_post(HISTORY_START, ch, 0);
+        }
+        sum_us += totals[ch];
+    }
+    history_post(HISTORY_BOOT, HISTORY_ALL_CHANNELS, sum_us / 1000000);
+    // Seeded with the flash values so a restored difference gets written out
+    persist_task_start(saved_us, snapshot_channels);
+    rollup_init(CHANNEL_COUNT, snapshot_channels);
+    live_init(CHANNEL_COUNT, snapshot_channels, handle_command);
+    longpoll_init(CHANNEL_COUNT, snapshot_channels);
+    api_state_init(CHANNEL_COUNT, snapshot_channels);
+    powerfail_start(powerfail_flush);
+    boot_mark("persist");
+    ESP_LOGI(TAG, "%d channels, flash entries per hour while running: %d (four-key NVS layout every second: %d)",
+             CHANNEL_COUNT, persist_entries_per_save(CHANNEL_COUNT) * 3600 / CONFIG_SLAVE_CHECKPOINT_PERIOD_S,
+             persist_legacy_entries_per_save() * 3600);
 
-    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
-    wifi_init_sta();
-    init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Counter storage error");
+    }
 
-    // Create a timer with a 1-second period
-    timer = xTimerCreate("Timer", pdMS_TO_TICKS(1000), pdTRUE, (void *)0, timer_callback);
+    // Poll the checkpoint policy once a second, whether or not the counter runs
+    timer = xTimerCreate("Timer", pdMS_TO_TICKS(TICK_PERIOD_MS), pdTRUE, (void *)0, timer_callback);
     if (timer == NULL) {
         ESP_LOGE(TAG, "Timer creation failed");
+    } else {
+        xTimerStart(timer, 0);
     }
 
-    // Load counting time from NVS
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
-    if (err == ESP_OK) {
-        err = nvs_get_i32(nvs_handle, "seconds", &seconds);
-    }
-    if (err == ESP_OK) {
-        err = nvs_get_i32(nvs_handle, "minutes", &minutes);
-    }
-    if (err == ESP_OK) {
-        err = nvs_get_i32(nvs_handle, "hours", &hours);
-    }
-    if (err == ESP_OK) {
-        err = nvs_get_i32(nvs_handle, "days", &days);
-    }
-    nvs_close(nvs_handle);
-
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "NVS storage error");
-    }
+    // Listen for masters on every enabled UART port. Everything the master
+    // needs is up from here on; the network comes up behind it
+    uart_link_start(handle_command);
+    boot_mark("uart");
+#if CONFIG_SLAVE_TELEMETRY_PERIOD_MS > 0
+    // Push periodic status to the master
+    xTaskCreate(telemetry_task, "telemetry_task", 1024 * 3, NULL, 5, NULL);
+#endif
 
-    // Create the UART receive task
-    xTaskCreate(rx_task, "uart_rx_task", 1024 * 4, NULL, configMAX_PRIORITIES, NULL);
+    // Association runs in the Wi-Fi task and finishes in event_handler
+    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
+    wifi_init_sta();
+    boot_mark("wifi_start");
+    // Wall-clock time for history timestamps; events before the first sync
+    // are stamped with uptime instead
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, CONFIG_SLAVE_SNTP_SERVER);
+    sntp_set_time_sync_notification_cb(time_synced);
+    esp_sntp_init();
+    boot_profile_log();
+#if CONFIG_SLAVE_HTTP_STORM_TEST
+    http_server_storm_test();
+#endif
+#if CONFIG_SLAVE_LIVE_BENCHMARK
+    live_benchmark();
+#endif
 }
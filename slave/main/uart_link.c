@@ -0,0 +1,322 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "uart_link.h"
+#include "log_ids.h"
+
+#define UART_LINK_RX_BUF_SIZE 1024
+#define UART_LINK_EVENT_QUEUE_LEN 20
+
+typedef struct {
+    uart_port_t num;
+    int txd;
+    int rxd;
+    uint32_t baud;
+    QueueHandle_t events;
+    // Parser state: a command is the bytes received up to an idle gap, either
+    // legacy text or binary frames starting with LINK_SOF
+    char line[UART_LINK_LINE_MAX + 1];
+    size_t line_len;
+    bool line_overflow;
+    link_decoder_t decoder;
+    // Result of the last capability exchange, zero for a legacy peer
+    link_hello_t peer;
+    uint32_t current_baud;
+    int64_t baud_confirm_deadline;  // 0 unless waiting for a frame at a new baud rate
+    uart_link_stats_t stats;
+} uart_link_port_t;
+
+static const char *TAG = "uart_link";
+
+static uart_link_port_t ports[] = {
+#if CONFIG_SLAVE_UART1_ENABLE
+    { .num = UART_NUM_1, .txd = CONFIG_SLAVE_UART1_TXD, .rxd = CONFIG_SLAVE_UART1_RXD, .baud = CONFIG_SLAVE_UART1_BAUD },
+#endif
+#if CONFIG_SLAVE_UART2_ENABLE
+    { .num = UART_NUM_2, .txd = CONFIG_SLAVE_UART2_TXD, .rxd = CONFIG_SLAVE_UART2_RXD, .baud = CONFIG_SLAVE_UART2_BAUD },
+#endif
+};
+
+#define PORT_COUNT (sizeof(ports) / sizeof(ports[0]))
+
+static uart_link_command_fn dispatch;
+static QueueSetHandle_t event_set;
+
+static void local_caps(const uart_link_port_t *p, link_hello_t *out) {
+    *out = (link_hello_t) {
+        .version = LINK_PROTO_VERSION,
+        .max_payload = LINK_MAX_PAYLOAD,
+        .features = LINK_FEAT_BINARY_CMD | LINK_FEAT_BAUD_SWITCH
+#if CONFIG_SLAVE_TELEMETRY_PERIOD_MS > 0
+                    | LINK_FEAT_TELEMETRY
+#endif
+        ,
+        .bauds = link_baud_mask(CONFIG_SLAVE_UART_MAX_BAUD) | link_baud_mask(p->baud),
+    };
+}
+
+static void send_hello(int idx, uart_link_port_t *p, uint8_t type) {
+    link_hello_t caps;
+    uint8_t payload[LINK_HELLO_LEN];
+    uint8_t frame[LINK_MAX_FRAME];
+    local_caps(p, &caps);
+    link_hello_pack(&caps, payload);
+    uart_link_write(idx, frame, link_encode(type, payload, sizeof(payload), frame));
+}
+
+static void set_baud(uart_link_port_t *p, uint32_t baud) {
+    if (baud == p->current_baud) {
+        return;
+    }
+    // Let the reply leave at the old rate before switching
+    uart_wait_tx_done(p->num, pdMS_TO_TICKS(100));
+    uart_set_baudrate(p->num, baud);
+    p->current_baud = baud;
+    ESP_LOGI(TAG, "UART%d now at %lu baud", p->num, (unsigned long)baud);
+}
+
+static void fall_back_to_legacy(uart_link_port_t *p) {
+    memset(&p->peer, 0, sizeof(p->peer));
+    p->baud_confirm_deadline = 0;
+    set_baud(p, p->baud);
+}
+
+static bool port_frame(int idx, uart_link_port_t *p, const link_frame_t *f) {
+    // Any valid frame proves the new baud rate works
+    p->baud_confirm_deadline = 0;
+    switch (f->type) {
+    case LINK_FRAME_HELLO: {
+        link_hello_t master, caps;
+        if (!link_hello_unpack(f, &master)) {
+            return false;
+        }
+        send_hello(idx, p, LINK_FRAME_HELLO_ACK);
+        local_caps(p, &caps);
+        link_negotiate(&caps, &master, &p->peer);
+        if (p->peer.features & LINK_FEAT_BAUD_SWITCH) {
+            const uint32_t baud = link_baud_fastest(p->peer.bauds);
+            if (baud && baud != p->current_baud) {
+                set_baud(p, baud);
+                p->baud_confirm_deadline = esp_timer_get_time() + UART_LINK_BAUD_CONFIRM_MS * 1000LL;
+            }
+        }
+        return true;
+    }
+    case LINK_FRAME_COMMAND: {
+        link_cmd_t cmd;
+        uint16_t channel;
+        if (!(p->peer.features & LINK_FEAT_BINARY_CMD) || !link_command_unpack(f, &cmd, &channel)) {
+            return false;
+        }
+        return dispatch(idx, cmd, channel);
+    }
+    default:
+        return false;
+    }
+}
+
+static void port_receive(int idx, uart_link_port_t *p, const uart_event_t *event) {
+    size_t pending = event->size;
+    while (pending > 0) {
+        const size_t space = UART_LINK_LINE_MAX - p->line_len;
+        if (space == 0) {
+            // Longer than any command: discard the rest of this burst
+            uint8_t sink[32];
+            const int n = uart_read_bytes(p->num, sink, pending < sizeof(sink) ? pending : sizeof(sink), 0);
+            if (n <= 0) {
+                break;
+            }
+            p->line_overflow = true;
+            p->stats.rx_bytes += n;
+            pending -= n;
+            continue;
+        }
+        const int n = uart_read_bytes(p->num, &p->line[p->line_len], pending < space ? pending : space, 0);
+        if (n <= 0) {
+            break;
+        }
+        p->line_len += n;
+        p->stats.rx_bytes += n;
+        pending -= n;
+    }
+
+    if (!event->timeout_flag || p->line_len == 0) {
+        // More of this command is still on its way
+        return;
+    }
+    p->line[p->line_len] = 0;
+    DLOG(LOG_RX_READ, idx, p->line_len, link_get_u32((uint8_t *)&p->line[0]), link_get_u32((uint8_t *)&p->line[4]));
+    if (p->line_overflow) {
+        p->stats.overflows++;
+    } else if ((uint8_t)p->line[0] == LINK_SOF) {
+        link_decoder_init(&p->decoder);
+        for (size_t i = 0; i < p->line_len; i++) {
+            if (link_decoder_feed(&p->decoder, p->line[i])) {
+                p->stats.frames++;
+                if (port_frame(idx, p, &p->decoder.frame)) {
+                    p->stats.commands++;
+                } else {
+                    p->stats.unknown++;
+                }
+            }
+        }
+        p->stats.unknown += p->decoder.crc_errors;
+    } else if (dispatch(idx, link_parse_legacy(p->line), 0)) {
+        p->stats.commands++;
+    } else {
+        p->stats.unknown++;
+    }
+    memset(p->line, 0, sizeof(p->line));
+    p->line_len = 0;
+    p->line_overflow = false;
+}
+
+static void port_event(int idx, uart_link_port_t *p, const uart_event_t *event) {
+    switch (event->type) {
+    case UART_DATA:
+        port_receive(idx, p, event);
+        break;
+    case UART_FIFO_OVF:
+    case UART_BUFFER_FULL:
+        // Whatever is buffered is now incomplete, drop it and start over
+        p->stats.overflows++;
+        uart_flush_input(p->num);
+        p->line_len = 0;
+        p->line_overflow = false;
+        break;
+    case UART_FRAME_ERR:
+    case UART_PARITY_ERR:
+        p->stats.frame_errors++;
+        if (p->current_baud != p->baud) {
+            // Most likely a restarted master talking at the default rate
+            fall_back_to_legacy(p);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void rx_task(void *arg) {
+    uart_event_t event;
+    while (1) {
+        QueueSetMemberHandle_t ready = xQueueSelectFromSet(event_set, pdMS_TO_TICKS(UART_LINK_BAUD_CONFIRM_MS / 4));
+        for (int i = 0; i < PORT_COUNT; i++) {
+            if (ready && ports[i].events == ready && xQueueReceive(ports[i].events, &event, 0) == pdTRUE) {
+                port_event(i, &ports[i], &event);
+                break;
+            }
+        }
+        const int64_t now = esp_timer_get_time();
+        for (int i = 0; i < PORT_COUNT; i++) {
+            if (ports[i].baud_confirm_deadline && now > ports[i].baud_confirm_deadline) {
+                ESP_LOGW(TAG, "UART%d: no frame at %lu baud, back to legacy", ports[i].num,
+                         (unsigned long)ports[i].current_baud);
+                fall_back_to_legacy(&ports[i]);
+            }
+        }
+    }
+}
+
+esp_err_t uart_link_start(uart_link_command_fn on_command) {
+    dispatch = on_command;
+    if (PORT_COUNT == 0) {
+        ESP_LOGW(TAG, "no UART ports enabled");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    event_set = xQueueCreateSet(PORT_COUNT * UART_LINK_EVENT_QUEUE_LEN);
+    if (event_set == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < PORT_COUNT; i++) {
+        uart_link_port_t *p = &ports[i];
+        const uart_config_t uart_config = {
+            .baud_rate = p->baud,
+            .data_bits = UART_DATA_8_BITS,
+            .parity = UART_PARITY_DISABLE,
+            .stop_bits = UART_STOP_BITS_1,
+            .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+            .source_clk = UART_SCLK_DEFAULT,
+        };
+        esp_err_t err = uart_driver_install(p->num, UART_LINK_RX_BUF_SIZE * 2, 0,
+                                            UART_LINK_EVENT_QUEUE_LEN, &p->events, 0);
+        if (err == ESP_OK) {
+            err = uart_param_config(p->num, &uart_config);
+        }
+        if (err == ESP_OK) {
+            err = uart_set_pin(p->num, p->txd, p->rxd, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "UART%d setup failed: %s", p->num, esp_err_to_name(err));
+            return err;
+        }
+        xQueueAddToSet(p->events, event_set);
+        p->current_baud = p->baud;
+        ESP_LOGI(TAG, "UART%d on TX %d RX %d at %lu baud", p->num, p->txd, p->rxd, (unsigned long)p->baud);
+        // Tell a master that is already up that it should redo the capability exchange
+        send_hello(i, p, LINK_FRAME_HELLO);
+    }
+
+    xTaskCreate(rx_task, "uart_rx_task", 1024 * 4, NULL, configMAX_PRIORITIES - 1, NULL);
+    return ESP_OK;
+}
+
+int uart_link_port_count(void) {
+    return PORT_COUNT;
+}
+
+int uart_link_uart_num(int port) {
+    return ports[port].num;
+}
+
+uint32_t uart_link_baud(int port) {
+    return ports[port].baud;
+}
+
+void uart_link_get_peer(int port, link_hello_t *out) {
+    *out = ports[port].peer;
+}
+
+int uart_link_write(int port, const void *data, size_t len) {
+    const int n = uart_write_bytes(ports[port].num, data, len);
+    if (n > 0) {
+        ports[port].stats.tx_bytes += n;
+    }
+    return n;
+}
+
+int uart_link_broadcast(uint16_t features, const void *data, size_t len) {
+    int written = 0;
+    for (int i = 0; i < PORT_COUNT; i++) {
+        if ((ports[i].peer.features & features) != features) {
+            continue;
+        }
+        if (uart_link_write(i, data, len) == len) {
+            written++;
+        }
+    }
+    return written;
+}
+
+void uart_link_get_stats(int port, uart_link_stats_t *out) {
+    *out = ports[port].stats;
+}
+
+void uart_link_get_totals(uart_link_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < PORT_COUNT; i++) {
+        const uart_link_stats_t *s = &ports[i].stats;
+        out->rx_bytes += s->rx_bytes;
+        out->tx_bytes += s->tx_bytes;
+        out->frames += s->frames;
+        out->commands += s->commands;
+        out->unknown += s->unknown;
+        out->frame_errors += s->frame_errors;
+        out->overflows += s->overflows;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef UART_LINK_H_
+#define UART_LINK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "link_proto.h"
+
+/* UART ports the slave listens on for masters.
+ *
+ * Every enabled port has its own pins, baud rate, driver event queue and
+ * parser state. A single task waits on all event queues through a queue set
+ * and hands complete commands to one dispatcher, so adding a port costs a
+ * queue and a buffer, not a task.
+ *
+ * Ordering: commands from one port are dispatched in the order they were
+ * received. Commands from different ports are dispatched in the order their
+ * last byte was received (the idle timeout that ends a command posts the
+ * event), and never concurrently.
+ *
+ * Each port also runs the slave half of the capability exchange: it
+ * announces itself with HELLO on start-up, answers a master's HELLO with
+ * HELLO_ACK and from then on accepts binary COMMAND frames, sends telemetry
+ * if both sides support it and moves to the fastest common baud rate. A port
+ * that switched baud and hears nothing valid within UART_LINK_BAUD_CONFIRM_MS
+ * falls back to its configured rate and legacy text. */
+#define UART_LINK_MAX_PORTS 2
+#define UART_LINK_LINE_MAX 96
+#define UART_LINK_BAUD_CONFIRM_MS 1000
+
+typedef struct {
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t frames;            // binary frames with a valid CRC
+    uint32_t commands;          // commands the dispatcher accepted
+    uint32_t unknown;           // commands the dispatcher rejected
+    uint32_t frame_errors;      // UART framing/parity errors
+    uint32_t overflows;         // FIFO overflow, ring buffer full or over-long command
+} uart_link_stats_t;
+
+/* Called from the UART task for every command, whether it arrived as legacy
+ * text or as a binary frame. cmd is LINK_CMD_NONE for text that did not
+ * parse; channel is 0 for text and for one-byte command frames. Returns
+ * false if the command was not accepted. */
+typedef bool (*uart_link_command_fn)(int port, link_cmd_t cmd, uint16_t channel);
+
+/* Install drivers for every enabled port and start the receive task. */
+esp_err_t uart_link_start(uart_link_command_fn on_command);
+
+int uart_link_port_count(void);
+
+/* UART number and configured baud rate of port index. */
+int uart_link_uart_num(int port);
+uint32_t uart_link_baud(int port);
+
+/* Capabilities agreed with the master on port; features is 0 for a legacy
+ * peer. */
+void uart_link_get_peer(int port, link_hello_t *out);
+
+int uart_link_write(int port, const void *data, size_t len);
+
+/* Write to every port whose peer negotiated all of features (0 for every
+ * port). Returns the number of ports written. */
+int uart_link_broadcast(uint16_t features, const void *data, size_t len);
+
+void uart_link_get_stats(int port, uart_link_stats_t *out);
+
+/* Sum over all ports. */
+void uart_link_get_totals(uart_link_stats_t *out);
+
+#endif
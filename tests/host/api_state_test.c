@@ -0,0 +1,275 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "channels.h"
+#include "api_state.h"
+#include "host_test.h"
+
+/* GET /api/state through api_state.c, api_enc.c and chunk_writer.c, with
+ * the response collected by the httpd stand-in:
+ *   - the JSON decodes to the snapshot it was made from;
+ *   - the CBOR, asked for by Accept or by format=cbor, decodes to the same
+ *     values as the JSON;
+ *   - size and encoding time of 20000 responses each, 8 and 256 channels. */
+#define VERSION 3000000000u
+#define UPTIME_S 90061
+#define RUNS 20000
+
+static uint16_t channels;
+
+// Large totals, so CBOR needs every head size up to 8 bytes
+static void snapshot(int64_t *totals, uint32_t *running) {
+    for (uint16_t ch = 0; ch < channels; ch++) {
+        totals[ch] = (int64_t)ch * 987654321 * 1000000;
+    }
+    for (int w = 0; w < CHANNELS_WORDS(channels); w++) {
+        running[w] = 0x55555555;
+    }
+}
+
+uint32_t longpoll_version(void) {
+    return VERSION;
+}
+
+/* Decoded value: a map holds its keys and values alternately in items. */
+typedef enum { V_UINT, V_BOOL, V_STR, V_ARRAY, V_MAP } vtype_t;
+
+typedef struct value {
+    vtype_t type;
+    uint64_t u;                 // V_UINT, V_BOOL
+    const char *s;              // V_STR, not terminated
+    size_t n;                   // V_STR length, V_ARRAY items, V_MAP pairs
+    struct value *items;
+} value_t;
+
+static void value_free(value_t *v) {
+    const size_t items = v->type == V_MAP ? 2 * v->n : v->type == V_ARRAY ? v->n : 0;
+    for (size_t i = 0; i < items; i++) {
+        value_free(&v->items[i]);
+    }
+    free(v->items);
+}
+
+static bool value_equal(const value_t *a, const value_t *b) {
+    if (a->type != b->type || a->n != b->n) {
+        return false;
+    }
+    switch (a->type) {
+    case V_UINT:
+    case V_BOOL:
+        return a->u == b->u;
+    case V_STR:
+        return memcmp(a->s, b->s, a->n) == 0;
+    default:
+        for (size_t i = 0; i < (a->type == V_MAP ? 2 * a->n : a->n); i++) {
+            if (!value_equal(&a->items[i], &b->items[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// The JSON api_enc writes: no whitespace, no escapes, unsigned integers
+static value_t json_decode(const char **p, const char *end) {
+    value_t v = { 0 };
+    CHECK(*p < end);
+    const char c = **p;
+    if (c == '{' || c == '[') {
+        const bool map = c == '{';
+        v.type = map ? V_MAP : V_ARRAY;
+        (*p)++;
+        size_t cap = 0, used = 0;
+        while (*p < end && **p != (map ? '}' : ']')) {
+            if (used > 0) {
+                CHECK(**p == ',');
+                (*p)++;
+            }
+            for (int k = 0; k < (map ? 2 : 1); k++) {
+                if (used == cap) {
+                    cap = cap ? 2 * cap : 8;
+                    v.items = realloc(v.items, cap * sizeof(value_t));
+                }
+                v.items[used++] = json_decode(p, end);
+                if (map && k == 0) {
+                    CHECK(v.items[used - 1].type == V_STR && *p < end && **p == ':');
+                    (*p)++;
+                }
+            }
+        }
+        CHECK(*p < end);
+        (*p)++;
+        v.n = map ? used / 2 : used;
+    } else if (c == '"') {
+        v.type = V_STR;
+        v.s = ++(*p);
+        while (*p < end && **p != '"') {
+            (*p)++;
+        }
+        CHECK(*p < end);
+        v.n = *p - v.s;
+        (*p)++;
+    } else if (c >= '0' && c <= '9') {
+        v.type = V_UINT;
+        while (*p < end && **p >= '0' && **p <= '9') {
+            v.u = v.u * 10 + (*(*p)++ - '0');
+        }
+    } else if (end - *p >= 4 && memcmp(*p, "true", 4) == 0) {
+        v.type = V_BOOL;
+        v.u = 1;
+        *p += 4;
+    } else {
+        CHECK(end - *p >= 5 && memcmp(*p, "false", 5) == 0);
+        v.type = V_BOOL;
+        *p += 5;
+    }
+    return v;
+}
+
+// Definite-length CBOR of the major types api_enc writes
+static value_t cbor_decode(const uint8_t **p, const uint8_t *end) {
+    value_t v = { 0 };
+    CHECK(*p < end);
+    const uint8_t major = **p >> 5;
+    const uint8_t info = *(*p)++ & 0x1f;
+    if (major == 7) {
+        CHECK(info == 20 || info == 21);
+        v.type = V_BOOL;
+        v.u = info == 21;
+        return v;
+    }
+    uint64_t arg = info;
+    if (info >= 24) {
+        CHECK(info <= 27);
+        const int bytes = 1 << (info - 24);
+        CHECK(end - *p >= bytes);
+        arg = 0;
+        for (int i = 0; i < bytes; i++) {
+            arg = arg << 8 | *(*p)++;
+        }
+        // api_enc promises the shortest form
+        CHECK(arg >= (bytes == 1 ? 24 : 1ull << (4 * bytes)));
+    }
+    switch (major) {
+    case 0:
+        v.type = V_UINT;
+        v.u = arg;
+        break;
+    case 3:
+        CHECK((uint64_t)(end - *p) >= arg);
+        v.type = V_STR;
+        v.s = (const char *)*p;
+        v.n = arg;
+        *p += arg;
+        break;
+    case 4:
+    case 5: {
+        v.type = major == 5 ? V_MAP : V_ARRAY;
+        v.n = arg;
+        const size_t items = major == 5 ? 2 * arg : arg;
+        v.items = calloc(items ? items : 1, sizeof(value_t));
+        for (size_t i = 0; i < items; i++) {
+            v.items[i] = cbor_decode(p, end);
+        }
+        break;
+    }
+    default:
+        CHECK(!"unexpected CBOR major type");
+    }
+    return v;
+}
+
+static const value_t *map_get(const value_t *map, const char *key) {
+    CHECK(map->type == V_MAP);
+    for (size_t i = 0; i < map->n; i++) {
+        const value_t *k = &map->items[2 * i];
+        if (k->n == strlen(key) && memcmp(k->s, key, k->n) == 0) {
+            return &map->items[2 * i + 1];
+        }
+    }
+    CHECK(!"key missing");
+    return NULL;
+}
+
+static void check_state(const value_t *state) {
+    int64_t totals[256];
+    uint32_t running[CHANNELS_WORDS(256)];
+    snapshot(totals, running);
+    CHECK(state->type == V_MAP && state->n == 3);
+    CHECK(map_get(state, "version")->u == VERSION);
+    CHECK(map_get(state, "uptime_s")->u == UPTIME_S);
+    const value_t *list = map_get(state, "channels");
+    CHECK(list->type == V_ARRAY && list->n == channels);
+    for (uint16_t ch = 0; ch < channels; ch++) {
+        const value_t *c = &list->items[ch];
+        CHECK(c->n == 3);
+        CHECK(map_get(c, "id")->type == V_UINT && map_get(c, "id")->u == ch);
+        CHECK(map_get(c, "running")->type == V_BOOL);
+        CHECK(map_get(c, "running")->u == !!(running[ch / 32] & 1u << (ch % 32)));
+        CHECK(map_get(c, "total_s")->u == (uint64_t)(totals[ch] / 1000000));
+    }
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void get(esp_err_t (*handler)(httpd_req_t *), httpd_req_t *req) {
+    httpd_host_reset(req);
+    CHECK(handler(req) == ESP_OK);
+    CHECK(req->ended);
+}
+
+static void test_channels(esp_err_t (*handler)(httpd_req_t *), uint16_t n) {
+    channels = n;
+    CHECK(api_state_init(n, snapshot) == ESP_OK);
+    httpd_req_t json = { .accept = "*/*" };
+    httpd_req_t cbor = { .accept = "text/html, application/cbor;q=0.9" };
+    httpd_req_t query = { .query = "format=cbor" };
+    get(handler, &json);
+    get(handler, &cbor);
+    get(handler, &query);
+    CHECK(strcmp(json.type, "application/json") == 0);
+    CHECK(strcmp(cbor.type, "application/cbor") == 0);
+    CHECK(query.len == cbor.len && memcmp(query.body, cbor.body, cbor.len) == 0);
+
+    const char *jp = json.body;
+    value_t from_json = json_decode(&jp, json.body + json.len);
+    CHECK(jp == json.body + json.len);
+    const uint8_t *cp = (const uint8_t *)cbor.body;
+    value_t from_cbor = cbor_decode(&cp, (const uint8_t *)cbor.body + cbor.len);
+    CHECK(cp == (const uint8_t *)cbor.body + cbor.len);
+    check_state(&from_json);
+    CHECK(value_equal(&from_json, &from_cbor));
+    value_free(&from_json);
+    value_free(&from_cbor);
+
+    httpd_req_t *const reqs[] = { &json, &cbor };
+    for (int i = 0; i < 2; i++) {
+        const double start = now_us();
+        for (int r = 0; r < RUNS; r++) {
+            get(handler, reqs[i]);
+        }
+        printf("%3u channels %s: %5zu bytes, %.2f us per response\n", n, i ? "CBOR" : "JSON",
+               reqs[i]->len, (now_us() - start) / RUNS);
+    }
+    free(json.body);
+    free(cbor.body);
+    free(query.body);
+}
+
+int main(void) {
+    host_clock_simulated = true;
+    host_clock_us = UPTIME_S * 1000000LL;
+    CHECK(api_state_register(NULL) == ESP_OK);
+    esp_err_t (*handler)(httpd_req_t *) = httpd_host_handler(API_STATE_URI);
+    CHECK(handler != NULL);
+    test_channels(handler, 8);
+    test_channels(handler, 256);
+    return 0;
+}
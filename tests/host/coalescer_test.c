@@ -0,0 +1,78 @@
+#include <string.h>
+#include "coalescer.h"
+#include "host_test.h"
+
+/* coalescer.c, which has no IDF dependency:
+ *   - a toggle burst that ends where it started sends nothing;
+ *   - repeated resets collapse into one RESET;
+ *   - a window emits in the order STOP, RESET, START, at most two;
+ *   - nothing is sent before the window has closed;
+ *   - coalescer_simulate(), the CONFIG_MASTER_COALESCE_SIMULATE pattern,
+ *     gives the counts quoted for the default 300 ms window. */
+#define WINDOW_MS 300
+
+typedef struct {
+    coalesce_cmd_t cmds[4];
+    int n;
+} sent_t;
+
+static void record(coalesce_cmd_t cmd, void *ctx) {
+    sent_t *s = ctx;
+    CHECK(s->n < 4);
+    s->cmds[s->n++] = cmd;
+}
+
+// Push the inputs 50 ms apart from power, then close the window
+static sent_t burst(bool power, const coalesce_input_t *in, int n) {
+    coalescer_t c;
+    sent_t s = { .n = 0 };
+    coalescer_init(&c, WINDOW_MS, power);
+    for (int i = 0; i < n; i++) {
+        coalescer_push(&c, in[i], 50 * i);
+        CHECK(coalescer_poll(&c, 50 * i, record, &s) == 0);
+    }
+    // One millisecond short of the window, then on it
+    CHECK(coalescer_poll(&c, WINDOW_MS - 1, record, &s) == 0);
+    CHECK(coalescer_poll(&c, WINDOW_MS, record, &s) == s.n);
+    CHECK(c.stats.windows == 1 && c.stats.inputs == (uint32_t)n && c.stats.saved == (uint32_t)(n - s.n));
+    // A closed window sends nothing again
+    CHECK(coalescer_poll(&c, 10 * WINDOW_MS, record, &s) == 0);
+    return s;
+}
+
+static void check_sent(sent_t s, int n, coalesce_cmd_t a, coalesce_cmd_t b) {
+    CHECK(s.n == n);
+    CHECK(n < 1 || s.cmds[0] == a);
+    CHECK(n < 2 || s.cmds[1] == b);
+}
+
+int main(void) {
+    const coalesce_input_t T = COALESCE_TOGGLE, R = COALESCE_RESET;
+
+    const coalesce_input_t round_trip[] = { T, T, T, T };
+    check_sent(burst(false, round_trip, 4), 0, 0, 0);
+    check_sent(burst(true, round_trip, 4), 0, 0, 0);
+
+    const coalesce_input_t resets[] = { R, R, R, R, R };
+    check_sent(burst(true, resets, 5), 1, COALESCE_EMIT_RESET, 0);
+
+    const coalesce_input_t odd[] = { T, T, T };
+    check_sent(burst(false, odd, 3), 1, COALESCE_EMIT_START, 0);
+    check_sent(burst(true, odd, 3), 1, COALESCE_EMIT_STOP, 0);
+
+    // Stop before reset, reset before start, wherever the reset fell
+    const coalesce_input_t stop_reset[] = { R, T, R };
+    check_sent(burst(true, stop_reset, 3), 2, COALESCE_EMIT_STOP, COALESCE_EMIT_RESET);
+    const coalesce_input_t reset_start[] = { T, R, R };
+    check_sent(burst(false, reset_start, 3), 2, COALESCE_EMIT_RESET, COALESCE_EMIT_START);
+    const coalesce_input_t reset_only[] = { T, R, T };
+    check_sent(burst(true, reset_only, 3), 1, COALESCE_EMIT_RESET, 0);
+
+    coalesce_stats_t stats;
+    coalescer_simulate(WINDOW_MS, &stats);
+    printf("window %d ms: %lu inputs, %lu sent, %lu saved (%lu%%) in %lu windows\n", WINDOW_MS,
+           (unsigned long)stats.inputs, (unsigned long)stats.sent, (unsigned long)stats.saved,
+           (unsigned long)(100 * stats.saved / stats.inputs), (unsigned long)stats.windows);
+    CHECK(stats.inputs == 6782 && stats.sent == 1981 && stats.saved == 6782 - 1981);
+    return 0;
+}
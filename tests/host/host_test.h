@@ -0,0 +1,27 @@
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Minimal checks for the host tests: a failed CHECK prints where and exits
+ * non-zero, so ctest reports the test as failed. */
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+/* Deterministic xorshift32, so every run simulates the same history. */
+static inline uint32_t test_rand(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_http_server.h"
+#include "boot_profile.h"
+#include "http_server.h"
+#include "host_test.h"
+
+/* http_server.c's lifecycle, driven by IP events as the default loop would
+ * deliver them, with the httpd stand-in as the server:
+ *   - no server before the first address; a failed start is retried on the
+ *     next one;
+ *   - the 300-cycle address storm of CONFIG_SLAVE_HTTP_STORM_TEST starts
+ *     the server once and registers its URIs once;
+ *   - every session open when the address changes is closed, and none when
+ *     the same address comes back. */
+#define STORM_CYCLES 300
+#define STALE_SESSIONS 3
+
+static int registered;
+static int boot_marks;
+
+static void register_uris(httpd_handle_t server) {
+    CHECK(server != NULL);
+    registered++;
+}
+
+void boot_mark(const char *name) {
+    CHECK(strcmp(name, "http") == 0);
+    boot_marks++;
+}
+
+void boot_profile_log(void) {
+}
+
+static void got_ip(bool changed) {
+    ip_event_got_ip_t event = { .ip_changed = changed };
+    esp_event_host_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &event);
+}
+
+int main(void) {
+    http_server_stats_t s;
+    CHECK(http_server_init(register_uris) == ESP_OK);
+    CHECK(http_server_handle() == NULL);
+
+    // The first start fails; the next address retries
+    httpd_host_start_result = ESP_ERR_NO_MEM;
+    got_ip(false);
+    CHECK(http_server_handle() == NULL && registered == 0);
+    httpd_host_start_result = ESP_OK;
+    got_ip(false);
+    CHECK(http_server_handle() != NULL && registered == 1 && boot_marks == 1);
+    http_server_get_stats(&s);
+    CHECK(s.got_ip == 2 && s.starts == 1 && s.start_failures == 1 && s.sessions_closed == 0);
+
+    // Each cycle leaves sessions from before the reconnect; only a new
+    // address closes them
+    for (int i = 0; i < STORM_CYCLES; i++) {
+        httpd_host_n_clients = STALE_SESSIONS;
+        for (int k = 0; k < STALE_SESSIONS; k++) {
+            httpd_host_clients[k] = 100 + k;
+        }
+        const int closed = httpd_host_closed;
+        got_ip(i % 2);
+        CHECK(httpd_host_closed - closed == (i % 2 ? STALE_SESSIONS : 0));
+    }
+    http_server_get_stats(&s);
+    printf("%d address events: %lu server starts, %lu stale sessions closed\n", STORM_CYCLES,
+           (unsigned long)s.starts, (unsigned long)s.sessions_closed);
+    CHECK(s.got_ip == 2 + STORM_CYCLES && s.ip_changes == STORM_CYCLES / 2);
+    CHECK(s.starts == 1 && httpd_host_starts == 1 && registered == 1 && boot_marks == 1);
+    CHECK(s.sessions_closed == STORM_CYCLES / 2 * STALE_SESSIONS && s.sessions_closed == (uint32_t)httpd_host_closed);
+
+    // Other IP events are not address changes
+    esp_event_host_post(IP_EVENT, IP_EVENT_STA_LOST_IP, NULL);
+    http_server_get_stats(&s);
+    CHECK(s.got_ip == 2 + STORM_CYCLES);
+    return 0;
+}
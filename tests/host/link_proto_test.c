@@ -0,0 +1,183 @@
+#include <string.h>
+#include "link_proto.h"
+#include "host_test.h"
+
+/* link_proto.c, the framing both UART ends share:
+ *   - CRC-16/CCITT-FALSE against its published check value;
+ *   - encode and decode round trip for every payload length;
+ *   - every single flipped bit is caught, and the decoder takes the next
+ *     frame after it;
+ *   - junk before SOF and an impossible length are skipped;
+ *   - command, HELLO and telemetry payloads round trip;
+ *   - a legacy peer negotiates down to text commands, baud switching needs
+ *     telemetry, and the fastest common rate is chosen. */
+
+// Feed bytes and return the number of frames completed; the last is in d->frame
+static int feed(link_decoder_t *d, const uint8_t *data, size_t len) {
+    int frames = 0;
+    for (size_t i = 0; i < len; i++) {
+        frames += link_decoder_feed(d, data[i]);
+    }
+    return frames;
+}
+
+static void test_crc(void) {
+    CHECK(link_crc16(0xFFFF, (const uint8_t *)"123456789", 9) == 0x29B1);
+    // Incremental over split input
+    const uint16_t part = link_crc16(0xFFFF, (const uint8_t *)"1234", 4);
+    CHECK(link_crc16(part, (const uint8_t *)"56789", 5) == 0x29B1);
+}
+
+static void test_round_trip(void) {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    uint8_t frame[LINK_MAX_FRAME];
+    for (int i = 0; i < LINK_MAX_PAYLOAD; i++) {
+        payload[i] = 0xA5 ^ i * 37;
+    }
+    link_decoder_t d;
+    link_decoder_init(&d);
+    for (int len = 0; len <= LINK_MAX_PAYLOAD; len++) {
+        const size_t n = link_encode(0x40 + len, payload, len, frame);
+        CHECK(n == LINK_HEADER_LEN + (size_t)len + LINK_CRC_LEN && frame[0] == LINK_SOF);
+        CHECK(feed(&d, frame, n) == 1);
+        CHECK(d.frame.type == 0x40 + len && d.frame.len == len && memcmp(d.frame.payload, payload, len) == 0);
+    }
+    CHECK(d.frames == LINK_MAX_PAYLOAD + 1 && d.crc_errors == 0 && d.junk == 0);
+    CHECK(link_encode(1, payload, LINK_MAX_PAYLOAD + 1, frame) == 0);
+}
+
+static void test_bit_flips(void) {
+    const uint8_t payload[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t good[LINK_MAX_FRAME];
+    uint8_t bad[LINK_MAX_FRAME];
+    const size_t n = link_encode(LINK_FRAME_TELEMETRY, payload, sizeof(payload), good);
+    // SOF and length flips desynchronise rather than fail the CRC; the
+    // decoder must still deliver the good frame that follows
+    for (size_t bit = 0; bit < 8 * n; bit++) {
+        memcpy(bad, good, n);
+        bad[bit / 8] ^= 1u << (bit % 8);
+        link_decoder_t d;
+        link_decoder_init(&d);
+        CHECK(feed(&d, bad, n) == 0);
+        // A shortened frame swallows some of the next one's bytes; a few
+        // SOF-free idle bytes flush it, as the gap between frames would
+        uint8_t idle[LINK_MAX_FRAME];
+        memset(idle, 0, sizeof(idle));
+        feed(&d, idle, sizeof(idle));
+        CHECK(feed(&d, good, n) == 1);
+        CHECK(d.frame.len == sizeof(payload) && memcmp(d.frame.payload, payload, sizeof(payload)) == 0);
+        if (bit / 8 >= 1 && bit / 8 != 2) {
+            CHECK(d.crc_errors == 1);
+        }
+    }
+}
+
+static void test_resync(void) {
+    uint8_t stream[16 + 2 * LINK_MAX_FRAME];
+    size_t n = 0;
+    static const char junk[] = "Power on\r\n";
+    memcpy(stream, junk, sizeof(junk) - 1);
+    n += sizeof(junk) - 1;
+    // SOF, then a length no frame can have
+    stream[n++] = LINK_SOF;
+    stream[n++] = LINK_FRAME_COMMAND;
+    stream[n++] = LINK_MAX_PAYLOAD + 1;
+    uint8_t cmd[LINK_COMMAND_MAX_LEN];
+    n += link_encode(LINK_FRAME_COMMAND, cmd, link_command_pack(LINK_CMD_STOP, 7, cmd), &stream[n]);
+    link_decoder_t d;
+    link_decoder_init(&d);
+    CHECK(feed(&d, stream, n) == 1);
+    CHECK(d.junk == sizeof(junk) - 1 + 3);
+    link_cmd_t c;
+    uint16_t ch;
+    CHECK(link_command_unpack(&d.frame, &c, &ch) && c == LINK_CMD_STOP && ch == 7);
+}
+
+static void test_payloads(void) {
+    link_frame_t f = { .type = LINK_FRAME_COMMAND };
+    link_cmd_t c;
+    uint16_t ch;
+    f.len = link_command_pack(LINK_CMD_RESET, 0, f.payload);
+    CHECK(f.len == 1 && link_command_unpack(&f, &c, &ch) && c == LINK_CMD_RESET && ch == 0);
+    f.len = link_command_pack(LINK_CMD_START, 0xBEEF, f.payload);
+    CHECK(f.len == 3 && link_command_unpack(&f, &c, &ch) && c == LINK_CMD_START && ch == 0xBEEF);
+    f.len = 0;
+    CHECK(!link_command_unpack(&f, &c, &ch));
+
+    const link_hello_t h = { .version = 1, .max_payload = 64, .features = 0x0107, .bauds = 0xF };
+    link_hello_t back;
+    f = (link_frame_t) { .type = LINK_FRAME_HELLO_ACK, .len = LINK_HELLO_LEN };
+    link_hello_pack(&h, f.payload);
+    CHECK(link_hello_unpack(&f, &back) && back.version == h.version && back.max_payload == h.max_payload);
+    CHECK(back.features == h.features && back.bauds == h.bauds);
+    f.type = LINK_FRAME_COMMAND;
+    CHECK(!link_hello_unpack(&f, &back));
+
+    const link_telemetry_t t = {
+        .version = 1, .flags = LINK_TELEMETRY_RUNNING, .uptime_ms = 0xDEADBEEF, .counter_s = 123456,
+        .rx_frame_errors = 1, .rx_overflows = 2, .rx_unknown = 3, .persist_writes = 0x01020304,
+        .persist_errors = 5, .free_heap = 200000, .min_free_heap = 150000,
+    };
+    link_telemetry_t tb;
+    f = (link_frame_t) { .type = LINK_FRAME_TELEMETRY, .len = LINK_TELEMETRY_LEN };
+    link_telemetry_pack(&t, f.payload);
+    CHECK(link_telemetry_unpack(&f, &tb));
+    CHECK(tb.version == t.version && tb.flags == t.flags && tb.uptime_ms == t.uptime_ms);
+    CHECK(tb.counter_s == t.counter_s && tb.rx_frame_errors == t.rx_frame_errors);
+    CHECK(tb.rx_overflows == t.rx_overflows && tb.rx_unknown == t.rx_unknown);
+    CHECK(tb.persist_writes == t.persist_writes && tb.persist_errors == t.persist_errors);
+    CHECK(tb.free_heap == t.free_heap && tb.min_free_heap == t.min_free_heap);
+    // A newer slave's longer frame still reads; a short one does not
+    f.len = LINK_TELEMETRY_LEN + 4;
+    CHECK(link_telemetry_unpack(&f, &tb));
+    f.len = LINK_TELEMETRY_LEN - 1;
+    CHECK(!link_telemetry_unpack(&f, &tb));
+
+    CHECK(link_parse_legacy(LINK_LEGACY_STOP) == LINK_CMD_STOP);
+    CHECK(link_parse_legacy("Power off") == LINK_CMD_NONE);
+    for (link_cmd_t cmd = LINK_CMD_START; cmd <= LINK_CMD_RESET; cmd++) {
+        CHECK(link_parse_legacy(link_legacy_text(cmd)) == cmd);
+    }
+}
+
+static void test_negotiate(void) {
+    const uint16_t all = LINK_FEAT_BINARY_CMD | LINK_FEAT_TELEMETRY | LINK_FEAT_BAUD_SWITCH;
+    const link_hello_t master = { .version = 1, .max_payload = 64, .features = all,
+                                  .bauds = link_baud_mask(921600) };
+    link_hello_t out;
+
+    // A HELLO_ACK with no features, as from a slave that only speaks text
+    const link_hello_t legacy = { .version = 0, .max_payload = 0, .features = 0, .bauds = 0 };
+    link_negotiate(&master, &legacy, &out);
+    CHECK(out.version == 0 && out.features == 0 && !(out.features & LINK_FEAT_BINARY_CMD));
+    CHECK(link_baud_fastest(out.bauds) == 0);
+
+    // Baud switching is dropped without telemetry
+    const link_hello_t no_telemetry = { .version = 1, .max_payload = 32,
+                                        .features = LINK_FEAT_BINARY_CMD | LINK_FEAT_BAUD_SWITCH,
+                                        .bauds = link_baud_mask(921600) };
+    link_negotiate(&master, &no_telemetry, &out);
+    CHECK(out.features == LINK_FEAT_BINARY_CMD && out.max_payload == 32);
+
+    // The fastest rate both offer
+    const link_hello_t slow = { .version = 1, .max_payload = 64, .features = all, .bauds = link_baud_mask(460800) };
+    link_negotiate(&master, &slow, &out);
+    CHECK(out.features == all && link_baud_fastest(out.bauds) == 460800);
+    link_negotiate(&slow, &master, &out);
+    CHECK(link_baud_fastest(out.bauds) == 460800);
+
+    CHECK(link_baud_mask(115200) == 0x1 && link_baud_mask(921600) == 0xF && link_baud_mask(9600) == 0);
+    CHECK(link_baud_mask(500000) == 0x7);
+    // Gaps in a mask: only the highest common bit counts
+    CHECK(link_baud_fastest(0x5) == 460800 && link_baud_fastest(0x1) == 115200);
+}
+
+int main(void) {
+    test_crc();
+    test_round_trip();
+    test_bit_flips();
+    test_resync();
+    test_payloads();
+    test_negotiate();
+    return 0;
+}
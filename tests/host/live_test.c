@@ -0,0 +1,263 @@
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "channels.h"
+#include "link_proto.h"
+#include "live.h"
+#include "host_test.h"
+
+/* live.c with socketpair subscribers behind the httpd stand-in:
+ *   - SSE and WebSocket subscribers get the same JSON per update, SSE as a
+ *     well-formed event, WebSocket as one unmasked text frame;
+ *   - subscribers past CONFIG_SLAVE_LIVE_MAX_CLIENTS get 503 or close 1013;
+ *   - a tick carries only the changed channels, keepalives follow idle posts;
+ *   - text and binary WebSocket commands reach the dispatcher, corrupted or
+ *     oversized ones do not;
+ *   - a peer that went away is dropped on the next broadcast;
+ *   - size of the full update and its WebSocket header for 256 channels. */
+#define KEEPALIVE_POSTS 15      // LIVE_KEEPALIVE_POSTS in live.c
+#define PEERS CONFIG_SLAVE_LIVE_MAX_CLIENTS
+
+static uint16_t channels;
+static int64_t totals[256];
+static uint32_t running[CHANNELS_WORDS(256)];
+
+static void snapshot(int64_t *t, uint32_t *r) {
+    memcpy(t, totals, channels * sizeof(int64_t));
+    memcpy(r, running, CHANNELS_WORDS(channels) * sizeof(uint32_t));
+}
+
+static struct {
+    int calls;
+    int port;
+    link_cmd_t cmd;
+    uint16_t channel;
+} dispatched;
+
+static bool on_command(int port, link_cmd_t cmd, uint16_t channel) {
+    dispatched.calls++;
+    dispatched.port = port;
+    dispatched.cmd = cmd;
+    dispatched.channel = channel;
+    return cmd != LINK_CMD_NONE && channel < channels;
+}
+
+httpd_handle_t http_server_handle(void) {
+    return (httpd_handle_t)1;
+}
+
+typedef struct {
+    int fd[2];                  // server side, client side
+    httpd_req_t req;
+} peer_t;
+
+static esp_err_t (*events_handler)(httpd_req_t *req);
+static esp_err_t (*ws_handler)(httpd_req_t *req);
+
+static esp_err_t subscribe(peer_t *p, bool ws) {
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, p->fd) == 0);
+    memset(&p->req, 0, sizeof(p->req));
+    p->req.method = HTTP_GET;
+    p->req.fd = p->fd[0];
+    return (ws ? ws_handler : events_handler)(&p->req);
+}
+
+static void disconnect(peer_t *p) {
+    if (p->req.free_ctx) {
+        p->req.free_ctx(p->req.sess_ctx);
+    }
+    close(p->fd[0]);
+    close(p->fd[1]);
+    free(p->req.body);
+}
+
+// Everything the peer has been sent so far, terminated
+static size_t received(peer_t *p, char *buf, size_t cap) {
+    size_t len = 0;
+    ssize_t n;
+    while (len < cap - 1 && (n = recv(p->fd[1], &buf[len], cap - 1 - len, MSG_DONTWAIT)) > 0) {
+        len += n;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+// The JSON of one SSE event of the given name; NULL if malformed
+static const char *sse_json(const char *event, const char *name, uint32_t id, size_t *len) {
+    char head[64];
+    snprintf(head, sizeof(head), "id: %lu\nevent: %s\ndata: ", (unsigned long)id, name);
+    if (strncmp(event, head, strlen(head)) != 0) {
+        return NULL;
+    }
+    const char *json = event + strlen(head);
+    const char *end = strstr(json, "\n\n");
+    if (end == NULL || end[2] != '\0' || memchr(json, '\n', end - json) != NULL) {
+        return NULL;
+    }
+    *len = end - json;
+    return json;
+}
+
+// The payload of one unmasked final text frame; NULL if malformed
+static const char *ws_text(const char *msg, size_t msg_len, size_t *len) {
+    const uint8_t *b = (const uint8_t *)msg;
+    if (msg_len < 2 || b[0] != (0x80 | HTTPD_WS_TYPE_TEXT) || (b[1] & 0x80)) {
+        return NULL;
+    }
+    size_t hlen = 2;
+    *len = b[1];
+    if (*len == 126) {
+        *len = b[2] << 8 | b[3];
+        hlen = 4;
+    }
+    return hlen + *len == msg_len ? msg + hlen : NULL;
+}
+
+static void command(peer_t *p, httpd_ws_type_t type, const void *data, size_t len, bool ok) {
+    char reply[64];
+    snprintf(reply, sizeof(reply), "{\"event\":\"reply\",\"ok\":%s}", ok ? "true" : "false");
+    httpd_host_reset(&p->req);
+    p->req.method = 0;
+    p->req.ws_type = type;
+    p->req.ws_payload = data;
+    p->req.ws_len = len;
+    CHECK(ws_handler(&p->req) == ESP_OK);
+    CHECK(p->req.len == strlen(reply) && memcmp(p->req.body, reply, p->req.len) == 0);
+}
+
+int main(void) {
+    static char buf[8192];
+    signal(SIGPIPE, SIG_IGN);
+    host_clock_simulated = true;
+    host_clock_us = 3600 * 1000000LL;
+    channels = 8;
+    for (uint16_t ch = 0; ch < channels; ch++) {
+        totals[ch] = (100 + ch) * 1000000LL;
+    }
+    running[0] = 0x5;
+    CHECK(live_init(channels, snapshot, on_command) == ESP_OK);
+    CHECK(live_register(NULL) == ESP_OK);
+    events_handler = httpd_host_handler(LIVE_SSE_URI);
+    ws_handler = httpd_host_handler(LIVE_WS_URI);
+    CHECK(events_handler != NULL && ws_handler != NULL);
+
+    // Half the subscribers on each transport, all starting from the same state
+    static const char state[] = "{\"event\":\"state\",\"id\":0,\"up\":3600,\"ch\":[[0,100,1],[1,101,0],[2,102,1],"
+                                "[3,103,0],[4,104,0],[5,105,0],[6,106,0],[7,107,0]]}";
+    static const char headers[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                                  "Cache-Control: no-cache\r\n\r\n";
+    peer_t peers[PEERS];
+    for (int i = 0; i < PEERS; i++) {
+        const bool ws = i >= PEERS / 2;
+        CHECK(subscribe(&peers[i], ws) == ESP_OK);
+        const size_t n = received(&peers[i], buf, sizeof(buf));
+        size_t len;
+        const char *json = ws ? ws_text(buf, n, &len) : NULL;
+        if (!ws) {
+            CHECK(strncmp(buf, headers, strlen(headers)) == 0);
+            json = sse_json(buf + strlen(headers), "state", 0, &len);
+        }
+        CHECK(json != NULL && len == strlen(state) && memcmp(json, state, len) == 0);
+    }
+
+    // One past the limit on each transport
+    live_stats_t s;
+    peer_t extra;
+    CHECK(subscribe(&extra, false) == ESP_OK);
+    CHECK(extra.req.status && strncmp(extra.req.status, "503", 3) == 0);
+    disconnect(&extra);
+    CHECK(subscribe(&extra, true) == ESP_FAIL);
+    static const char close_1013[] = { 0x88, 2, 0x03, (char)0xF5 };
+    CHECK(received(&extra, buf, sizeof(buf)) == 4 && memcmp(buf, close_1013, 4) == 0);
+    disconnect(&extra);
+    live_get_stats(&s);
+    CHECK(s.subscribers == PEERS && s.ws_subscribers == PEERS - PEERS / 2 && s.rejected == 2);
+
+    // A tick lists only the channel that changed, byte for byte the same JSON
+    // on both transports
+    totals[1] += 1000000;
+    running[0] |= 1u << 1;
+    live_post();
+    static const char tick[] = "{\"event\":\"tick\",\"id\":1,\"up\":3600,\"ch\":[[1,102,1]]}";
+    for (int i = 0; i < PEERS; i++) {
+        const bool ws = i >= PEERS / 2;
+        const size_t n = received(&peers[i], buf, sizeof(buf));
+        size_t len;
+        const char *json = ws ? ws_text(buf, n, &len) : sse_json(buf, "tick", 1, &len);
+        CHECK(json != NULL && len == strlen(tick) && memcmp(json, tick, len) == 0);
+    }
+
+    // Idle posts send nothing until the keepalive
+    for (int i = 0; i < KEEPALIVE_POSTS - 1; i++) {
+        live_post();
+    }
+    for (int i = 0; i < PEERS; i++) {
+        CHECK(received(&peers[i], buf, sizeof(buf)) == 0);
+    }
+    live_post();
+    static const char ping[] = { 0x80 | HTTPD_WS_TYPE_PING, 0 };
+    for (int i = 0; i < PEERS; i++) {
+        const size_t n = received(&peers[i], buf, sizeof(buf));
+        CHECK(i < PEERS / 2 ? n == 3 && strcmp(buf, ":\n\n") == 0 : n == 2 && memcmp(buf, ping, 2) == 0);
+    }
+
+    // Commands from a WebSocket subscriber
+    peer_t *const ws = &peers[PEERS - 1];
+    command(ws, HTTPD_WS_TYPE_TEXT, "START", 5, true);
+    CHECK(dispatched.port == LIVE_WS_PORT && dispatched.cmd == LINK_CMD_START && dispatched.channel == 0);
+    command(ws, HTTPD_WS_TYPE_TEXT, "RESET 3", 7, true);
+    CHECK(dispatched.cmd == LINK_CMD_RESET && dispatched.channel == 3);
+    command(ws, HTTPD_WS_TYPE_TEXT, "STOP 9", 6, false);
+    CHECK(dispatched.cmd == LINK_CMD_STOP && dispatched.channel == 9);
+    command(ws, HTTPD_WS_TYPE_TEXT, "BOGUS", 5, false);
+    uint8_t payload[LINK_COMMAND_MAX_LEN];
+    uint8_t frame[LINK_MAX_FRAME];
+    const size_t frame_len = link_encode(LINK_FRAME_COMMAND, payload, link_command_pack(LINK_CMD_STOP, 5, payload),
+                                         frame);
+    command(ws, HTTPD_WS_TYPE_BINARY, frame, frame_len, true);
+    CHECK(dispatched.cmd == LINK_CMD_STOP && dispatched.channel == 5);
+    const int calls = dispatched.calls;
+    frame[frame_len - 1] ^= 1;
+    command(ws, HTTPD_WS_TYPE_BINARY, frame, frame_len, false);
+    CHECK(dispatched.calls == calls);
+    // Longer than any command: the error closes the session
+    static const char big[LINK_MAX_FRAME + 1];
+    httpd_host_reset(&ws->req);
+    ws->req.ws_type = HTTPD_WS_TYPE_TEXT;
+    ws->req.ws_payload = (const uint8_t *)big;
+    ws->req.ws_len = sizeof(big);
+    CHECK(ws_handler(&ws->req) != ESP_OK);
+    live_get_stats(&s);
+    CHECK(s.ws_commands == 3 && s.ws_rejected == 3);
+
+    // A peer that went away is closed and dropped by the next broadcast
+    close(peers[0].fd[1]);
+    totals[2] += 1000000;
+    live_post();
+    live_get_stats(&s);
+    CHECK(s.dropped == 1 && httpd_host_closed == 1 && s.subscribers == PEERS - 1);
+    printf("%d subscribers: %lu broadcasts, last %lu bytes, 2 rejected, 1 dropped\n", PEERS,
+           (unsigned long)s.broadcasts, (unsigned long)s.last_bytes);
+    for (int i = 0; i < PEERS; i++) {
+        disconnect(&peers[i]);
+    }
+    live_get_stats(&s);
+    CHECK(s.subscribers == 0);
+
+    // Every channel of a 256-channel board in one message
+    channels = 256;
+    CHECK(live_init(channels, snapshot, on_command) == ESP_OK);
+    peer_t big_board;
+    CHECK(subscribe(&big_board, true) == ESP_OK);
+    const size_t n = received(&big_board, buf, sizeof(buf));
+    size_t len;
+    CHECK(ws_text(buf, n, &len) != NULL && (uint8_t)buf[1] == 126);
+    printf("256 channels: full update %zu bytes under a %zu-byte WebSocket header\n", len, n - len);
+    disconnect(&big_board);
+    return 0;
+}
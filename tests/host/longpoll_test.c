@@ -0,0 +1,183 @@
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "channels.h"
+#include "longpoll.h"
+#include "host_test.h"
+
+/* longpoll.c with socketpair clients behind the httpd stand-in:
+ *   - a stale or missing since is answered at once;
+ *   - a current one parks the request without a response, and the change
+ *     writes a complete HTTP answer to its socket;
+ *   - a parked request with no change is answered at the timeout;
+ *   - waiters past CONFIG_SLAVE_LONGPOLL_MAX_WAITERS get 503;
+ *   - a session that goes away takes every waiter on it along;
+ *   - a waiter whose socket is gone is closed on the next wake. */
+#define CHANNELS 3
+#define TIMEOUT_US (CONFIG_SLAVE_LONGPOLL_TIMEOUT_S * 1000000LL)
+
+static int64_t totals[CHANNELS];
+static uint32_t running[CHANNELS_WORDS(CHANNELS)];
+
+static void snapshot(int64_t *t, uint32_t *r) {
+    memcpy(t, totals, sizeof(totals));
+    memcpy(r, running, sizeof(running));
+}
+
+httpd_handle_t http_server_handle(void) {
+    return (httpd_handle_t)1;
+}
+
+typedef struct {
+    int fd[2];                  // server side, client side
+    httpd_req_t req;
+    char query[32];
+} client_t;
+
+static esp_err_t (*wait_handler)(httpd_req_t *req);
+
+static void connect_client(client_t *c) {
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, c->fd) == 0);
+    memset(&c->req, 0, sizeof(c->req));
+    c->req.method = HTTP_GET;
+    c->req.fd = c->fd[0];
+}
+
+// GET /wait?since=<since> on the client's session
+static void wait(client_t *c, uint32_t since) {
+    snprintf(c->query, sizeof(c->query), "since=%lu", (unsigned long)since);
+    httpd_host_reset(&c->req);
+    c->req.query = c->query;
+    CHECK(wait_handler(&c->req) == ESP_OK);
+}
+
+static void disconnect(client_t *c) {
+    if (c->req.free_ctx) {
+        c->req.free_ctx(c->req.sess_ctx);
+    }
+    close(c->fd[0]);
+    close(c->fd[1]);
+    free(c->req.body);
+}
+
+// Everything the client has been sent so far, terminated
+static size_t received(client_t *c, char *buf, size_t cap) {
+    size_t len = 0;
+    ssize_t n;
+    while (len < cap - 1 && (n = recv(c->fd[1], &buf[len], cap - 1 - len, MSG_DONTWAIT)) > 0) {
+        len += n;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static void expected_body(char *buf, size_t cap, uint32_t version) {
+    snprintf(buf, cap, "{\"version\":%lu,\"up\":%lld,\"ch\":[[0,%lld,1],[1,%lld,0],[2,%lld,1]]}",
+             (unsigned long)version, (long long)(host_clock_us / 1000000), (long long)(totals[0] / 1000000),
+             (long long)(totals[1] / 1000000), (long long)(totals[2] / 1000000));
+}
+
+// The parked client got exactly one complete answer with version
+static void check_answer(client_t *c, uint32_t version) {
+    char got[512], body[256], want[512];
+    expected_body(body, sizeof(body), version);
+    snprintf(want, sizeof(want), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+             "Cache-Control: no-cache\r\nContent-Length: %zu\r\n\r\n%s", strlen(body), body);
+    received(c, got, sizeof(got));
+    CHECK(strcmp(got, want) == 0);
+}
+
+static void check_stats(uint32_t parked, uint32_t woken, uint32_t timeouts, uint32_t rejected, uint32_t dropped) {
+    longpoll_stats_t s;
+    longpoll_get_stats(&s);
+    CHECK(s.parked == parked && s.woken == woken && s.timeouts == timeouts);
+    CHECK(s.rejected == rejected && s.dropped == dropped);
+}
+
+int main(void) {
+    char buf[512];
+    signal(SIGPIPE, SIG_IGN);
+    host_clock_simulated = true;
+    host_clock_us = 7200 * 1000000LL;
+    totals[0] = 10 * 1000000LL;
+    totals[1] = 20 * 1000000LL;
+    totals[2] = 30 * 1000000LL;
+    running[0] = 0x5;
+    CHECK(longpoll_init(CHANNELS, snapshot) == ESP_OK);
+    CHECK(longpoll_register(NULL) == ESP_OK);
+    wait_handler = httpd_host_handler(LONGPOLL_URI);
+    CHECK(wait_handler != NULL);
+    uint32_t version = longpoll_version();
+
+    // No since, and a stale one: answered at once through the server
+    client_t a, b, c;
+    connect_client(&a);
+    httpd_host_reset(&a.req);
+    CHECK(wait_handler(&a.req) == ESP_OK);
+    expected_body(buf, sizeof(buf), version);
+    CHECK(a.req.ended && a.req.status == NULL && a.req.len == strlen(buf) && memcmp(a.req.body, buf, a.req.len) == 0);
+    wait(&a, version - 1);
+    CHECK(a.req.ended && a.req.len == strlen(buf));
+
+    // Park, then wake on a change
+    wait(&a, version);
+    CHECK(!a.req.ended && a.req.len == 0 && a.req.sess_ctx != NULL);
+    CHECK(received(&a, buf, sizeof(buf)) == 0);
+    check_stats(1, 0, 0, 0, 0);
+    totals[1] += 5 * 1000000LL;
+    longpoll_post(true);
+    check_answer(&a, ++version);
+    check_stats(0, 1, 0, 0, 0);
+
+    // Park on the new version; ticks before the deadline send nothing
+    wait(&a, version);
+    host_clock_us += TIMEOUT_US - 1;
+    longpoll_post(false);
+    CHECK(received(&a, buf, sizeof(buf)) == 0);
+    host_clock_us += 1;
+    longpoll_post(false);
+    check_answer(&a, version);
+    check_stats(0, 1, 1, 0, 0);
+
+    // Full: the next session is turned away
+    connect_client(&b);
+    connect_client(&c);
+    wait(&a, version);
+    wait(&b, version);
+    wait(&c, version);
+    CHECK(c.req.ended && c.req.status && strncmp(c.req.status, "503", 3) == 0);
+    check_stats(2, 1, 1, 1, 0);
+
+    // A session that goes away removes every waiter on it, here two
+    // pipelined requests of one keep-alive session
+    disconnect(&b);
+    check_stats(1, 1, 1, 1, 0);
+    wait(&a, version);
+    check_stats(2, 1, 1, 1, 0);
+    a.req.free_ctx(a.req.sess_ctx);
+    check_stats(0, 1, 1, 1, 0);
+
+    // A client that vanished without its session closing is closed on the
+    // next wake, the others still get their answer
+    connect_client(&b);
+    wait(&a, version);
+    wait(&b, version);
+    close(b.fd[1]);
+    const int closed = httpd_host_closed;
+    longpoll_post(true);
+    check_answer(&a, ++version);
+    check_stats(0, 2, 1, 1, 1);
+    CHECK(httpd_host_closed == closed + 1);
+
+    disconnect(&a);
+    close(b.fd[0]);
+    free(b.req.body);
+    disconnect(&c);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include <stdint.h>
+#include "powerfail_sim.h"
+#include "host_test.h"
+
+/* The power-cut simulation with the default Kconfig policy (60 s period,
+ * 5 s idle) and a 10 ms hold-up, cut at random times and inside flash
+ * operations, with and without the warning. The worst loss must stay
+ * within the bound the design claims for each case. */
+int main(void) {
+    for (int mode = 0; mode < 4; mode++) {
+        const powerfail_sim_config_t cfg = {
+            .period_s = 60,
+            .idle_s = 5,
+            .holdup_us = 10000,
+            .warning = mode & 1,
+            .at_op = mode & 2,
+            .trials = 500,
+        };
+        powerfail_sim_result_t r;
+        CHECK(powerfail_sim_run(&cfg, &r) == ESP_OK);
+        printf("%s warning, cuts %s: max loss %lld ms, mean %lld ms, bound %lld ms\n",
+               cfg.warning ? "with" : "no", cfg.at_op ? "during flash ops" : "at random times",
+               (long long)(r.max_loss_us / 1000), (long long)(r.mean_loss_us / 1000),
+               (long long)(r.bound_us / 1000));
+        CHECK(r.max_loss_us >= 0 && r.max_loss_us <= r.bound_us);
+    }
+    return 0;
+}
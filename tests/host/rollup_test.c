@@ -0,0 +1,11 @@
+#include "rollup.h"
+#include "host_test.h"
+
+/* rollup_benchmark() on the host: a month of eight synthetic channels at
+ * 10 s ticks into RAM journals, a flush and remount late on the second to
+ * last day, then the minute, hour and day sums of the last complete day
+ * must agree. Logs bytes per day per level and query costs. */
+int main(void) {
+    CHECK(rollup_benchmark() == ESP_OK);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include "esp_timer.h"
+#include "run_timer.h"
+#include "channels.h"
+#include "host_test.h"
+
+/* Days of the slave's once-a-second timer with jittered and stalled
+ * callbacks, and start/stop/reset commands at random instants between them.
+ * The counters must equal the run time summed independently, to the
+ * microsecond, at every callback; the old per-callback increment is run
+ * alongside to show the drift it would have had. */
+#define SIM_DAYS 7
+#define SIM_CHANNELS 4
+#define PERIOD_US 1000000
+#define JITTER_US 100000        // +/- on every callback
+#define STALL_PERMILLE 10       // callbacks held back by a flash commit
+#define STALL_MAX_US 3000000
+
+typedef struct {
+    bool running;
+    int64_t start_us;
+    int64_t total_us;           // reference
+    int64_t naive_s;            // what "seconds++" per callback would count
+} reference_t;
+
+static void command(reference_t *r, run_timer_t *t, channels_t *c, uint16_t ch, uint32_t what, int64_t now) {
+    int64_t run_us;
+    switch (what % 3) {
+    case 0:
+        if (!r->running) {
+            r->running = true;
+            r->start_us = now;
+        }
+        if (ch == 0) {
+            run_timer_start(t, now);
+        }
+        channels_start(c, ch, now);
+        break;
+    case 1:
+        if (r->running) {
+            r->total_us += now - r->start_us;
+            r->running = false;
+        }
+        if (ch == 0) {
+            run_timer_stop(t, now);
+        }
+        channels_stop(c, ch, now, &run_us);
+        break;
+    default:
+        r->total_us = 0;
+        r->naive_s = 0;
+        r->start_us = now;
+        if (ch == 0) {
+            run_timer_reset(t, now);
+        }
+        channels_reset(c, ch, now);
+        break;
+    }
+}
+
+static int64_t expected(const reference_t *r, int64_t now) {
+    return r->total_us + (r->running ? now - r->start_us : 0);
+}
+
+int main(void) {
+    uint32_t rng = 0x31u;
+    host_clock_simulated = true;
+    host_clock_us = 5000000;    // boot takes a while
+
+    run_timer_t timer;
+    run_timer_init(&timer, 0);
+    channels_t ch;
+    CHECK(channels_init(&ch, SIM_CHANNELS) == ESP_OK);
+    reference_t ref[SIM_CHANNELS] = { 0 };
+    int64_t totals[SIM_CHANNELS];
+    uint32_t running[CHANNELS_WORDS(SIM_CHANNELS)];
+
+    const int64_t end = host_clock_us + SIM_DAYS * 86400LL * 1000000;
+    int64_t next_tick = host_clock_us + PERIOD_US;
+    uint32_t ticks = 0, stalls = 0, commands = 0;
+    while (host_clock_us < end) {
+        // A command now and then, at an arbitrary instant before the tick
+        if (test_rand(&rng) % 60 == 0) {
+            const int64_t at = host_clock_us + test_rand(&rng) % (next_tick - host_clock_us + 1);
+            const uint16_t c = test_rand(&rng) % SIM_CHANNELS;
+            // Resets are rare next to starts and stops
+            const uint32_t what = test_rand(&rng) % 500 == 0 ? 2 : test_rand(&rng) % 2;
+            host_clock_us = at;
+            command(&ref[c], &timer, &ch, c, what, esp_timer_get_time());
+            commands++;
+        }
+
+        host_clock_us = next_tick;
+        const int64_t now = esp_timer_get_time();
+        ticks++;
+        CHECK(run_timer_elapsed_us(&timer, now) == expected(&ref[0], now));
+        channels_snapshot(&ch, now, totals, running);
+        for (uint16_t c = 0; c < SIM_CHANNELS; c++) {
+            CHECK(totals[c] == expected(&ref[c], now));
+            CHECK(channels_elapsed_us(&ch, c, now) == totals[c]);
+            CHECK(channels_is_running(&ch, c) == ref[c].running);
+            if (ref[c].running) {
+                ref[c].naive_s++;
+            }
+        }
+        run_timer_dhms_t d;
+        run_timer_to_dhms(expected(&ref[0], now), &d);
+        CHECK(((d.days * 24LL + d.hours) * 60 + d.minutes) * 60 + d.seconds == expected(&ref[0], now) / 1000000);
+
+        // The next callback: period plus jitter, sometimes a long stall
+        int64_t delay = PERIOD_US - JITTER_US + test_rand(&rng) % (2 * JITTER_US + 1);
+        if (test_rand(&rng) % 1000 < STALL_PERMILLE) {
+            delay += test_rand(&rng) % STALL_MAX_US;
+            stalls++;
+        }
+        next_tick += delay;
+    }
+
+    printf("%d days, %lu callbacks (%lu stalled), %lu commands: 0 us drift on %d channels\n",
+           SIM_DAYS, (unsigned long)ticks, (unsigned long)stalls, (unsigned long)commands, SIM_CHANNELS);
+    for (uint16_t c = 0; c < SIM_CHANNELS; c++) {
+        const int64_t s = expected(&ref[c], host_clock_us) / 1000000;
+        printf("  channel %u: %lld s counted, a per-callback increment would show %lld s (%+lld)\n",
+               c, (long long)s, (long long)ref[c].naive_s, (long long)(ref[c].naive_s - s));
+    }
+    channels_free(&ch);
+    return 0;
+}
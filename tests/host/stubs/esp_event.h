@@ -0,0 +1,19 @@
+#ifndef ESP_EVENT_H_
+#define ESP_EVENT_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Host stand-in for the default event loop: one registered handler, which
+ * esp_event_host_post() calls at once. */
+typedef const char *esp_event_base_t;
+typedef void *esp_event_handler_instance_t;
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t base, int32_t id, void *data);
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler,
+                                              void *arg, esp_event_handler_instance_t *instance);
+
+/* Deliver an event to the registered handler, if it asked for base and id. */
+void esp_event_host_post(esp_event_base_t base, int32_t id, void *data);
+
+#endif
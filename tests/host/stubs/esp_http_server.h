@@ -0,0 +1,123 @@
+#ifndef ESP_HTTP_SERVER_H_
+#define ESP_HTTP_SERVER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+/* Host stand-in for the parts of esp_http_server.h the handlers use. A
+ * request carries its query, Accept header, socket and any incoming
+ * WebSocket message in, and collects the response type and chunked body
+ * or WebSocket reply in a growing buffer (httpd_host.c). Raw sends go to
+ * the request's socket; queued work runs at once. httpd_start() and the
+ * client list are driven by the httpd_host_* variables below. */
+#define ESP_ERR_HTTPD_BASE 0xb000
+#define ESP_ERR_HTTPD_HANDLERS_FULL (ESP_ERR_HTTPD_BASE + 1)
+#define ESP_ERR_HTTPD_RESULT_TRUNC (ESP_ERR_HTTPD_BASE + 3)
+
+#define HTTPD_RESP_USE_STRLEN -1
+
+typedef void *httpd_handle_t;
+typedef void (*httpd_free_ctx_fn_t)(void *ctx);
+typedef void (*httpd_work_fn_t)(void *arg);
+
+typedef enum {
+    HTTP_GET = 1,
+} httpd_method_t;
+
+typedef enum {
+    HTTPD_400_BAD_REQUEST,
+    HTTPD_404_NOT_FOUND,
+    HTTPD_500_INTERNAL_SERVER_ERROR,
+} httpd_err_code_t;
+
+typedef enum {
+    HTTPD_WS_TYPE_CONTINUE = 0x0,
+    HTTPD_WS_TYPE_TEXT = 0x1,
+    HTTPD_WS_TYPE_BINARY = 0x2,
+    HTTPD_WS_TYPE_CLOSE = 0x8,
+    HTTPD_WS_TYPE_PING = 0x9,
+    HTTPD_WS_TYPE_PONG = 0xA,
+} httpd_ws_type_t;
+
+typedef struct {
+    bool final;
+    bool fragmented;
+    httpd_ws_type_t type;
+    uint8_t *payload;
+    size_t len;
+} httpd_ws_frame_t;
+
+typedef struct httpd_req {
+    int method;                 // HTTP_GET, or 0 for a WebSocket message
+    const char *query;          // NULL for none
+    const char *accept;         // Accept header, NULL for none
+    int fd;                     // socket for raw sends
+    httpd_ws_type_t ws_type;    // incoming WebSocket message
+    const uint8_t *ws_payload;
+    size_t ws_len;
+    void *sess_ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    const char *type;           // set by the handler
+    const char *status;         // NULL for 200
+    char *body;
+    size_t len;
+    size_t cap;
+    bool ended;                 // terminating chunk or whole response sent
+} httpd_req_t;
+
+typedef struct {
+    uint16_t max_open_sockets;
+    uint16_t max_uri_handlers;
+    bool lru_purge_enable;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() { .max_open_sockets = 7, .max_uri_handlers = 8 }
+
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+    bool is_websocket;
+} httpd_uri_t;
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri);
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t len);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t len);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *field, char *val, size_t len);
+esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status);
+esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t len);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg);
+int httpd_send(httpd_req_t *req, const char *buf, size_t len);
+int httpd_req_to_sockfd(httpd_req_t *req);
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd);
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg);
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *frame, size_t max_len);
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *frame);
+
+/* Handler registered for uri, NULL if none. */
+esp_err_t (*httpd_host_handler(const char *uri))(httpd_req_t *req);
+
+/* Empty the response of req for the next call. */
+void httpd_host_reset(httpd_req_t *req);
+
+/* Sessions closed through httpd_sess_trigger_close() so far. */
+extern int httpd_host_closed;
+
+/* Servers started so far, and what the next httpd_start() returns. */
+extern int httpd_host_starts;
+extern esp_err_t httpd_host_start_result;
+
+/* Open sessions reported by httpd_get_client_list(). */
+extern int httpd_host_clients[];
+extern size_t httpd_host_n_clients;
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef ESP_LOG_H_
+#define ESP_LOG_H_
+
+#include <stdio.h>
+
+/* Host stand-in for esp_log.h: errors and warnings go to stderr, info to
+ * stdout (benchmarks report through it), debug and verbose are dropped. */
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) printf("I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGV(tag, fmt, ...) ((void)(tag))
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef ESP_NETIF_H_
+#define ESP_NETIF_H_
+
+#include <stdbool.h>
+#include "esp_event.h"
+
+/* Host stand-in for the IP events of esp_netif_types.h. */
+extern esp_event_base_t const IP_EVENT;
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef struct {
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+#endif
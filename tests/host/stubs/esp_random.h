@@ -0,0 +1,12 @@
+#ifndef ESP_RANDOM_H_
+#define ESP_RANDOM_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Host stand-in for the hardware RNG. */
+static inline uint32_t esp_random(void) {
+    return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+#endif
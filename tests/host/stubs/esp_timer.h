@@ -0,0 +1,15 @@
+#ifndef ESP_TIMER_H_
+#define ESP_TIMER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Host stand-in for esp_timer_get_time(). It follows the host's monotonic
+ * clock until a test sets host_clock_simulated, then returns host_clock_us,
+ * which the test advances itself. */
+extern bool host_clock_simulated;
+extern int64_t host_clock_us;
+
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef FREERTOS_H_
+#define FREERTOS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Host stand-in for the FreeRTOS kernel: the tests are single threaded, so
+ * critical sections, mutexes and notifications do nothing, and tasks are
+ * never started. */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFu
+#define portTICK_PERIOD_MS 10
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define configMAX_PRIORITIES 25
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define taskENTER_CRITICAL(mux) ((void)(mux))
+#define taskEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif
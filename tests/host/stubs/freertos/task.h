@@ -0,0 +1,37 @@
+#ifndef FREERTOS_TASK_H_
+#define FREERTOS_TASK_H_
+
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                     UBaseType_t prio, TaskHandle_t *handle) {
+    if (handle) {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    return 0;
+}
+
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return pdPASS;
+}
+
+static inline void vTaskDelay(TickType_t ticks) {
+}
+
+static inline TaskHandle_t xTaskGetHandle(const char *name) {
+    return NULL;
+}
+
+static inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return 0;
+}
+
+#endif
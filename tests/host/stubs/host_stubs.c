@@ -0,0 +1,48 @@
+#include <time.h>
+#include <stdio.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+
+bool host_clock_simulated;
+int64_t host_clock_us;
+
+int64_t esp_timer_get_time(void) {
+    if (host_clock_simulated) {
+        return host_clock_us;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    static char name[16];
+    snprintf(name, sizeof(name), "0x%x", code);
+    return name;
+}
+
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+static struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event;
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler,
+                                              void *arg, esp_event_handler_instance_t *instance) {
+    event.base = base;
+    event.id = id;
+    event.handler = handler;
+    event.arg = arg;
+    return ESP_OK;
+}
+
+void esp_event_host_post(esp_event_base_t base, int32_t id, void *data) {
+    if (event.handler && base == event.base && id == event.id) {
+        event.handler(event.arg, base, id, data);
+    }
+}
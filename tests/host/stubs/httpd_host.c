@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include "esp_http_server.h"
+
+#define MAX_URIS 16
+#define MAX_CLIENTS 16
+
+static httpd_uri_t uris[MAX_URIS];
+static size_t n_uris;
+
+int httpd_host_closed;
+int httpd_host_starts;
+esp_err_t httpd_host_start_result = ESP_OK;
+int httpd_host_clients[MAX_CLIENTS];
+size_t httpd_host_n_clients;
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    if (httpd_host_start_result != ESP_OK) {
+        return httpd_host_start_result;
+    }
+    httpd_host_starts++;
+    *handle = (httpd_handle_t)1;
+    return ESP_OK;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds) {
+    if (*fds < httpd_host_n_clients) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(client_fds, httpd_host_clients, httpd_host_n_clients * sizeof(int));
+    *fds = httpd_host_n_clients;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri) {
+    if (n_uris == MAX_URIS) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    uris[n_uris++] = *uri;
+    return ESP_OK;
+}
+
+esp_err_t (*httpd_host_handler(const char *uri))(httpd_req_t *req) {
+    for (size_t i = 0; i < n_uris; i++) {
+        if (strcmp(uris[i].uri, uri) == 0) {
+            return uris[i].handler;
+        }
+    }
+    return NULL;
+}
+
+void httpd_host_reset(httpd_req_t *req) {
+    req->type = NULL;
+    req->status = NULL;
+    req->len = 0;
+    req->ended = false;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type) {
+    req->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t len) {
+    if (buf == NULL || len == 0) {
+        req->ended = true;
+        return ESP_OK;
+    }
+    if (req->len + len > req->cap) {
+        req->cap = (req->len + len) * 2;
+        req->body = realloc(req->body, req->cap);
+        if (req->body == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    memcpy(&req->body[req->len], buf, len);
+    req->len += len;
+    return ESP_OK;
+}
+
+static esp_err_t copy(const char *s, size_t n, char *buf, size_t len) {
+    if (len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const size_t m = n < len - 1 ? n : len - 1;
+    memcpy(buf, s, m);
+    buf[m] = '\0';
+    return m < n ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t len) {
+    return req->query ? copy(req->query, strlen(req->query), buf, len) : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t len) {
+    const size_t klen = strlen(key);
+    while (*qry) {
+        const char *end = strchr(qry, '&');
+        const size_t n = end ? (size_t)(end - qry) : strlen(qry);
+        if (n > klen && strncmp(qry, key, klen) == 0 && qry[klen] == '=') {
+            return copy(&qry[klen + 1], n - klen - 1, val, len);
+        }
+        qry += end ? n + 1 : n;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *field, char *val, size_t len) {
+    if (strcasecmp(field, "Accept") != 0 || req->accept == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy(req->accept, strlen(req->accept), val, len);
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status) {
+    req->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t len) {
+    const esp_err_t err = httpd_resp_send_chunk(req, buf, len == HTTPD_RESP_USE_STRLEN ? (ssize_t)strlen(buf) : len);
+    req->ended = true;
+    return err;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    req->status = error == HTTPD_400_BAD_REQUEST ? "400 Bad Request"
+                  : error == HTTPD_404_NOT_FOUND ? "404 Not Found" : "500 Internal Server Error";
+    httpd_resp_send(req, msg, HTTPD_RESP_USE_STRLEN);
+    return ESP_FAIL;
+}
+
+int httpd_send(httpd_req_t *req, const char *buf, size_t len) {
+    return send(req->fd, buf, len, 0);
+}
+
+int httpd_req_to_sockfd(httpd_req_t *req) {
+    return req->fd;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    httpd_host_closed++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+    work(arg);
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *frame, size_t max_len) {
+    if (req->ws_len > max_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(frame->payload, req->ws_payload, req->ws_len);
+    frame->type = req->ws_type;
+    frame->len = req->ws_len;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *frame) {
+    return httpd_resp_send_chunk(req, (const char *)frame->payload, frame->len);
+}
@@ -0,0 +1,6 @@
+#include "journal.h"
+
+// No flash partitions on the host; tests use journal_ram_init()
+esp_err_t journal_partition_init(journal_flash_t *flash, const char *label) {
+    return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,10 @@
+#ifndef LWIP_SOCKETS_H_
+#define LWIP_SOCKETS_H_
+
+/* Host stand-in for lwip/sockets.h: the host's BSD sockets. */
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#endif